@@ -8,13 +8,185 @@
 #include "TLegend.h"
 #include "TROOT.h"
 #include "TGraphAsymmErrors.h"
+#include "Math/MinimizerOptions.h"
 
+#include "HcalTrigger/Validation/interface/QuantileSketch.h"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
 #include <map>
 #include <string>
+#include <thread>
 #include <vector>
+#include <unistd.h>
+
+// sum of the response stores (offline vs L1) of a file, e.g. over |eta| regions
+TH2* sumResponses(TFile* file, const std::vector<std::string>& names, const std::string& name)
+{
+  TH2* sum = 0;
+  for (const std::string& part : names) {
+    TH2* response = dynamic_cast<TH2*>(file->Get(part.c_str()));
+    if (!response) continue;
+    if (!sum) {
+      sum = static_cast<TH2*>(response->Clone(name.c_str()));
+      sum->SetDirectory(0);
+    }
+    else sum->Add(response);
+  }
+  return sum;
+}
+
+// Offline spectra of the objects with an L1 value above each threshold,
+// from a response store: the L1 bins are summed from the top down once per
+// offline bin, so each threshold is a lookup. The bins hold single L1
+// values (multiples of 0.5 GeV), so a bin passes if its lower edge is
+// above the threshold. The last spectrum is the denominator: every
+// object, or only those with an L1 match (not in the L1 underflow).
+std::vector<TH1D*> turnOnSpectra(const TH2* response, const std::vector<double>& thresholds, const std::string& name,
+				 bool matchedOnly)
+{
+  const TAxis* l1Axis = response->GetYaxis();
+  int nL1 = l1Axis->GetNbins();
+  std::vector<int> firstBins;
+  for (double threshold : thresholds) {
+    int bin = l1Axis->FindBin(threshold);
+    if (bin >= 1 && bin <= nL1 && l1Axis->GetBinLowEdge(bin) <= threshold) bin++;
+    firstBins.push_back(std::max(bin, 0));
+  }
+  firstBins.push_back(matchedOnly ? 1 : 0);
+
+  std::vector<TH1D*> spectra;
+  for (size_t t=0; t<firstBins.size(); t++) {
+    std::string spectrumName = t < thresholds.size() ? Form("%s%g", name.c_str(), thresholds[t]) : name + "Ref";
+    spectra.push_back(response->ProjectionX(spectrumName.c_str(), 1, 0, "e"));
+    spectra.back()->Reset();
+    spectra.back()->SetDirectory(0);
+  }
+  std::vector<double> above(nL1+3, 0.);
+  for (int x=0; x<=response->GetXaxis()->GetNbins()+1; x++) {
+    // above[y]: the objects in L1 bins y and up
+    above[nL1+2] = 0.;
+    for (int y=nL1+1; y>=0; y--) above[y] = above[y+1] + response->GetBinContent(x, y);
+    for (size_t t=0; t<firstBins.size(); t++) {
+      double n = above[std::min(firstBins[t], nL1+2)];
+      spectra[t]->SetBinContent(x, n);
+      spectra[t]->SetBinError(x, sqrt(n));
+    }
+  }
+  return spectra;
+}
+
+// One Gaussian fit of the fitting stage: a whole histogram, or the y
+// slice of one x bin of a 2D histogram (as FitSlicesY fits them). Each
+// task has its own function, so the fits share nothing and can run at the
+// same time.
+struct FitTask {
+  std::string name;  // of the histogram, and the condition, for the table
+  int slice;         // x bin, -1 for a whole histogram
+  double xLow, xHigh;
+  TH1* hist;
+  TF1* function;
+  int status;
+};
+
+// a task fitting hist (or a slice of it) in [lo, hi]
+FitTask fitTask(const std::string& name, int slice, double xLow, double xHigh, TH1* hist, double lo, double hi)
+{
+  static int nFunctions = 0;
+  FitTask task = {name, slice, xLow, xHigh, hist, new TF1(Form("fitGaus%d", nFunctions++), "gaus", lo, hi), -1};
+  return task;
+}
+
+// tasks for the y slices of the non-empty x bins of hist
+void addSliceTasks(std::vector<FitTask>& tasks, const TH2* hist, const std::string& name, double lo, double hi)
+{
+  for (int x=1; x<=hist->GetXaxis()->GetNbins(); x++) {
+    TH1D* slice = hist->ProjectionY(Form("%s_slice%d", name.c_str(), x), x, x, "e");
+    slice->SetDirectory(0);
+    if (slice->GetEntries() == 0) {
+      delete slice;
+      continue;
+    }
+    tasks.push_back(fitTask(name, x, hist->GetXaxis()->GetBinLowEdge(x), hist->GetXaxis()->GetBinUpEdge(x), slice, lo, hi));
+  }
+}
+
+// run the fits on nThreads threads, each taking the next task until none is
+// left; every result stays with its task, so the order is that of tasks
+void runFits(std::vector<FitTask>& tasks, int nThreads)
+{
+  std::atomic<size_t> next(0);
+  auto work = [&tasks, &next]() {
+    for (size_t t; (t = next++) < tasks.size(); ) {
+      tasks[t].status = tasks[t].hist->Fit(tasks[t].function, "QNR");
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t=1; t<nThreads; t++) threads.push_back(std::thread(work));
+  work();
+  for (std::thread& thread : threads) thread.join();
+}
+
+// false if the histogram had too few points for the fit
+bool fitted(const FitTask& task)
+{
+  return task.function->GetNumberFitPoints() > task.function->GetNpar();
+}
+
+// parameter p (1: mean, 2: sigma) of the slice fits of hist, named
+// <hist>_<p> like the histograms of FitSlicesY; slices with too few points
+// for the fit are left empty. 0 without hist.
+TH1D* sliceParameter(const std::vector<FitTask>& tasks, const TH2* hist, const std::string& name, int p)
+{
+  if (!hist) return 0;
+  const TAxis* axis = hist->GetXaxis();
+  TH1D* result = new TH1D(Form("%s_%d", hist->GetName(), p), "", axis->GetNbins(), axis->GetXmin(), axis->GetXmax());
+  result->SetDirectory(0);
+  for (const FitTask& task : tasks) {
+    if (task.name != name || task.slice < 0 || !fitted(task)) continue;
+    result->SetBinContent(task.slice, task.function->GetParameter(p));
+    result->SetBinError(task.slice, task.function->GetParError(p));
+  }
+  return result;
+}
+
+// the fitted parameters of every task, in task order
+bool writeFitTable(const std::string& fileName, const std::vector<FitTask>& tasks)
+{
+  std::ofstream table(fileName.c_str());
+  table << "# histogram slice xLow xHigh entries status constant mean meanError sigma sigmaError chi2 ndf\n";
+  for (const FitTask& task : tasks) {
+    table << task.name << ' ' << task.slice << ' ' << task.xLow << ' ' << task.xHigh << ' ' << task.hist->GetEntries()
+	  << ' ' << task.status << ' ' << task.function->GetParameter(0)
+	  << ' ' << task.function->GetParameter(1) << ' ' << task.function->GetParError(1)
+	  << ' ' << task.function->GetParameter(2) << ' ' << task.function->GetParError(2)
+	  << ' ' << task.function->GetChisquare() << ' ' << task.function->GetNDF() << '\n';
+  }
+  return table.good();
+}
 
-int main()
+int main(int argc, char *argv[])
 {
+  // L1 thresholds (GeV) of the jet and MET turn-ons, given with -j and -m
+  std::vector<double> jetThresholds, metThresholds;
+  // threads of the fitting stage, given with -t
+  int nThreads = std::max(1u, std::thread::hardware_concurrency());
+  int opt;
+  while ((opt = getopt(argc, argv, "j:m:t:")) != -1) {
+    if (opt == 'j') jetThresholds.push_back(atof(optarg));
+    else if (opt == 'm') metThresholds.push_back(atof(optarg));
+    else if (opt == 't' && atoi(optarg) > 0) nThreads = atoi(optarg);
+    else {
+      std::cout << "Usage: draw_l1analysis.exe [-j jet threshold]... [-m MET threshold]... [-t threads]\n"
+		<< "  turn-ons at the given L1 thresholds (GeV), derived from the response stores\n"
+		<< "  -t runs the resolution fits on that many threads (default: all cores)" << std::endl;
+      return 1;
+    }
+  }
+  if (jetThresholds.empty()) jetThresholds = {50, 64, 76, 92, 112, 180};
+  if (metThresholds.empty()) metThresholds = {30, 40, 50, 70, 100};
+
   // include comparisons between HW and data TPs
   bool includeHW = false;
   int rebinFactor = 1;
@@ -27,10 +199,9 @@ int main()
   std::vector<std::string> l1Types = {"singleJet", "doubleJet", "tripleJet", "quadJet",
 					"htSum", "etSum", "metSum", "metHFSum"};
   
-  std::vector<std::string> jetrefTypes = {"RefJet","RefmJet" };
-  std::vector<std::string> jetTypes = {"JetEt50","JetEt64","JetEt76","JetEt92","JetEt112","JetEt180"};
-  std::vector<std::string> sumrefTypes = {"RefMET"};
-  std::vector<std::string> sumTypes = {"MET30","MET40","MET50","MET70","MET100"};
+  // response stores, summed over the |eta| regions for the turn-ons
+  std::vector<std::string> jetResponses = {"respLeadJet_hb", "respLeadJet_he", "respLeadJet_hf"};
+  std::vector<std::string> metResponses = {"respMET"};
   // std::vector<std::string> resTypes = {"hresJet","hResMET"};
   
   std::vector<std::string> resTypes = {"hresJet1","hresJet2","hresJet3","hresJet4","hresJet5","hresJet6","hresJet7","hresJet8","hresJet9","hresJet10",
@@ -88,279 +259,333 @@ int main()
   for(auto pair : effHists_hw) pair.second->SetLineStyle(kDashed);
   for(auto pair : effHists_def) pair.second->SetLineStyle(kDotted);
 
-  // Efficiencies
-  std::map<std::string, TH1F*> jetHists_def;
-  std::map<std::string, TH1F*> jetHists_new_cond;
-  std::map<std::string, TH1F*> metHists_def;
-  std::map<std::string, TH1F*> metHists_new_cond;
-
-  std::map<std::string, TGraphAsymmErrors*> jeteffHists_def;
-  std::map<std::string, TGraphAsymmErrors*> jeteffHists_new_cond;
-  std::map<std::string, TGraphAsymmErrors*> meteffHists_def;
-  std::map<std::string, TGraphAsymmErrors*> meteffHists_new_cond;
-
-
   //-----------------------------------------------------------------------
-  // L1 Jet efficiencies
+  // L1 Jet and ETM efficiencies, at any threshold from the response stores
   //-----------------------------------------------------------------------
 
-  int rebinF=2;
-  
-  TH1F *jetrefHists_def=dynamic_cast<TH1F*>(files.at(0)->Get("RefmJet"));jetrefHists_def->Rebin(rebinF);
-  TH1F *jetrefHists_new_cond=dynamic_cast<TH1F*>(files.at(1)->Get("RefmJet"));jetrefHists_new_cond->Rebin(rebinF);
-  
   std::vector<TCanvas*> tcanvases;
-  
-  for (auto jetType : jetTypes) {
 
-    tcanvases.push_back(new TCanvas);
-    tcanvases.back()->SetWindowSize(tcanvases.back()->GetWw(), 1.3*tcanvases.back()->GetWh());
-    gPad->SetGridx(); gPad->SetGridy();
-    std::string histName(jetType);
+  struct TurnOns {
+    std::vector<std::string> responses;
+    std::vector<double> thresholds;
+    std::string prefix, plotSuffix, title;
+    bool matchedOnly;  // denominator: the objects with an L1 match
+    int rebin;
+  };
+  std::vector<TurnOns> turnOns = {
+    {jetResponses, jetThresholds, "JetEt", "jetEffs_emu", "offline Jet E_{T} (GeV)", true, 1},
+    {metResponses, metThresholds, "MET", "metEffs_emu", "offline MET (GeV)", false, 2}};
+
+  for (const TurnOns& turnOn : turnOns) {
+    std::vector<std::vector<TH1D*> > spectra;
+    for (size_t f=0; f<files.size(); f++) {
+      TH2* response = sumResponses(files.at(f), turnOn.responses, Form("%sResponse%zu", turnOn.prefix.c_str(), f));
+      if (!response) {
+	std::cout << "No " << turnOn.responses.front() << " in " << filenames.at(f)
+		  << ", rerun l1jetanalysis.exe for the turn-ons" << std::endl;
+	break;
+      }
+      spectra.push_back(turnOnSpectra(response, turnOn.thresholds, Form("%s%zu_", turnOn.prefix.c_str(), f),
+				      turnOn.matchedOnly));
+      for (TH1D* spectrum : spectra.back()) spectrum->Rebin(turnOn.rebin);
+    }
+    if (spectra.size() < files.size()) continue;
 
-    jetHists_def[jetType] = dynamic_cast<TH1F*>(files.at(0)->Get(histName.c_str()));
-    jetHists_new_cond[jetType] = dynamic_cast<TH1F*>(files.at(1)->Get(histName.c_str()));
+    for (size_t t=0; t<turnOn.thresholds.size(); t++) {
 
-    jetHists_def[jetType]->Rebin(rebinF);
-    jetHists_new_cond[jetType]->Rebin(rebinF);
+      tcanvases.push_back(new TCanvas);
+      tcanvases.back()->SetWindowSize(tcanvases.back()->GetWw(), 1.3*tcanvases.back()->GetWh());
+      gPad->SetGridx(); gPad->SetGridy();
 
-    TGraphAsymmErrors *Eff1 = new TGraphAsymmErrors();
-    TGraphAsymmErrors *Eff2 = new TGraphAsymmErrors();
-    
-    Eff1->BayesDivide(jetHists_def[jetType],jetrefHists_def);
-    Eff2->BayesDivide(jetHists_new_cond[jetType],jetrefHists_new_cond);
+      TGraphAsymmErrors *Eff1 = new TGraphAsymmErrors();
+      TGraphAsymmErrors *Eff2 = new TGraphAsymmErrors();
 
-    jeteffHists_def[jetType] = Eff1;
-    jeteffHists_new_cond[jetType] = Eff2;
-    
-    jeteffHists_def[jetType]->SetMarkerColor(kBlack);
-    jeteffHists_new_cond[jetType]->SetMarkerColor(kRed);
+      Eff1->BayesDivide(spectra[0][t], spectra[0].back());
+      Eff2->BayesDivide(spectra[1][t], spectra[1].back());
 
-    jeteffHists_def[jetType]->SetMarkerSize(0.8);
-    jeteffHists_new_cond[jetType]->SetMarkerSize(0.8);
-    
-    jeteffHists_def[jetType]->Draw("AP");
-    jeteffHists_new_cond[jetType]->Draw("P");
-    jeteffHists_def[jetType]->GetXaxis()->SetTitle("offline Jet E_{T} (GeV)");
-    jeteffHists_def[jetType]->GetYaxis()->SetTitle("Efficiency");
+      Eff1->SetMarkerColor(kBlack);
+      Eff2->SetMarkerColor(kRed);
 
-    tcanvases.back()->Print(Form("plots/%sjetEffs_emu.pdf", jetType.c_str()));
-    
+      Eff1->SetMarkerSize(0.8);
+      Eff2->SetMarkerSize(0.8);
+
+      Eff1->Draw("AP");
+      Eff2->Draw("P");
+      Eff1->GetXaxis()->SetTitle(turnOn.title.c_str());
+      Eff1->GetYaxis()->SetTitle("Efficiency");
+
+      tcanvases.back()->Print(Form("plots/%s%g%s.pdf", turnOn.prefix.c_str(), turnOn.thresholds[t],
+				   turnOn.plotSuffix.c_str()));
+    }
+  }
+
+  //-----------------------------------------------------------------------
+  // Resolution fits: the slices of hresJet and hResMET, and the hresJet*
+  // and hresMET* histograms, of both conditions, all fitted at once
+  //-----------------------------------------------------------------------
+
+  // the ranges of the original fits: the FitSlicesY functions had
+  // SetRange(-1.,1.) (jets) and SetRange(-1.,3.) (MET), the per-bin
+  // histograms were fitted in -2..2
+  std::vector<std::string> conditions = {"def", "new_cond"};
+  std::vector<TH2F*> resJet, resMET;
+  std::vector<std::map<std::string, TH1F*> > resHists(files.size());
+  std::vector<FitTask> fitTasks;
+  for (size_t f=0; f<files.size(); f++) {
+    resJet.push_back(dynamic_cast<TH2F*>(files.at(f)->Get("hresJet")));
+    if (resJet.back()) {
+      resJet.back()->RebinX(4);
+      addSliceTasks(fitTasks, resJet.back(), "hresJet_" + conditions[f], -1., 1.);
+    }
+    else std::cout << "No hresJet in " << filenames[f] << std::endl;
+    resMET.push_back(dynamic_cast<TH2F*>(files.at(f)->Get("hResMET")));
+    if (resMET.back()) {
+      resMET.back()->RebinX(5);
+      addSliceTasks(fitTasks, resMET.back(), "hResMET_" + conditions[f], -1., 3.);
+    }
+    else std::cout << "No hResMET in " << filenames[f] << std::endl;
+    for (auto rType : resTypes) {
+      resHists[f][rType] = dynamic_cast<TH1F*>(files.at(f)->Get(rType.c_str()));
+      if (!resHists[f][rType]) {
+	std::cout << "No " << rType << " in " << filenames[f] << std::endl;
+	continue;
+      }
+      resHists[f][rType]->Rebin(rebinFactor);
+      fitTasks.push_back(fitTask(rType + "_" + conditions[f], -1, 0., 0., resHists[f][rType], -2., 2.));
+    }
+  }
+  gROOT->cd();
+
+  // Minuit2 can minimise on several threads at once, TMinuit cannot
+  ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2");
+  if (nThreads > 1) ROOT::EnableThreadSafety();
+  runFits(fitTasks, nThreads);
+  if (!writeFitTable("plots/resolution_fits.txt", fitTasks)) {
+    std::cout << "Cannot write plots/resolution_fits.txt" << std::endl;
   }
 
+  // means and widths of the slices, as FitSlicesY made them, per condition
+  TH1D *resJet_def_1 = sliceParameter(fitTasks, resJet[0], "hresJet_def", 1);
+  TH1D *resJet_def_2 = sliceParameter(fitTasks, resJet[0], "hresJet_def", 2);
+  TH1D *resJet_new_cond_1 = sliceParameter(fitTasks, resJet[1], "hresJet_new_cond", 1);
+  TH1D *resJet_new_cond_2 = sliceParameter(fitTasks, resJet[1], "hresJet_new_cond", 2);
+  TH1D *resMET_def_1 = sliceParameter(fitTasks, resMET[0], "hResMET_def", 1);
+  TH1D *resMET_def_2 = sliceParameter(fitTasks, resMET[0], "hResMET_def", 2);
+  TH1D *resMET_new_cond_1 = sliceParameter(fitTasks, resMET[1], "hResMET_new_cond", 1);
+  TH1D *resMET_new_cond_2 = sliceParameter(fitTasks, resMET[1], "hResMET_new_cond", 2);
+  TFile* fitFile = TFile::Open("plots/resolution_fits.root", "recreate");
+  if (fitFile && !fitFile->IsZombie()) {
+    std::vector<std::vector<TH1D*> > fitHists = {{resJet_def_1, resJet_def_2, resMET_def_1, resMET_def_2},
+						{resJet_new_cond_1, resJet_new_cond_2, resMET_new_cond_1, resMET_new_cond_2}};
+    for (size_t f=0; f<fitHists.size(); f++) {
+      fitFile->mkdir(conditions[f].c_str())->cd();
+      for (TH1D* hist : fitHists[f]) if (hist) hist->Write();
+    }
+    fitFile->Close();
+  }
+  else std::cout << "Cannot write plots/resolution_fits.root" << std::endl;
+  delete fitFile;
+  gROOT->cd();
+
   //-----------------------------------------------------------------------
-  // L1 ETM efficiencies
+  // L1 Jet resolution summary plots
   //-----------------------------------------------------------------------
 
-  rebinF=10;
-  TH1F *metrefHists_def=dynamic_cast<TH1F*>(files.at(0)->Get("RefMET"));metrefHists_def->Rebin(rebinF);
-  TH1F *metrefHists_new_cond=dynamic_cast<TH1F*>(files.at(1)->Get("RefMET"));metrefHists_new_cond->Rebin(rebinF);
+  // // Jet resolution
+  std::vector<TCanvas*> mycanvases;
   
-   for (auto metType : sumTypes) {
+  if (resJet[0] && resJet[1]) {
+    mycanvases.push_back(new TCanvas);
+    mycanvases.back()->SetWindowSize(mycanvases.back()->GetWw(), 1.3*mycanvases.back()->GetWh());
 
-    tcanvases.push_back(new TCanvas);
-    tcanvases.back()->SetWindowSize(tcanvases.back()->GetWw(), 1.3*tcanvases.back()->GetWh());
     gPad->SetGridx(); gPad->SetGridy();
-    std::string histName(metType);
 
-    metHists_def[metType] = dynamic_cast<TH1F*>(files.at(0)->Get(histName.c_str()));
-    metHists_new_cond[metType] = dynamic_cast<TH1F*>(files.at(1)->Get(histName.c_str()));
+    resJet_def_1->Draw("");
+    resJet_def_1->GetXaxis()->SetTitle("offline Jet E_{T} (GeV)");
+    // resJet_def_1->GetYaxis()->SetTitle("gaussian #mu");
+    resJet_def_1->GetYaxis()->SetRangeUser(-1.,1.);
+    resJet_def_1->SetMarkerSize(0.5);
+    resJet_def_1->SetMarkerStyle(24);
 
-    metHists_def[metType]->Rebin(rebinF);
-    metHists_new_cond[metType]->Rebin(rebinF);
+    resJet_new_cond_1->Draw("same");
+    resJet_new_cond_1->SetLineColor(2);
+    resJet_new_cond_1->SetMarkerColor(2);
+    resJet_new_cond_1->SetMarkerSize(0.5);
+    resJet_new_cond_1->SetMarkerStyle(20);
+    mycanvases.back()->Print(Form("plots/%s_emu.pdf", "resJet_mean"));
 
-    TGraphAsymmErrors *Eff1 = new TGraphAsymmErrors();
-    TGraphAsymmErrors *Eff2 = new TGraphAsymmErrors();
-    
-    Eff1->BayesDivide(metHists_def[metType],metrefHists_def);
-    Eff2->BayesDivide(metHists_new_cond[metType],metrefHists_new_cond);
+    mycanvases.push_back(new TCanvas);
+    mycanvases.back()->SetWindowSize(mycanvases.back()->GetWw(), 1.3*mycanvases.back()->GetWh());
 
-    meteffHists_def[metType] = Eff1;
-    meteffHists_new_cond[metType] = Eff2;
-    
-    meteffHists_def[metType]->SetMarkerColor(kBlack);
-    meteffHists_new_cond[metType]->SetMarkerColor(kRed);
+    gPad->SetGridx(); gPad->SetGridy();
 
-    meteffHists_def[metType]->SetMarkerSize(0.8);
-    meteffHists_new_cond[metType]->SetMarkerSize(0.8);
-    
-    meteffHists_def[metType]->Draw("AP");
-    meteffHists_new_cond[metType]->Draw("P");
-    meteffHists_def[metType]->GetXaxis()->SetTitle("offline MET (GeV)");
-    meteffHists_def[metType]->GetYaxis()->SetTitle("Efficiency");
+    resJet_def_2->Draw("");
+    resJet_def_2->GetXaxis()->SetTitle("offline Jet E_{T} (GeV)");
+    // resJet_def_2->GetYaxis()->SetTitle("gaussian #sigma");
+    resJet_def_2->GetYaxis()->SetRangeUser(0.,0.9);
+    resJet_def_2->SetMarkerSize(0.5);
+    resJet_def_2->SetMarkerStyle(24);
 
-    tcanvases.back()->Print(Form("plots/%smetEffs_emu.pdf", metType.c_str()));
-    
+    resJet_new_cond_2->Draw("same");
+    resJet_new_cond_2->SetLineColor(2);
+    resJet_new_cond_2->SetMarkerColor(2);
+    resJet_new_cond_2->SetMarkerSize(0.5);
+    resJet_new_cond_2->SetMarkerStyle(20);
 
+    mycanvases.back()->Print(Form("plots/%s_emu.pdf", "resJet_sigma"));
   }
-   
-   //-----------------------------------------------------------------------
-   // L1 Jet resolution summary plots
-   //-----------------------------------------------------------------------
+
+  //-----------------------------------------------------------------------
+  // L1 ETM resolution summary plots
+  //-----------------------------------------------------------------------
   
-  TF1 *fgaus = new TF1("g1","gaus");//,-2.,2.);
-  fgaus->SetRange(-1.,1.);
+  std::vector<TCanvas*> mycanvases2;
   
-  // // Jet resolution
-  std::vector<TCanvas*> mycanvases;
-  TH2F *resJet_def = dynamic_cast<TH2F*>(files.at(0)->Get("hresJet"));resJet_def->RebinX(4);
-  //  TH2F *resJet_new_cond = dynamic_cast<TH2F*>(files.at(1)->Get("hresJet"));resJet_new_cond->RebinX(4);
-  resJet_def->FitSlicesY(fgaus);
-  TH1D *resJet_def_1 = (TH1D*)gDirectory->Get("hresJet_1");
-  TH1D *resJet_def_2 = (TH1D*)gDirectory->Get("hresJet_2");
-  gROOT->cd();
+  if (resMET[0] && resMET[1]) {
+    mycanvases2.push_back(new TCanvas);
+    mycanvases2.back()->SetWindowSize(mycanvases2.back()->GetWw(), 1.3*mycanvases2.back()->GetWh());
 
-  TH2F *resJet_new_cond = dynamic_cast<TH2F*>(files.at(1)->Get("hresJet"));resJet_new_cond->RebinX(4);
-  resJet_new_cond->FitSlicesY(fgaus);
-  TH1D *resJet_new_cond_1 = (TH1D*)gDirectory->Get("hresJet_1");
-  TH1D *resJet_new_cond_2 = (TH1D*)gDirectory->Get("hresJet_2");
-  gROOT->cd();
-  
-  mycanvases.push_back(new TCanvas);
-  mycanvases.back()->SetWindowSize(mycanvases.back()->GetWw(), 1.3*mycanvases.back()->GetWh());
+    gPad->SetGridx(); gPad->SetGridy();
 
-  gPad->SetGridx(); gPad->SetGridy();
-  
-  resJet_def_1->Draw("");
-  resJet_def_1->GetXaxis()->SetTitle("offline Jet E_{T} (GeV)");
-  // resJet_def_1->GetYaxis()->SetTitle("gaussian #mu");
-  resJet_def_1->GetYaxis()->SetRangeUser(-1.,1.);
-  resJet_def_1->SetMarkerSize(0.5);
-  resJet_def_1->SetMarkerStyle(24);
- 
-  resJet_new_cond_1->Draw("same");
-  resJet_new_cond_1->SetLineColor(2);
-  resJet_new_cond_1->SetMarkerColor(2);
-  resJet_new_cond_1->SetMarkerSize(0.5);
-  resJet_new_cond_1->SetMarkerStyle(20);
-  mycanvases.back()->Print(Form("plots/%s_emu.pdf", "resJet_mean"));
+    resMET_def_1->Draw("");
+    resMET_def_1->GetXaxis()->SetTitle("offline MET (GeV)");
+    resMET_def_1->GetYaxis()->SetRangeUser(-2.,2);
+    resMET_def_1->SetMarkerSize(0.5);
+    resMET_def_1->SetMarkerStyle(24);
+    resMET_def_1->SetMarkerColor(1);
 
-  mycanvases.push_back(new TCanvas);
-  mycanvases.back()->SetWindowSize(mycanvases.back()->GetWw(), 1.3*mycanvases.back()->GetWh());
+    resMET_new_cond_1->Draw("same");
+    resMET_new_cond_1->SetLineColor(2);
+    resMET_new_cond_1->SetMarkerColor(2);
+    resMET_new_cond_1->SetMarkerSize(0.5);
+    resMET_new_cond_1->SetMarkerStyle(20);
 
-  gPad->SetGridx(); gPad->SetGridy();
-  
-  resJet_def_2->Draw("");
-  resJet_def_2->GetXaxis()->SetTitle("offline Jet E_{T} (GeV)");
-  // resJet_def_2->GetYaxis()->SetTitle("gaussian #sigma");
-  resJet_def_2->GetYaxis()->SetRangeUser(0.,0.9);
-  resJet_def_2->SetMarkerSize(0.5);
-  resJet_def_2->SetMarkerStyle(24);
- 
-  resJet_new_cond_2->Draw("same");
-  resJet_new_cond_2->SetLineColor(2);
-  resJet_new_cond_2->SetMarkerColor(2);
-  resJet_new_cond_2->SetMarkerSize(0.5);
-  resJet_new_cond_2->SetMarkerStyle(20);
+    mycanvases2.back()->Print(Form("plots/%s_emu.pdf", "resMET_mean"));
+
+    mycanvases2.push_back(new TCanvas);
+    mycanvases2.back()->SetWindowSize(mycanvases2.back()->GetWw(), 1.3*mycanvases2.back()->GetWh());
+
+    gPad->SetGridx(); gPad->SetGridy();
+
+    resMET_def_2->Draw("");
+    resMET_def_2->GetXaxis()->SetTitle("offline MET (GeV)");
+    resMET_def_2->GetYaxis()->SetRangeUser(0.,1.);
+    resMET_def_2->SetMarkerSize(0.5);
+    resMET_def_2->SetMarkerStyle(24);
+    resMET_def_2->SetMarkerColor(1);
 
-  mycanvases.back()->Print(Form("plots/%s_emu.pdf", "resJet_sigma"));
+    resMET_new_cond_2->Draw("same");
+    resMET_new_cond_2->SetLineColor(2);
+    resMET_new_cond_2->SetMarkerColor(2);
+    resMET_new_cond_2->SetMarkerSize(0.5);
+    resMET_new_cond_2->SetMarkerStyle(20);
 
+    mycanvases2.back()->Print(Form("plots/%s_emu.pdf", "resMET_sigma"));
+  }
+  
   //-----------------------------------------------------------------------
-  // L1 ETM resolution summary plots
+  // Resolution from the quantile sketches: median and interquartile width
+  // of L1/offline - 1, and the fractions below -0.5 and above +0.5
   //-----------------------------------------------------------------------
-  
-  TF1 *fgaus0 = new TF1("g0","gaus");//,-2.,2.);
-  fgaus0->SetRange(-1.,3.);
-  
-  std::vector<TCanvas*> mycanvases2;
-  TH2F *resMET_def = dynamic_cast<TH2F*>(files.at(0)->Get("hResMET"));resMET_def->RebinX(5);
-  files.at(0)->cd();
-  resMET_def->FitSlicesY(fgaus0);//,1,80);//,20);
 
-  TH2F *resMET_new_cond = dynamic_cast<TH2F*>(files.at(1)->Get("hResMET"));resMET_new_cond->RebinX(5);
-  files.at(1)->cd();
-  resMET_new_cond->FitSlicesY(fgaus0);//,1,80);//,20);
-  
-  mycanvases2.push_back(new TCanvas);
-  mycanvases2.back()->SetWindowSize(mycanvases2.back()->GetWw(), 1.3*mycanvases2.back()->GetWh());
-
-  gPad->SetGridx(); gPad->SetGridy();
-
-  TH1D *resMET_def_1 = (TH1D*)files.at(0)->Get("hResMET_1");
-  resMET_def_1->Draw("");
-  resMET_def_1->GetXaxis()->SetTitle("offline MET (GeV)");
-  resMET_def_1->GetYaxis()->SetRangeUser(-2.,2);
-  resMET_def_1->SetMarkerSize(0.5);
-  resMET_def_1->SetMarkerStyle(24);
-  resMET_def_1->SetMarkerColor(1);
-  
-  TH1D *resMET_new_cond_1 = (TH1D*)files.at(1)->Get("hResMET_1");
-  resMET_new_cond_1->Draw("same");
-  resMET_new_cond_1->SetLineColor(2);
-  resMET_new_cond_1->SetMarkerColor(2);
-  resMET_new_cond_1->SetMarkerSize(0.5);
-  resMET_new_cond_1->SetMarkerStyle(20);
-  
-  mycanvases2.back()->Print(Form("plots/%s_emu.pdf", "resMET_mean"));
-
-  mycanvases2.push_back(new TCanvas);
-  mycanvases2.back()->SetWindowSize(mycanvases2.back()->GetWw(), 1.3*mycanvases2.back()->GetWh());
-
-  gPad->SetGridx(); gPad->SetGridy();
-
-  TH1D *resMET_def_2 = (TH1D*)files.at(0)->Get("hResMET_2");
-  resMET_def_2->Draw("");
-  resMET_def_2->GetXaxis()->SetTitle("offline MET (GeV)");
-  resMET_def_2->GetYaxis()->SetRangeUser(0.,1.);
-  resMET_def_2->SetMarkerSize(0.5);
-  resMET_def_2->SetMarkerStyle(24);
-  resMET_def_2->SetMarkerColor(1);
-
-  TH1D *resMET_new_cond_2 = (TH1D*)files.at(1)->Get("hResMET_2");
-  resMET_new_cond_2->Draw("same");
-  resMET_new_cond_2->SetLineColor(2);
-  resMET_new_cond_2->SetMarkerColor(2);
-  resMET_new_cond_2->SetMarkerSize(0.5);
-  resMET_new_cond_2->SetMarkerStyle(20);
-  
-  mycanvases2.back()->Print(Form("plots/%s_emu.pdf", "resMET_sigma"));
-  
+  std::vector<std::string> sketchTypes = {"sketchLeadJet_hb", "sketchLeadJet_he", "sketchLeadJet_hf", "sketchMET"};
+  std::vector<std::string> sketchSummaries = {"median", "iqr", "tailLow", "tailHigh"};
+  std::vector<TCanvas*> scanvases;
+  for (auto sketchType : sketchTypes) {
+    std::vector<std::vector<TH1D*> > summaries;  // per file, per summary
+    for (size_t f=0; f<files.size(); f++) {
+      TH2* hist = dynamic_cast<TH2*>(files.at(f)->Get(sketchType.c_str()));
+      if (!hist) break;
+      ResolutionSketch sketch(hist);
+      summaries.push_back(std::vector<TH1D*>());
+      for (auto summary : sketchSummaries) {
+	TH1D* h = hist->ProjectionX(Form("%s_%s_%zu", sketchType.c_str(), summary.c_str(), f), 1, 0);
+	h->Reset();
+	h->SetDirectory(0);
+	for (int b=1; b<=sketch.binning().nBins; b++) {
+	  if (sketch.entries(b) == 0) continue;
+	  double value = 0.;
+	  if (summary == "median") value = sketch.median(b) - 1.;
+	  else if (summary == "iqr") value = sketch.interquartileWidth(b);
+	  else if (summary == "tailLow") value = sketch.fractionBelow(b, 0.5);
+	  else value = sketch.fractionAbove(b, 1.5);
+	  h->SetBinContent(b, value);
+	}
+	summaries.back().push_back(h);
+      }
+    }
+    if (summaries.size() < files.size()) {
+      std::cout << "No " << sketchType << ", rerun l1jetanalysis.exe for the sketch resolutions" << std::endl;
+      continue;
+    }
+
+    for (size_t s=0; s<sketchSummaries.size(); s++) {
+      scanvases.push_back(new TCanvas);
+      scanvases.back()->SetWindowSize(scanvases.back()->GetWw(), 1.3*scanvases.back()->GetWh());
+      gPad->SetGridx(); gPad->SetGridy();
+
+      TH1D* h_def = summaries[0][s];
+      TH1D* h_new_cond = summaries[1][s];
+      h_def->Draw("P");
+      h_def->GetXaxis()->SetTitle(sketchType == "sketchMET" ? "offline MET (GeV)" : "offline leading Jet E_{T} (GeV)");
+      h_def->GetYaxis()->SetTitle(sketchSummaries[s].c_str());
+      h_def->GetYaxis()->SetRangeUser(s == 0 ? -1. : 0., 1.);
+      h_def->SetMarkerSize(0.5);
+      h_def->SetMarkerStyle(24);
+      h_def->SetMarkerColor(1);
+
+      h_new_cond->Draw("P same");
+      h_new_cond->SetMarkerColor(2);
+      h_new_cond->SetMarkerSize(0.5);
+      h_new_cond->SetMarkerStyle(20);
+
+      scanvases.back()->Print(Form("plots/%s_%s_emu.pdf", sketchType.c_str(), sketchSummaries[s].c_str()));
+    }
+  }
+
   //-----------------------------------------------------------------------
   // Resolution in ET bins plots
   //-----------------------------------------------------------------------
   
-  std::map<std::string, TH1F*> resHists_def;
-  std::map<std::string, TH1F*> resHists_new_cond;
-  std::map<std::string, TH1F*> resHistsRatio;
+  std::map<std::string, TH1F*>& resHists_def = resHists[0];
+  std::map<std::string, TH1F*>& resHists_new_cond = resHists[1];
   
   std::vector<TCanvas*> rcanvases;
   for(auto rType : resTypes) {
-    std::string histName(rType);
-    // std::string histNameHw(histName);
-    //    histName += "Effs_emu";
-    //  histNameHw += "Effs_hw";
+    if (!resHists_def[rType] || !resHists_new_cond[rType]) continue;
     rcanvases.push_back(new TCanvas);
     rcanvases.back()->SetWindowSize(rcanvases.back()->GetWw(), 1.3*rcanvases.back()->GetWh());
-    
-    resHists_def[rType] = dynamic_cast<TH1F*>(files.at(0)->Get(histName.c_str()));
-    //  resHists_hw[rType] = dynamic_cast<TH1F*>(files.at(0)->Get(histNameHw.c_str()));
-    resHists_new_cond[rType] = dynamic_cast<TH1F*>(files.at(1)->Get(histName.c_str()));
-    
-    resHists_def[rType]->Rebin(rebinFactor);
-    //  resHists_hw[rType]->Rebin(rebinFactor);
-    resHists_new_cond[rType]->Rebin(rebinFactor);
 
     resHists_def[rType]->SetLineColor(kBlack); //histColor[rType]);
     //   resHists_hw[rType]->SetLineColor(histColor[rType]);
     resHists_new_cond[rType]->SetLineColor(kRed); //histColor[rType]);
 
-    resHists_def[rType]->Fit("gaus","R+","hist",-2.,2.); //Draw("hist");
+    // the fits of the fitting stage, none if there were too few points
+    TF1 *f1 = 0, *f2 = 0;
+    for (const FitTask& task : fitTasks) {
+      if (!fitted(task)) continue;
+      if (task.hist == resHists_def[rType]) f1 = task.function;
+      if (task.hist == resHists_new_cond[rType]) f2 = task.function;
+    }
+    resHists_def[rType]->Draw("hist");
     resHists_def[rType]->GetYaxis()->SetRangeUser(0.,1.4*resHists_def[rType]->GetMaximum());
-    TF1 *f1 = resHists_def[rType]->GetFunction("gaus"); //->SetLineColor(kBlack);
-    f1->SetLineColor(kBlack);
-    f1->Draw("SAME");
+    if (f1) {
+      f1->SetLineColor(kBlack);
+      f1->Draw("SAME");
+    }
     
-    resHists_new_cond[rType]->Fit("gaus","R+","histsame",-2.,2.);
-    TF1 *f2 = resHists_new_cond[rType]->GetFunction("gaus"); //->SetLineColor(kBlack);
-    f2->SetLineColor(kRed);
-    f2->Draw("SAME");
+    resHists_new_cond[rType]->Draw("histsame");
+    if (f2) {
+      f2->SetLineColor(kRed);
+      f2->Draw("SAME");
+    }
 
     rcanvases.back()->Print(Form("plots/%sbin_emu.pdf", rType.c_str()));
     
   }
-  for(auto pair : resHists_new_cond) pair.second->SetLineWidth(2);
+  for(auto pair : resHists_new_cond) if (pair.second) pair.second->SetLineWidth(2);
   // for(auto pair : resHists_hw) pair.second->SetLineStyle(kDashed);
-  for(auto pair : resHists_def) pair.second->SetLineStyle(kDotted);
+  for(auto pair : resHists_def) if (pair.second) pair.second->SetLineStyle(kDotted);
   
   //-----------------------------------------------------------------------
   // Standard L1 quantities
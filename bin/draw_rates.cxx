@@ -5,14 +5,29 @@
 #include "TFile.h"
 #include "TLegend.h"
 #include "TROOT.h"
+#include "TSystem.h"
 
+#include <iostream>
 #include <map>
 #include <string>
 #include <vector>
+#include <unistd.h>
 
 
-int main()
+int main(int argc, char *argv[])
 {
+  // take the new/current ratios from rates_paired.root, given with -p
+  bool usePaired = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "p")) != -1) {
+    if (opt == 'p') usePaired = true;
+    else {
+      std::cout << "Usage: draw_rates.exe [-p]\n"
+		<< "  -p draws the new/current ratios of \"rates.exe pair\" from rates_paired.root" << std::endl;
+      return 1;
+    }
+  }
+
   // include comparisons between HW and data TPs
   bool includeHW = false;
   int rebinFactor = 1;
@@ -36,11 +51,25 @@ int main()
   std::map<std::string, TH1F*> rateHists_new_cond;
   std::map<std::string, TH1F*> rateHists_hw;
   std::map<std::string, TH1F*> rateHistsRatio;
+  std::map<std::string, bool> pairedRatio;
   
   std::vector<TFile*> files;
   for(auto file : filenames) {
     files.push_back(TFile::Open(file.c_str()));
   }
+  // written by "rates.exe pair" after its rates_def.root and rates_new_cond.root:
+  // new/current ratios from the same events, with errors that account for the
+  // events passing in both. Not used if a rates file was rewritten since.
+  TFile* pairedFile = 0;
+  if(usePaired && !includeHW) {
+    FileStat_t pairedStat, defStat, newStat;
+    if(gSystem->GetPathInfo("rates_paired.root", pairedStat) != 0)
+      std::cout << "No rates_paired.root, dividing the rates" << std::endl;
+    else if(gSystem->GetPathInfo(filenames.at(0).c_str(), defStat) != 0 || gSystem->GetPathInfo(filenames.at(1).c_str(), newStat) != 0
+	    || defStat.fMtime > pairedStat.fMtime || newStat.fMtime > pairedStat.fMtime)
+      std::cout << "rates_paired.root is older than the rates, dividing the rates" << std::endl;
+    else pairedFile = TFile::Open("rates_paired.root");
+  }
   for(auto rateType : rateTypes) {
     std::string histName(rateType);
     std::string histNameHw(histName);
@@ -62,7 +91,17 @@ int main()
       rateHistsRatio[rateType] = dynamic_cast<TH1F*>(rateHists_def[rateType]->Clone(name));
       rateHistsRatio[rateType]->Divide(rateHists_hw[rateType]);
     }
-    else {
+    else if(pairedFile) {
+      std::string ratioName(rateType);
+      ratioName += "RateRatio_emu";
+      rateHistsRatio[rateType] = dynamic_cast<TH1F*>(pairedFile->Get(ratioName.c_str()));
+      if(rateHistsRatio[rateType]) {
+	rateHistsRatio[rateType]->SetLineColor(histColor[rateType]);
+	pairedRatio[rateType] = true;
+      }
+      else std::cout << "No " << ratioName << " in rates_paired.root, dividing the rates" << std::endl;
+    }
+    if(!rateHistsRatio[rateType]) {
       rateHistsRatio[rateType] = dynamic_cast<TH1F*>(rateHists_new_cond[rateType]->Clone(name));
       rateHistsRatio[rateType]->Divide(rateHists_def[rateType]);
     }
@@ -120,11 +159,12 @@ int main()
     leg->Draw();
     
     pad2.back()->cd();
-    rateHistsRatio[iplot.second.front()]->Draw("hist");
+    // the paired ratios are only meaningful with their (correlated) errors
+    rateHistsRatio[iplot.second.front()]->Draw(pairedRatio[iplot.second.front()] ? "e" : "hist");
     if(includeHW) rateHistsRatio[iplot.second.front()]->GetYaxis()->SetTitle("Current/HW");
     else rateHistsRatio[iplot.second.front()]->GetYaxis()->SetTitle("New/Current");
     for(auto hist : iplot.second) {
-      rateHistsRatio[hist]->Draw("hist same");
+      rateHistsRatio[hist]->Draw(pairedRatio[hist] ? "e same" : "hist same");
     }
 
     if(includeHW) canvases.back()->Print(Form("plots/%sRates_hw.pdf", iplot.first.c_str()));
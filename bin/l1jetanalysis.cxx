@@ -7,9 +7,16 @@
 #include "TH2F.h"
 #include "TH3F.h"
 #include "TChain.h"
+#include "TList.h"
+#include "TParameter.h"
+#include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <vector>
+#include <unistd.h>
 #include "L1Trigger/L1TNtuples/interface/L1AnalysisEventDataFormat.h"
 #include "L1Trigger/L1TNtuples/interface/L1AnalysisL1UpgradeDataFormat.h"
 #include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoVertexDataFormat.h"
@@ -19,38 +26,72 @@
 #include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoMetDataFormat.h"
 #include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoMetFilterDataFormat.h"
 
-/* TODO: put errors in rates...
-creates the rates and distributions for l1 trigger objects
+#include "HcalTrigger/Validation/interface/BatchHistogram.h"
+#include "HcalTrigger/Validation/interface/CaloTPColumns.h"
+#include "HcalTrigger/Validation/interface/EventSkim.h"
+#include "HcalTrigger/Validation/interface/GoodLumiMask.h"
+#include "HcalTrigger/Validation/interface/JetQuantities.h"
+#include "HcalTrigger/Validation/interface/L1UpgradeColumns.h"
+#include "HcalTrigger/Validation/interface/ResultCache.h"
+#include "HcalTrigger/Validation/interface/RunReport.h"
+
+/* creates the jet and MET efficiencies, resolutions and L1 distributions
 How to use:
-1. input the number of bunches in the run (~line 35)
-2. change the variables "newConditionsNtuples" and "oldConditionsNtuples" to ntuple paths
-3. If good run JSON is not applied during ntuple production, modify isGoodLumiSection()
-
-Optionally, if you want to rescale to a given instantaneous luminosity:
-1. input the instantaneous luminosity of the run (~line 32) [only if we scale to 2016 nominal]
-2. select whether you rescale to L=1.5e34 (~line606??...) generally have it setup to rescale
-nb: for 2&3 I have provided the info in runInfoForRates.txt
+1. set numBunch below to the number of colliding bunches of the run
+2. run "l1jetanalysis.exe def [ntuples]" and "l1jetanalysis.exe new [ntuples]" (alone it lists the options):
+   -l good run JSON (or modify isGoodLumiSection()), -c cache / -s skim (replayed
+   by giving it instead of the ntuples), -k jets per skim row, -b sketch binning
+3. draw the outputs with draw_l1analysis.exe
 */
 
 // configurable parameters
 double numBunch = 1537; //the number of bunches colliding for the run of interest
 double runLum = 0.02; // 0.44: 275783  0.58:  276363 //luminosity of the run of interest (*10^34)
 double expectedLum = 1.15; //expected luminosity of 2016 runs (*10^34)
+const GoodLumiMask* goodLumiMask = 0; //certified lumi sections given with -l (none: see isGoodLumiSection())
+SketchBinning sketchBinning; //offline ET bins of the resolution sketches, given with -b nBins:lo:hi
+int skimJetPairs = 6; //offline jets (with their matched L1 jets) stored per skim row, given with -k
 
-void jetanalysis(bool newConditions, const std::string& inputFileDirectory);
+void jetanalysis(bool newConditions, const std::string& inputFileDirectory, const std::string& cacheDirectory,
+		 const std::string& skimFile);
 
 int main(int argc, char *argv[])
 {
   bool newConditions = true;
   std::string ntuplePath("");
+  std::string lumiMaskFile("");
+  std::string cacheDirectory("");
+  std::string skimFile("");
+  bool badOption = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "l:c:s:b:k:")) != -1) {
+    if (opt == 'l') lumiMaskFile = optarg;
+    else if (opt == 'c') cacheDirectory = optarg;
+    else if (opt == 's') skimFile = optarg;
+    else if (opt == 'b') {
+      if (sscanf(optarg, "%d:%lf:%lf", &sketchBinning.nBins, &sketchBinning.lo, &sketchBinning.hi) != 3
+	  || sketchBinning.nBins < 1 || !(sketchBinning.hi > sketchBinning.lo)) badOption = true;
+    }
+    else if (opt == 'k') {
+      if (sscanf(optarg, "%d", &skimJetPairs) != 1 || skimJetPairs < 0) badOption = true;
+    }
+    else badOption = true;
+  }
 
-  if (argc != 3) {
-    std::cout << "Usage: l1jetanalysis.exe [new/def] [path to ntuples]\n"
-	      << "[new/def] indicates new or default (existing) conditions" << std::endl;
+  if (argc-optind != 2 || badOption) {
+    std::cout << "Usage: l1jetanalysis.exe [-l lumimask.json] [-c cacheDir | -s skim [-k nJets]] [-b nBins:lo:hi] [new/def] [path to ntuples or skim]\n"
+	      << "[new/def] indicates new or default (existing) conditions\n"
+	      << "the ntuples are a directory of L1Ntuple_*.root files, or a file (or pattern) ending in .root\n"
+	      << "-l only uses the lumi sections certified in a good run JSON\n"
+	      << "-c keeps the results of every input file in cacheDir and only processes new or changed files\n"
+	      << "-s also writes a skim of the good events, which can be given instead of the ntuple path\n"
+	      << "-k sets how many of the leading offline jets the skim keeps (default 6); all are analysed\n"
+	      << "-b sets the offline E_T bins of the resolution sketches (default 10:0:500)" << std::endl;
     exit(1);
   }
   else {
-    std::string par1(argv[1]);
+    std::string par1(argv[optind]);
     std::transform(par1.begin(), par1.end(), par1.begin(), ::tolower);
     if(par1.compare("new") == 0) newConditions = true;
     else if(par1.compare("def") == 0) newConditions = false;
@@ -58,18 +99,35 @@ int main(int argc, char *argv[])
       std::cout << "First parameter must be \"new\" or \"def\"" << std::endl;
       exit(1);
     }
-    ntuplePath = argv[2];
+    ntuplePath = argv[optind+1];
+  }
+
+  if ((!cacheDirectory.empty() || !skimFile.empty())
+      && (SkimReader::isSkim(ntuplePath) || (!cacheDirectory.empty() && !skimFile.empty()))) {
+    std::cout << "-c and -s cannot be combined, and need ntuples, not a skim" << std::endl;
+    exit(1);
+  }
+
+  if (!lumiMaskFile.empty()) {
+    GoodLumiMask* mask = new GoodLumiMask();
+    if (!mask->load(lumiMaskFile)) {
+      std::cout << "Cannot read good lumi JSON " << lumiMaskFile << std::endl;
+      exit(1);
+    }
+    goodLumiMask = mask;
   }
 
-  jetanalysis(newConditions, ntuplePath);
+  jetanalysis(newConditions, ntuplePath, cacheDirectory, skimFile);
 
   return 0;
 }
 
 // only need to edit this section if good run JSON
-// is not used during ntuple production
-bool isGoodLumiSection(int lumiBlock)
+// is not used during ntuple production and not given with -l
+bool isGoodLumiSection(unsigned run, int lumiBlock)
 {
+  if (goodLumiMask) return goodLumiMask->contains(run, lumiBlock);
+
   if (lumiBlock >= 1
       || lumiBlock <= 10000) {
     return true;
@@ -78,22 +136,160 @@ bool isGoodLumiSection(int lumiBlock)
   return false;
 }
 
-double deltaPhi(double phi1, double phi2) {
-  double result = phi1 - phi2;
-  if(fabs(result) > 9999) return result;
-  while (result > TMath::Pi()) result -= 2*TMath::Pi();
-  while (result <= -TMath::Pi()) result += 2*TMath::Pi();
-  return result;
+// everything besides the input file the cached histograms depend on;
+// bump the version whenever the selection or the histograms change
+std::string cacheConfig(const std::vector<TH1*>& hists, bool emuOn, bool hwOn, bool recoOn)
+{
+  std::ostringstream config;
+  config << "l1jetanalysis v7 emu=" << emuOn << " hw=" << hwOn << " reco=" << recoOn;
+  for (const TH1* hist : hists) {
+    config << ' ' << hist->GetName() << ':' << hist->GetNcells()
+	   << ':' << hist->GetXaxis()->GetXmin() << ':' << hist->GetXaxis()->GetXmax();
+  }
+  config << " mask=" << (goodLumiMask ? goodLumiMask->checksum() : 0);
+  return config.str();
+}
+
+// run number of the first event, for the record in extraInfo.txt
+unsigned firstRunNumber(const std::string& inputFile)
+{
+  TChain eventTree("l1EventTree/L1EventTree");
+  eventTree.Add(inputFile.c_str());
+  L1Analysis::L1AnalysisEventDataFormat* event_ = new L1Analysis::L1AnalysisEventDataFormat();
+  eventTree.SetBranchAddress("Event", &event_);
+  eventTree.SetBranchStatus("*", 0);
+  eventTree.SetBranchStatus("run", 1);
+  eventTree.GetEntry(0);
+  unsigned run = event_->run;
+  delete event_;
+  return run;
+}
+
+// add the histograms and event count of a cache entry to the totals;
+// false (and nothing added) if the entry is incomplete
+bool addCachedHists(TDirectory* entry, const std::vector<TH1*>& totals, Long64_t& eventCount)
+{
+  std::vector<TH1*> cached;
+  for (TH1* total : totals) {
+    cached.push_back(dynamic_cast<TH1*>(entry->Get(total->GetName())));
+    if (!cached.back()) return false;
+  }
+  TParameter<Long64_t>* count = dynamic_cast<TParameter<Long64_t>*>(entry->Get("goodLumiEventCount"));
+  if (!count) return false;
+  for (size_t i=0; i<totals.size(); i++) totals[i]->Add(cached[i]);
+  eventCount += count->GetVal();
+  return true;
+}
+
+// skim written with -s: the event id, the quantities above and the TP
+// spectra at the TP resolution
+enum JetSkimColumn { kSkimRun, kSkimLumi, kSkimEvent, kSkimBx, kSkimJetEt,
+		     kSkimEtSum = kSkimJetEt+4, kSkimMetSum, kSkimMetHFSum, kSkimHtSum, kSkimMhtSum,
+		     kSkimMetFilters, kSkimCaloMet, kSkimJetPairs };
+
+// columns of a skim with nPairs offline jets per row
+int nJetSkimColumns(bool recoOn, int nPairs)
+{
+  return recoOn ? kSkimJetPairs+4*nPairs : kSkimMetFilters;
+}
+
+std::vector<SkimColumn> jetSkimColumns(bool recoOn, int nPairs)
+{
+  std::vector<SkimColumn> columns = {{"run", kSkimUInt32}, {"lumi", kSkimUInt32}, {"event", kSkimUInt64}, {"bx", kSkimUInt32},
+				     {"emu_singleJet", kSkimEt}, {"emu_doubleJet", kSkimEt},
+				     {"emu_tripleJet", kSkimEt}, {"emu_quadJet", kSkimEt},
+				     {"emu_etSum", kSkimEt}, {"emu_metSum", kSkimEt}, {"emu_metHFSum", kSkimEt},
+				     {"emu_htSum", kSkimEt}, {"emu_mhtSum", kSkimEt}};
+  if (recoOn) {
+    std::vector<SkimColumn> reco = {{"metFilters", kSkimUInt32}, {"caloMet", kSkimFloat}};
+    // offline jets and their matched L1 jets, leading first: refJetEt, refJetEt2, ...
+    for (int p=0; p<nPairs; p++) {
+      std::string suffix = p == 0 ? "" : std::to_string(p+1);
+      reco.push_back({"refJetEt" + suffix, kSkimFloat});
+      reco.push_back({"refJetEta" + suffix, kSkimFloat});
+      reco.push_back({"emu_matchedJetEt" + suffix, kSkimEt});
+      reco.push_back({"emu_matchedJetEta" + suffix, kSkimFloat});
+    }
+    columns.insert(columns.end(), reco.begin(), reco.end());
+  }
+  return columns;
+}
+
+// offline jets per row of a skim (0 without the reco columns)
+int skimPairCount(const SkimReader& skim)
+{
+  int nPairs = 0;
+  while (skim.column("refJetEt" + (nPairs == 0 ? std::string() : std::to_string(nPairs+1))) >= 0) nPairs++;
+  return nPairs;
 }
 
-double deltaR(double eta1, double phi1, double eta2, double phi2) {
-  double deta = eta1 - eta2;
-  double dphi = deltaPhi(phi1, phi2);
-  return sqrt(deta*deta + dphi*dphi);
+// true if skim has the columns of jetSkimColumns(recoOn, skimPairCount(skim)) in that order
+bool isJetSkim(const SkimReader& skim, bool recoOn)
+{
+  std::vector<SkimColumn> columns = jetSkimColumns(recoOn, skimPairCount(skim));
+  for (size_t c=0; c<columns.size(); c++) {
+    if (skim.column(columns[c].name) != static_cast<int>(c)) return false;
+  }
+  return true;
+}
+
+// the first nPairs jet pairs of q are stored, the rest are left out
+void setSkimRow(SkimRows& rows, const L1Analysis::L1AnalysisEventDataFormat& event, const JetEventQuantities& q,
+		int nPairs)
+{
+  rows.setInteger(kSkimRun, event.run);
+  rows.setInteger(kSkimLumi, event.lumi);
+  rows.setInteger(kSkimEvent, event.event);
+  rows.setInteger(kSkimBx, event.bx);
+  for (int c=0; c<4; c++) rows.setValue(kSkimJetEt+c, q.jetEt[c]);
+  rows.setValue(kSkimEtSum, q.etSum);
+  rows.setValue(kSkimMetSum, q.metSum);
+  rows.setValue(kSkimMetHFSum, q.metHFSum);
+  rows.setValue(kSkimHtSum, q.htSum);
+  rows.setValue(kSkimMhtSum, q.mhtSum);
+  if (q.hasReco) {
+    rows.setInteger(kSkimMetFilters, q.metFilters);
+    rows.setValue(kSkimCaloMet, q.caloMet);
+    float nan = std::nanf("");
+    JetPair none = {nan, nan, nan, nan};
+    for (int p=0; p<nPairs; p++) {
+      const JetPair& pair = size_t(p) < q.jetPairs.size() ? q.jetPairs[p] : none;
+      rows.setValue(kSkimJetPairs+4*p, pair.refEt);
+      rows.setValue(kSkimJetPairs+4*p+1, pair.refEta);
+      rows.setValue(kSkimJetPairs+4*p+2, pair.l1Et);
+      rows.setValue(kSkimJetPairs+4*p+3, pair.l1Eta);
+    }
+  }
 }
 
-void jetanalysis(bool newConditions, const std::string& inputFileDirectory){
+// row i of a block of decoded skim columns, with nPairs offline jets per row
+void readSkimRow(const std::vector<std::vector<double> >& values, size_t i, bool hasReco, int nPairs,
+		 JetEventQuantities& q)
+{
+  for (int c=0; c<4; c++) q.jetEt[c] = values[kSkimJetEt+c][i];
+  q.etSum = values[kSkimEtSum][i];
+  q.metSum = values[kSkimMetSum][i];
+  q.metHFSum = values[kSkimMetHFSum][i];
+  q.htSum = values[kSkimHtSum][i];
+  q.mhtSum = values[kSkimMhtSum][i];
+  if (hasReco) {
+    q.hasReco = true;
+    q.metFilters = values[kSkimMetFilters][i] != 0.;
+    q.caloMet = values[kSkimCaloMet][i];
+    // the pairs are stored leading first, so the first absent one ends them
+    for (int p=0; p<nPairs && !std::isnan(values[kSkimJetPairs+4*p][i]); p++) {
+      JetPair pair = {float(values[kSkimJetPairs+4*p][i]), float(values[kSkimJetPairs+4*p+1][i]),
+		      float(values[kSkimJetPairs+4*p+2][i]), float(values[kSkimJetPairs+4*p+3][i])};
+      q.jetPairs.push_back(pair);
+    }
+  }
+}
+
+void jetanalysis(bool newConditions, const std::string& inputFileDirectory, const std::string& cacheDirectory,
+		 const std::string& skimFile){
   
+  StageClock jobClock;
+  StageTimes times;
   bool hwOn = true;   //are we using data from hardware? (upgrade trigger had to be running!!!)
   bool emuOn = true;  //are we using data from emulator?
   //for efficiencies & resolutions:
@@ -104,8 +300,20 @@ void jetanalysis(bool newConditions, const std::string& inputFileDirectory){
     return;
   }
 
-  std::string inputFile(inputFileDirectory);
-  inputFile += "/L1Ntuple_*.root";
+  // the input is either a directory of ntuples or a skim written with -s
+  SkimReader* skimInput = 0;
+  int skimInputPairs = 0;
+  if (SkimReader::isSkim(inputFileDirectory)) {
+    skimInput = new SkimReader(inputFileDirectory);
+    if (!skimInput->good() || !isJetSkim(*skimInput, false)) {
+      std::cout << "Cannot read skim " << inputFileDirectory << std::endl;
+      return;
+    }
+    recoOn = recoOn && isJetSkim(*skimInput, true);
+    skimInputPairs = skimPairCount(*skimInput);
+  }
+
+  std::string inputFile(skimInput ? inputFileDirectory : ntupleFiles(inputFileDirectory));
   std::string outputDirectory = "emu";  //***runNumber, triggerType, version, hw/emu/both***MAKE SURE IT EXISTS
   std::string outputFilename = "l1analysis_def.root";
   if(newConditions) outputFilename = "l1analysis_new_cond.root";
@@ -115,44 +323,101 @@ void jetanalysis(bool newConditions, const std::string& inputFileDirectory){
   //   return;
   // }
 
+  // efficiency, resolution and L1 distribution histograms
+  JetHistograms jetHists(sketchBinning);
+  JetMatcher jetMatcher;
+
+  // tp bins
+  int nTpBins = 100;
+  float tpLo = 0.;
+  float tpHi = 100.;
+
+  // hcal/ecal TPs
+  TH1F* hcalTP_emu = new TH1F("hcalTP_emu", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
+  TH1F* ecalTP_emu = new TH1F("ecalTP_emu", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
+  // filled a whole event at a time, copied into the histograms before writing
+  BatchHistogram hcalTPCounts_emu(hcalTP_emu);
+  BatchHistogram ecalTPCounts_emu(ecalTP_emu);
+
+  // TH1F* hcalTP_hw = new TH1F("hcalTP_hw", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
+  // TH1F* ecalTP_hw = new TH1F("ecalTP_hw", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
+
+  // With a cache, only the input files without an entry are read. The
+  // histograms of each are stored and added to the totals when the loop
+  // moves on to the next file, and the totals are written at the end.
+  std::vector<TH1*> hists;
+  TIter nextHist(kk->GetList());
+  while (TObject* obj = nextHist()) {
+    if (TH1* hist = dynamic_cast<TH1*>(obj)) hists.push_back(hist);
+  }
+  std::vector<std::string> inputFiles;
+  if (!skimInput) inputFiles.push_back(inputFile);
+  ResultCache* cache = 0;
+  std::vector<TH1*> totals;
+  Long64_t totalEventCount = 0;
+  if (!cacheDirectory.empty()) {
+    cache = new ResultCache(cacheDirectory, cacheConfig(hists, emuOn, hwOn, recoOn));
+    for (TH1* hist : hists) {
+      totals.push_back(static_cast<TH1*>(hist->Clone()));
+      totals.back()->SetDirectory(0);
+    }
+    inputFiles.clear();
+    std::vector<std::string> files = expandInputFiles(inputFile);
+    for (const std::string& file : files) {
+      TFile* entry = cache->open(file);
+      if (!entry || !addCachedHists(entry, totals, totalEventCount)) inputFiles.push_back(file);
+      if (entry) {
+	entry->Close();
+	delete entry;
+      }
+    }
+    kk->cd();
+    std::cout << "Used cached results for " << files.size()-inputFiles.size() << " of " << files.size() << " files" << std::endl;
+  }
 
   // make trees
   std::cout << "Loading up the TChain..." << std::endl;
+  StageClock openClock;
   TChain * treeL1emu = new TChain("l1UpgradeEmuTree/L1UpgradeTree");
   if (emuOn){
-    treeL1emu->Add(inputFile.c_str());
+    addInputFiles(treeL1emu, inputFiles);
   }
   TChain * treeL1hw = new TChain("l1UpgradeTree/L1UpgradeTree");
   if (hwOn){
-    treeL1hw->Add(inputFile.c_str());
+    addInputFiles(treeL1hw, inputFiles);
   }
   TChain * eventTree = new TChain("l1EventTree/L1EventTree");
-  eventTree->Add(inputFile.c_str());
+  addInputFiles(eventTree, inputFiles);
 
   // In case you want to include RECO info
   TChain * recoTree = new TChain("l1JetRecoTree/JetRecoTree");
   TChain * metfilterTree = new TChain("l1MetFilterRecoTree/MetFilterRecoTree");
   if (recoOn) {
-    recoTree->Add(inputFile.c_str());
-    metfilterTree->Add(inputFile.c_str());
+    addInputFiles(recoTree, inputFiles);
+    addInputFiles(metfilterTree, inputFiles);
   }
 
   TChain * treeL1TPemu = new TChain("l1CaloTowerEmuTree/L1CaloTowerTree");
   if (emuOn){
-    treeL1TPemu->Add(inputFile.c_str());
+    addInputFiles(treeL1TPemu, inputFiles);
   }
 
   TChain * treeL1TPhw = new TChain("l1CaloTowerTree/L1CaloTowerTree");
   if (hwOn){
-    treeL1TPhw->Add(inputFile.c_str());
+    addInputFiles(treeL1TPhw, inputFiles);
   }
 
-  L1Analysis::L1AnalysisL1UpgradeDataFormat    *l1emu_ = new L1Analysis::L1AnalysisL1UpgradeDataFormat();
-  treeL1emu->SetBranchAddress("L1Upgrade", &l1emu_);
-  L1Analysis::L1AnalysisL1UpgradeDataFormat    *l1hw_ = new L1Analysis::L1AnalysisL1UpgradeDataFormat();
-  treeL1hw->SetBranchAddress("L1Upgrade", &l1hw_);
+  // only the L1 leaves used below are read
+  L1UpgradeColumns    *l1emu_ = new L1UpgradeColumns(treeL1emu, false, recoOn);
+  // L1UpgradeColumns    *l1hw_ = new L1UpgradeColumns(treeL1hw);
   L1Analysis::L1AnalysisEventDataFormat    *event_ = new L1Analysis::L1AnalysisEventDataFormat();
   eventTree->SetBranchAddress("Event", &event_);
+  // read first for every entry, so only what the lumi check and skim need
+  eventTree->SetBranchStatus("*", 0);
+  eventTree->SetBranchStatus("run", 1);
+  eventTree->SetBranchStatus("lumi", 1);
+  eventTree->SetBranchStatus("event", 1);
+  eventTree->SetBranchStatus("bx", 1);
 
   L1Analysis::L1AnalysisRecoJetDataFormat    *jet_ = new L1Analysis::L1AnalysisRecoJetDataFormat();
   recoTree->SetBranchAddress("Jet", &jet_);
@@ -161,314 +426,186 @@ void jetanalysis(bool newConditions, const std::string& inputFileDirectory){
   L1Analysis::L1AnalysisRecoMetFilterDataFormat    *metfilter_ = new L1Analysis::L1AnalysisRecoMetFilterDataFormat();
   metfilterTree->SetBranchAddress("MetFilters", &metfilter_);
   
-  L1Analysis::L1AnalysisCaloTPDataFormat    *l1TPemu_ = new L1Analysis::L1AnalysisCaloTPDataFormat();
-  treeL1TPemu->SetBranchAddress("CaloTP", &l1TPemu_);
-  L1Analysis::L1AnalysisCaloTPDataFormat    *l1TPhw_ = new L1Analysis::L1AnalysisCaloTPDataFormat();
-  treeL1TPhw->SetBranchAddress("CaloTP", &l1TPhw_);
+  CaloTPColumns    *l1TPemu_ = new CaloTPColumns(treeL1TPemu);
+  // CaloTPColumns    *l1TPhw_ = new CaloTPColumns(treeL1TPhw);
 
 
   // get number of entries
   Long64_t nentries;
   if (emuOn) nentries = treeL1emu->GetEntries();
   else nentries = treeL1hw->GetEntries();
-  int goodLumiEventCount = 0;
+  Long64_t goodLumiEventCount = 0;
+  times.add(times.stage("open chains"), openClock.lap());
 
   std::string outputTxtFilename = "output_rates/" + outputDirectory + "/extraInfo.txt";
   std::ofstream myfile; // save info about the run, including rates for a given lumi section, and number of events we used.
   myfile.open(outputTxtFilename.c_str());
-  eventTree->GetEntry(0);
-  myfile << "run number = " << event_->run << std::endl;
-
-  // set parameters for histograms
-  // jet bins
-  int nJetBins = 500;
-  float jetLo = 0.;
-  float jetHi = 500.;
-  //  float jetBinWidth = (jetHi-jetLo)/nJetBins;
-
-  // htSum bins
-  int nHtSumBins = 800;
-  float htSumLo = 0.;
-  float htSumHi = 800.;
-  // float htSumBinWidth = (htSumHi-htSumLo)/nHtSumBins;
-
-  // mhtSum bins
-  int nMhtSumBins = 500;
-  float mhtSumLo = 0.;
-  float mhtSumHi = 500.;
-  //  float mhtSumBinWidth = (mhtSumHi-mhtSumLo)/nMhtSumBins;
-
-  // etSum bins
-  int nEtSumBins = 1000;
-  float etSumLo = 0.;
-  float etSumHi = 1000.;
-  // float etSumBinWidth = (etSumHi-etSumLo)/nEtSumBins;
-
-  // metSum bins
-  int nMetSumBins = 500;
-  float metSumLo = 0.;
-  float metSumHi = 500.;
-  //  float metSumBinWidth = (metSumHi-metSumLo)/nMetSumBins;
-
-  // tp bins
-  int nTpBins = 100;
-  float tpLo = 0.;
-  float tpHi = 100.;
-
-  std::string axR = ";Threshold E_{T} (GeV);rate (Hz)";
-  std::string axD = ";E_{T} (GeV);events/bin";
-  std::string metD = ";MET (GeV);events/bin";
-  
-  //make histos
-  // TH1F *NCenJets = new TH1F("NCenJets","n",20,-0.5,19.5);
-
-  // Jets
-  TH1F *refJetET = new TH1F("RefJet", "all Jet1 E_{T} (GeV)",nJetBins, jetLo, jetHi);
-  TH1F *refmJetET = new TH1F("RefmJet", "all matched Jet1 E_{T} (GeV)",nJetBins, jetLo, jetHi);
-  
-  TH1F *jetET50   = new TH1F( "JetEt50" , axD.c_str(),nJetBins, jetLo, jetHi);
-  TH1F *jetET64   = new TH1F( "JetEt64" , axD.c_str(),nJetBins, jetLo, jetHi);
-  TH1F *jetET76   = new TH1F( "JetEt76" , axD.c_str(),nJetBins, jetLo, jetHi);
-  TH1F *jetET92   = new TH1F( "JetEt92" , axD.c_str(),nJetBins, jetLo, jetHi);
-  TH1F *jetET112  = new TH1F( "JetEt112" , axD.c_str(),nJetBins, jetLo, jetHi);
-  TH1F *jetET180  = new TH1F( "JetEt180" , axD.c_str(),nJetBins, jetLo, jetHi);
-  
-  TH1F *l1jetET1 = new TH1F( "singleJet" , axD.c_str(),nJetBins, jetLo, jetHi);
-  TH1F *l1jetET2 = new TH1F( "doubleJet" , axD.c_str(),nJetBins, jetLo, jetHi);
-  TH1F *l1jetET3 = new TH1F( "tripleJet" , axD.c_str(),nJetBins, jetLo, jetHi);
-  TH1F *l1jetET4 = new TH1F( "quadJet" , axD.c_str(),nJetBins, jetLo, jetHi);
-
-  // and Sums
-  TH1F *refMET  = new TH1F("RefMET",metD.c_str(), nMetSumBins, metSumLo, metSumHi);
-  TH1F *MET_100U = new TH1F("MET100",metD.c_str(), nMetSumBins, metSumLo, metSumHi);
-  TH1F *MET_70U  = new TH1F("MET70",metD.c_str(), nMetSumBins, metSumLo, metSumHi);
-  TH1F *MET_40U  = new TH1F("MET40",metD.c_str(), nMetSumBins, metSumLo, metSumHi);
-  TH1F *MET_30U  = new TH1F("MET30",metD.c_str(), nMetSumBins, metSumLo, metSumHi);
-  TH1F *MET_50U  = new TH1F("MET50",metD.c_str(), nMetSumBins, metSumLo, metSumHi);
-
-  TH1F *l1ET = new TH1F("etSum","L1 sumET (GeV)",nEtSumBins,etSumLo,etSumHi);
-  TH1F *l1MET = new TH1F("metSum","L1 MET (GeV)",nMetSumBins,metSumLo,metSumHi);
-  TH1F *l1METHF = new TH1F("metHFSum","L1 METHF (GeV)",nMetSumBins,metSumLo,metSumHi);
-  TH1F *l1HT = new TH1F("htSum","L1 HT (GeV)",nHtSumBins,htSumLo,htSumHi);
-  TH1F *l1MHT = new TH1F("mhtSum","L1 MHT (GeV)",nMhtSumBins,mhtSumLo,mhtSumHi);
-
-  // resolution histograms
-  TH2F *hresJet = new TH2F("hresJet","",nJetBins, jetLo, jetHi,100,-5,5);
-  TH2F *hresMET = new TH2F("hResMET","",nMetSumBins,metSumLo,metSumHi,100,-5,5);
-
-  TH2F *hresJet_hb = new TH2F("hresJet_hb","",nJetBins, jetLo, jetHi,100,-5,5);
-  TH2F *hresJet_he = new TH2F("hresJet_he","",nJetBins, jetLo, jetHi,100,-5,5);
-  TH2F *hresJet_hf = new TH2F("hresJet_hf","",nJetBins, jetLo, jetHi,100,-5,5);
-  
-  TH1F *h_resMET1 = new TH1F("hresMET1","",100,-5,5) ;
-  TH1F *h_resMET2 = new TH1F("hresMET2","",100,-5,5) ;
-  TH1F *h_resMET3 = new TH1F("hresMET3","",100,-5,5) ;
-  TH1F *h_resMET4 = new TH1F("hresMET4","",100,-5,5) ;
-  TH1F *h_resMET5 = new TH1F("hresMET5","",100,-5,5) ;
-  TH1F *h_resMET6 = new TH1F("hresMET6","",100,-5,5) ;
-  TH1F *h_resMET7 = new TH1F("hresMET7","",100,-5,5) ;
-  TH1F *h_resMET8 = new TH1F("hresMET8","",100,-5,5) ;
-  TH1F *h_resMET9 = new TH1F("hresMET9","",100,-5,5) ;
-  TH1F *h_resMET10 = new TH1F("hresMET10","",100,-5,5) ;
-  
-  TH1F *h_resJet1 = new TH1F("hresJet1","",100,-5,5) ;
-  TH1F *h_resJet2 = new TH1F("hresJet2","",100,-5,5) ;
-  TH1F *h_resJet3 = new TH1F("hresJet3","",100,-5,5) ;
-  TH1F *h_resJet4 = new TH1F("hresJet4","",100,-5,5) ;
-  TH1F *h_resJet5 = new TH1F("hresJet5","",100,-5,5) ;
-  TH1F *h_resJet6 = new TH1F("hresJet6","",100,-5,5) ;
-  TH1F *h_resJet7 = new TH1F("hresJet7","",100,-5,5) ;
-  TH1F *h_resJet8 = new TH1F("hresJet8","",100,-5,5) ;
-  TH1F *h_resJet9 = new TH1F("hresJet9","",100,-5,5) ;
-  TH1F *h_resJet10 = new TH1F("hresJet10","",100,-5,5) ;
-    
-  // hcal/ecal TPs
-  TH1F* hcalTP_emu = new TH1F("hcalTP_emu", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
-  TH1F* ecalTP_emu = new TH1F("ecalTP_emu", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
+  if (skimInput) {
+    std::vector<uint64_t> run;
+    if (skimInput->nBlocks() > 0) skimInput->integers(0, kSkimRun, run);
+    myfile << "run number = " << (run.empty() ? 0 : run[0]) << std::endl;
+  }
+  else myfile << "run number = " << firstRunNumber(inputFile) << std::endl;
+
+  SkimWriter* skimWriter = 0;
+  SkimRows* skimRows = 0;
+  Long64_t skimTruncatedEvents = 0;  // events with more offline jets than the skim keeps
+  BatchHistogram skimHcalTP_emu(512, 0., 512*skim::kEtLsb);
+  BatchHistogram skimEcalTP_emu(512, 0., 512*skim::kEtLsb);
+  if (!skimFile.empty()) {
+    skimWriter = new SkimWriter(skimFile, jetSkimColumns(recoOn, skimJetPairs));
+    if (!skimWriter->good()) {
+      std::cout << "Cannot write skim " << skimFile << std::endl;
+      return;
+    }
+    skimRows = new SkimRows(skimWriter->columns());
+  }
 
-  // TH1F* hcalTP_hw = new TH1F("hcalTP_hw", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
-  // TH1F* ecalTP_hw = new TH1F("ecalTP_hw", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
+  // store the histograms of inputFiles[f] in the cache and start over
+  auto finishFile = [&](size_t f) {
+    hcalTPCounts_emu.fillHist(hcalTP_emu);
+    ecalTPCounts_emu.fillHist(ecalTP_emu);
+    jetHists.fillHists();
+    TFile* entry = cache->create(inputFiles[f]);
+    if (entry) {
+      for (TH1* hist : hists) entry->WriteTObject(hist);
+      TParameter<Long64_t> count("goodLumiEventCount", goodLumiEventCount);
+      entry->WriteTObject(&count);
+      cache->commit(entry, inputFiles[f]);
+    }
+    else std::cout << "Cannot write cache entry for " << inputFiles[f] << std::endl;
+    kk->cd();
+    for (size_t i=0; i<hists.size(); i++) {
+      totals[i]->Add(hists[i]);
+      hists[i]->Reset();
+    }
+    hcalTPCounts_emu.reset();
+    ecalTPCounts_emu.reset();
+    jetHists.reset();
+    totalEventCount += goodLumiEventCount;
+    goodLumiEventCount = 0;
+  };
+  size_t currentFile = 0;
+
+  StageTimer timer(times);
+  int eventStage = times.stage("GetEntry l1EventTree");
+  int tpEmuStage = times.stage("GetEntry l1CaloTowerEmuTree");
+  int emuStage = times.stage("GetEntry l1UpgradeEmuTree");
+  int recoStage = times.stage("GetEntry l1JetRecoTree");
+  int metfilterStage = times.stage("GetEntry l1MetFilterRecoTree");
+  int rankStage = times.stage("rank objects");
+  int fillStage = times.stage("fill");
+  EventProgress progress(nentries);
 
   /////////////////////////////////
   // loop through all the entries//
   /////////////////////////////////
   for (Long64_t jentry=0; jentry<nentries; jentry++){
-    if((jentry%10000)==0) std::cout << "Done " << jentry  << " events of " << nentries << std::endl;
+    progress.count();
 
     //lumi break clause
-    eventTree->GetEntry(jentry);
+    timer.read(eventTree, jentry, eventStage);
+    // first entry of a later file: what was filled so far belongs to the earlier ones
+    if (cache) {
+      while (currentFile < static_cast<size_t>(eventTree->GetTreeNumber())) finishFile(currentFile++);
+    }
     //skip the corresponding event
-    if (!isGoodLumiSection(event_->lumi)) continue;
+    if (!isGoodLumiSection(event_->run, event_->lumi)) continue;
     goodLumiEventCount++;
 
+    JetEventQuantities q;
     //do routine for L1 emulator quantites
     if (emuOn){
 
-      treeL1TPemu->GetEntry(jentry);
-      double tpEt(0.);
-      
-      for(int i=0; i < l1TPemu_->nHCALTP; i++){
-	tpEt = l1TPemu_->hcalTPet[i];
-	hcalTP_emu->Fill(tpEt);
-      }
-      for(int i=0; i < l1TPemu_->nECALTP; i++){
-	tpEt = l1TPemu_->ecalTPet[i];
-	ecalTP_emu->Fill(tpEt);
+      timer.read(treeL1TPemu, jentry, tpEmuStage);
+      timer.start(fillStage);
+      hcalTPCounts_emu.fill(l1TPemu_->hcalTPet, l1TPemu_->nHCALTP);
+      ecalTPCounts_emu.fill(l1TPemu_->ecalTPet, l1TPemu_->nECALTP);
+      if (skimWriter) {
+	skimHcalTP_emu.fill(l1TPemu_->hcalTPet, l1TPemu_->nHCALTP);
+	skimEcalTP_emu.fill(l1TPemu_->ecalTPet, l1TPemu_->nECALTP);
       }
 
-      treeL1emu->GetEntry(jentry);
-      // get jetEt*, egEt*, tauEt, htSum, mhtSum, etSum, metSum
-      // ALL EMU OBJECTS HAVE BX=0...
-      double jetEt_1(0.);
-      if (l1emu_->nJets>0) {
-	jetEt_1 = l1emu_->jetEt[0];
-	l1jetET1->Fill(jetEt_1);
-      }
-      double jetEt_2(0.);
-      if (l1emu_->nJets>1) {
-	jetEt_2 = l1emu_->jetEt[1];
-	l1jetET2->Fill(jetEt_2);
-      }
-      double jetEt_3(0.);
-      if (l1emu_->nJets>2) {
-	jetEt_3 = l1emu_->jetEt[2];
-	l1jetET3->Fill(jetEt_3);
-      }
-      double jetEt_4(0.);
-      if (l1emu_->nJets>3) {
-	jetEt_4 = l1emu_->jetEt[3];
-	l1jetET4->Fill(jetEt_4);
-      }
-      
-   
-      double htSum(0.0);
-      double mhtSum(0.0);
-      double etSum(0.0);
-      double metSum(0.0);
-      double metHFSum(0.0);
-      for (unsigned int c=0; c<l1emu_->nSums; c++){
-          if( l1emu_->sumBx[c] != 0 ) continue;
-          if( l1emu_->sumType[c] == L1Analysis::kTotalEt ) etSum = l1emu_->sumEt[c];
-          if( l1emu_->sumType[c] == L1Analysis::kTotalHt ) htSum = l1emu_->sumEt[c];
-          if( l1emu_->sumType[c] == L1Analysis::kMissingEt ) metSum = l1emu_->sumEt[c];
-	  if( l1emu_->sumType[c] == L1Analysis::kMissingEtHF ) metHFSum = l1emu_->sumEt[c];
-          if( l1emu_->sumType[c] == L1Analysis::kMissingHt ) mhtSum = l1emu_->sumEt[c];
-      }
+      timer.read(treeL1emu, jentry, emuStage);
+      timer.start(rankStage);
+      l1Quantities(l1emu_, q);
 
-      l1ET->Fill(etSum);
-      l1MET->Fill(metSum);
-      l1METHF->Fill(metHFSum);
-      l1HT->Fill(htSum);
-      l1MHT->Fill(mhtSum);
-    
-    // stuff for efficiencies and resolution
       if (recoOn) {
-	recoTree->GetEntry(jentry);
-	metfilterTree->GetEntry(jentry);
-	
-	// apply recommended MET filters
-	if (!metfilter_->muonBadTrackFilter) continue;
-	if (!metfilter_->badPFMuonFilter) continue;
-	if (!metfilter_->badChCandFilter) continue;
-
-	// met
-	float rMET = met_->caloMet;
-	refMET->Fill( rMET );
-	if( metSum >30. ) { MET_30U->Fill(rMET);}
-	if( metSum >40. ) { MET_40U->Fill(rMET);}
-	if( metSum >50. ) { MET_50U->Fill(rMET);}
-	if( metSum >70. ) { MET_70U->Fill(rMET);}
-	if( metSum >100. ) { MET_100U->Fill(rMET);}
-
-	// met resolution
-	float resMET = (metSum-rMET)/rMET;
-	hresMET->Fill(rMET, resMET);
-	
-	if (rMET<20.) h_resMET1->Fill(resMET);
-	if (rMET>=20. && rMET<40.) h_resMET2->Fill(resMET);
-	if (rMET>=40. && rMET<60.) h_resMET3->Fill(resMET);
-	if (rMET>=60. && rMET<80.) h_resMET4->Fill(resMET);
-	if (rMET>=80. && rMET<100.) h_resMET5->Fill(resMET);
-	if (rMET>=100. && rMET<120.) h_resMET6->Fill(resMET);
-	if (rMET>=120. && rMET<140.) h_resMET7->Fill(resMET);
-	if (rMET>=140. && rMET<180.) h_resMET8->Fill(resMET);
-	if (rMET>=180. && rMET<250.) h_resMET9->Fill(resMET);
-	if (rMET>=250. && rMET<500.) h_resMET10->Fill(resMET);
-	
-	// leading offline jet
-	double maxEn(0.);
-        int jetIdx(-1);
-
-        for(unsigned int i = 0; i < jet_->nJets; ++i)
-        {
-          if(jet_->etCorr[i] > maxEn){
-            maxEn = jet_->etCorr[i];
-	    if (maxEn>10.) jetIdx = i;
-          }
-        }
-
-	if (jetIdx>=0) { // at least 1 offline jet >10. geV
-
-	  refJetET->Fill(jet_->etCorr[jetIdx]);
-	  
-	  // return Matched L1 jet
-	  int l1jetIdx(-1);
-	  double minDR = 999.;
-	  double dptmin=1000.;
-	  for (unsigned int i=0; i<l1emu_->nJets; i++) {
-	    double dR=deltaR(jet_->eta[jetIdx], jet_->phi[jetIdx],l1emu_->jetEta[i],l1emu_->jetPhi[i]);
-	    double dpt=fabs( (l1emu_->jetEt[i]-jet_->etCorr[jetIdx])/jet_->etCorr[jetIdx] );
-	    if (dR<minDR && dpt<dptmin) {
-	      minDR=dR;
-	      dptmin=dpt;
-	      if (minDR<0.5) l1jetIdx=i;
-	    }
-	  }
-	  
-	  if (l1jetIdx>=0) { // found matched l1jet
-
-	    refmJetET->Fill(jet_->etCorr[jetIdx]);
-	    if (l1emu_->jetEt[l1jetIdx]>50.) jetET50->Fill(jet_->etCorr[jetIdx]);
-	    if (l1emu_->jetEt[l1jetIdx]>64.) jetET64->Fill(jet_->etCorr[jetIdx]);
-	    if (l1emu_->jetEt[l1jetIdx]>76.) jetET76->Fill(jet_->etCorr[jetIdx]);
-	    if (l1emu_->jetEt[l1jetIdx]>92.) jetET92->Fill(jet_->etCorr[jetIdx]);
-	    if (l1emu_->jetEt[l1jetIdx]>112.) jetET112->Fill(jet_->etCorr[jetIdx]);
-	    if (l1emu_->jetEt[l1jetIdx]>180.) jetET180->Fill(jet_->etCorr[jetIdx]);
-
-	    float resJet=(l1emu_->jetEt[l1jetIdx]-jet_->etCorr[jetIdx])/jet_->etCorr[jetIdx];
-	    hresJet->Fill(jet_->etCorr[jetIdx],resJet);
-
-	    if (fabs(l1emu_->jetEta[l1jetIdx])<=1.305) {
-	      hresJet_hb->Fill(jet_->etCorr[jetIdx],resJet);
-	    } else if (fabs(l1emu_->jetEta[l1jetIdx])<=3.0) {
-	      hresJet_he->Fill(jet_->etCorr[jetIdx],resJet);
-	    } else {
-	      hresJet_hf->Fill(jet_->etCorr[jetIdx],resJet);
-	    }
-	      
-	    if (jet_->etCorr[jetIdx]<50.) h_resJet1->Fill(resJet);
-	    if (jet_->etCorr[jetIdx]>=50. && jet_->etCorr[jetIdx]<100.) h_resJet2->Fill(resJet);
-	    if (jet_->etCorr[jetIdx]>=100. && jet_->etCorr[jetIdx]<150.) h_resJet3->Fill(resJet);
-	    if (jet_->etCorr[jetIdx]>=150. && jet_->etCorr[jetIdx]<200.) h_resJet4->Fill(resJet);
-	    if (jet_->etCorr[jetIdx]>=200. && jet_->etCorr[jetIdx]<250.) h_resJet5->Fill(resJet);
-	    if (jet_->etCorr[jetIdx]>=250. && jet_->etCorr[jetIdx]<300.) h_resJet6->Fill(resJet);
-	    if (jet_->etCorr[jetIdx]>=300. && jet_->etCorr[jetIdx]<350.) h_resJet7->Fill(resJet);
-	    if (jet_->etCorr[jetIdx]>=350. && jet_->etCorr[jetIdx]<400.) h_resJet8->Fill(resJet);
-	    if (jet_->etCorr[jetIdx]>=400. && jet_->etCorr[jetIdx]<450.) h_resJet9->Fill(resJet);
-	    if (jet_->etCorr[jetIdx]>=450. && jet_->etCorr[jetIdx]<500.) h_resJet10->Fill(resJet);
-	
-	    
-	  } // close 'found matched l1jet'
-	} // close 'at least one offline jet'
-	
-	
-      }// closes if 'recoOn' is true
+	timer.read(recoTree, jentry, recoStage);
+	timer.read(metfilterTree, jentry, metfilterStage);
+	timer.start(rankStage);
+	recoQuantities(l1emu_, jet_, met_, metfilter_, jetMatcher, q);
+      }
 
+      timer.start(fillStage);
+      jetHists.fill(q);
     }// closes if 'emuOn' is true
-    
+
+    if (skimWriter) {
+      setSkimRow(*skimRows, *event_, q, skimJetPairs);
+      if (q.jetPairs.size() > size_t(skimJetPairs)) skimTruncatedEvents++;
+      if (!skimRows->next()) skimWriter->append(*skimRows);
+    }
+    timer.stop();
   }// closes loop through events
+  Long64_t entryCount = progress.nDone();
+  double loopSeconds = progress.seconds();
+
+  // the same from a skim
+  if (skimInput) {
+    std::vector<uint64_t> run, lumi;
+    int nColumns = nJetSkimColumns(recoOn, skimInputPairs);
+    std::vector<std::vector<double> > values(nColumns);
+    StageClock loopClock;
+    int decodeStage = times.stage("decode skim");
+    for (size_t b=0; b<skimInput->nBlocks(); b++) {
+      timer.start(decodeStage);
+      skimInput->integers(b, kSkimRun, run);
+      skimInput->integers(b, kSkimLumi, lumi);
+      for (int c=kSkimJetEt; c<nColumns; c++) skimInput->values(b, c, values[c]);
+      timer.start(fillStage);
+      entryCount += skimInput->blockRows(b);
+      for (size_t i=0; i<skimInput->blockRows(b); i++) {
+	if (!isGoodLumiSection(run[i], lumi[i])) continue;
+	goodLumiEventCount++;
+	JetEventQuantities q;
+	readSkimRow(values, i, recoOn, skimInputPairs, q);
+	jetHists.fill(q);
+      }
+    }
+    timer.stop();
+    loopSeconds += loopClock.lap();
+    skimInput->addSpectrum("hcalTP_emu", hcalTPCounts_emu);
+    skimInput->addSpectrum("ecalTP_emu", ecalTPCounts_emu);
+    delete skimInput;
+  }
+  if (skimWriter) {
+    skimWriter->append(*skimRows);
+    skimWriter->addSpectrum("hcalTP_emu", skimHcalTP_emu);
+    skimWriter->addSpectrum("ecalTP_emu", skimEcalTP_emu);
+    skimWriter->close();
+    std::cout << "Wrote " << skimWriter->nEvents() << " events to " << skimFile;
+    if (skimWriter->nRounded() > 0) std::cout << " (" << skimWriter->nRounded() << " values rounded to 0.5 GeV)";
+    if (skimTruncatedEvents > 0) {
+      std::cout << "; " << skimTruncatedEvents << " events have more than " << skimJetPairs
+		<< " offline jets, the others are not in the skim (see -k)";
+    }
+    std::cout << std::endl;
+    delete skimRows;
+    delete skimWriter;
+  }
+
+  if (cache) {
+    while (currentFile < inputFiles.size()) finishFile(currentFile++);
+    for (size_t i=0; i<hists.size(); i++) hists[i]->Add(totals[i]);
+    hcalTPCounts_emu.add(hcalTP_emu);
+    ecalTPCounts_emu.add(ecalTP_emu);
+    jetHists.addHists();
+    goodLumiEventCount = totalEventCount;
+  }
 
   //  TFile g( outputFilename.c_str() , "new");
+  StageClock writeClock;
   kk->cd();
   // normalisation factor for rate histograms (11kHz is the orbit frequency)
   double norm = 11246*(numBunch/goodLumiEventCount); // no lumi rescale
@@ -476,25 +613,14 @@ void jetanalysis(bool newConditions, const std::string& inputFileDirectory){
 
   if (emuOn){
     // ecal/hcal TPs
+    hcalTPCounts_emu.fillHist(hcalTP_emu);
+    ecalTPCounts_emu.fillHist(ecalTP_emu);
     hcalTP_emu->Write();
     ecalTP_emu->Write();
-    // l1 quantities
-    l1jetET1->Write(); l1jetET2->Write(); l1jetET3->Write(); l1jetET4->Write();
-    l1ET->Write(); l1MET->Write(); l1METHF->Write(); l1HT->Write(); l1MHT->Write();
-    // efficiencies
-    refJetET->Write(); refmJetET->Write();
-    jetET50->Write(); jetET64->Write(); jetET76->Write(); jetET92->Write(); jetET112->Write(); jetET180->Write();
-    refMET->Write();
-    MET_30U->Write(); MET_40U->Write(); MET_50U->Write(); MET_70U->Write(); MET_100U->Write();
-    // resolutions
-    hresMET->Write(); hresJet->Write();
-    hresJet_hb->Write();
-    hresJet_he->Write();
-    hresJet_hf->Write();
-    h_resMET1->Write();h_resMET2->Write();h_resMET3->Write();h_resMET4->Write();h_resMET5->Write();h_resMET6->Write();h_resMET7->Write();h_resMET8->Write();h_resMET9->Write();h_resMET10->Write();
-    h_resJet1->Write();h_resJet2->Write();h_resJet3->Write();h_resJet4->Write();h_resJet5->Write();h_resJet6->Write();h_resJet7->Write();h_resJet8->Write();h_resJet9->Write();h_resJet10->Write();
-    
+    jetHists.write();
   }
+  kk->Close();
+  times.add(times.stage("write"), writeClock.lap());
 
   
   myfile << "using the following ntuple: " << inputFile << std::endl;
@@ -504,4 +630,9 @@ void jetanalysis(bool newConditions, const std::string& inputFileDirectory){
   myfile << "norm factor used = " << norm << std::endl;
   myfile << "number of good events = " << goodLumiEventCount << std::endl;
   myfile.close(); 
+
+  if (!writeRunReport(reportFileName(outputFilename), "l1jetanalysis", inputFile, 1, entryCount,
+		      goodLumiEventCount, loopSeconds, jobClock.lap(), times)) {
+    std::cout << "Cannot write " << reportFileName(outputFilename) << std::endl;
+  }
 }//closes the function 'rates'
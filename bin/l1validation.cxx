@@ -0,0 +1,311 @@
+// Script running the rate, TP spectrum and jet/MET efficiency and resolution
+// analyses in one pass over the ntuples
+#include "TFile.h"
+#include "TH1F.h"
+#include "TChain.h"
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisEventDataFormat.h"
+
+#include "HcalTrigger/Validation/interface/AnalysisModule.h"
+#include "HcalTrigger/Validation/interface/BatchHistogram.h"
+#include "HcalTrigger/Validation/interface/CumulativeRate.h"
+#include "HcalTrigger/Validation/interface/GoodLumiMask.h"
+#include "HcalTrigger/Validation/interface/JetQuantities.h"
+#include "HcalTrigger/Validation/interface/NtupleReader.h"
+#include "HcalTrigger/Validation/interface/RateQuantities.h"
+#include "HcalTrigger/Validation/interface/RunReport.h"
+
+/* creates in one pass what rates.exe and l1jetanalysis.exe create separately:
+the rate histograms and TP spectra (rates_def/new_cond.root) and the jet and MET
+efficiency and resolution histograms (l1analysis_def/new_cond.root).
+Every ntuple entry is read once and handed to the enabled modules (-a).
+The per-tool options (skims, caches, threads, menus, ...) stay with rates.exe
+and l1jetanalysis.exe.
+*/
+
+// configurable parameters
+double numBunch = 1537; //the number of bunches colliding for the run of interest
+double runLum = 0.02; // 0.44: 275783  0.58:  276363 //luminosity of the run of interest (*10^34)
+double expectedLum = 1.15; //expected luminosity of 2016 runs (*10^34)
+const GoodLumiMask* goodLumiMask = 0; //certified lumi sections given with -l (none: all)
+std::string ntupleIndexPath(ntupleIndexFile()); //entry-count index of the ntuples, given with -i (default: in the working directory)
+
+void validation(bool newConditions, const std::string& inputFileDirectory, bool ratesOn, bool tpOn, bool analysisOn);
+
+int main(int argc, char *argv[])
+{
+  bool newConditions = true;
+  std::string ntuplePath("");
+  std::string lumiMaskFile("");
+  bool ratesOn = true;
+  bool tpOn = true;
+  bool analysisOn = true;
+  bool badOption = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "l:a:i:")) != -1) {
+    if (opt == 'l') lumiMaskFile = optarg;
+    else if (opt == 'i') ntupleIndexPath = optarg;
+    else if (opt == 'a') {
+      ratesOn = tpOn = analysisOn = false;
+      std::istringstream modules(optarg);
+      std::string module;
+      while (std::getline(modules, module, ',')) {
+	if (module == "rates") ratesOn = true;
+	else if (module == "tp") tpOn = true;
+	else if (module == "analysis") analysisOn = true;
+	else badOption = true;
+      }
+    }
+    else badOption = true;
+  }
+
+  if (argc-optind != 2 || badOption) {
+    std::cout << "Usage: l1validation.exe [-l lumimask.json] [-a rates,tp,analysis] [-i index.txt] [new/def] [path to ntuples]\n"
+	      << "[new/def] indicates new or default (existing) conditions\n"
+	      << "the ntuples are a directory of L1Ntuple_*.root files, or a file (or pattern) ending in .root\n"
+	      << "-l only uses the lumi sections certified in a good run JSON\n"
+	      << "-a runs only the given modules (default: all): rates and tp write rates_*.root, analysis l1analysis_*.root\n"
+	      << "-i keeps the entries of the ntuple files in this index (default " << ntupleIndexFile() << " in the working directory)" << std::endl;
+    exit(1);
+  }
+  else {
+    std::string par1(argv[optind]);
+    std::transform(par1.begin(), par1.end(), par1.begin(), ::tolower);
+    if(par1.compare("new") == 0) newConditions = true;
+    else if(par1.compare("def") == 0) newConditions = false;
+    else {
+      std::cout << "First parameter must be \"new\" or \"def\"" << std::endl;
+      exit(1);
+    }
+    ntuplePath = argv[optind+1];
+  }
+
+  if (!lumiMaskFile.empty()) {
+    GoodLumiMask* mask = new GoodLumiMask();
+    if (!mask->load(lumiMaskFile)) {
+      std::cout << "Cannot read good lumi JSON " << lumiMaskFile << std::endl;
+      exit(1);
+    }
+    goodLumiMask = mask;
+  }
+
+  validation(newConditions, ntuplePath, ratesOn, tpOn, analysisOn);
+
+  return 0;
+}
+
+// normalisation factor for rate histograms (11kHz is the orbit frequency)
+double rateNorm(Long64_t goodLumiEventCount)
+{
+  return 11246*(numBunch/goodLumiEventCount); // no lumi rescale
+}
+
+void writeTPHist(const BatchHistogram& counts, const char* name)
+{
+  TH1F* tpHist = new TH1F(name, ";TP E_{T}; # Entries", counts.nBins(), counts.lo(), counts.hi());
+  counts.fillHist(tpHist);
+  tpHist->Write();
+}
+
+// the <type>Rates_emu/hw histograms of rates.exe
+class RatesModule : public AnalysisModule {
+public:
+  explicit RatesModule(TFile* file)
+    : file_(file), rates_emu_(bookRateCurves()), rates_hw_(bookRateCurves()) {}
+
+  unsigned trees() const { return kEmuTree | kHwTree; }
+
+  void analyze(const ValidationEvent& event) {
+    double et[kNRateTypes];
+    emuQuantities(event.l1emu, et);
+    for (int r=0; r<kNRateTypes; r++) rates_emu_[r].fill(et[r]);
+    hwQuantities(event.l1hw, et);
+    for (int r=0; r<kNRateTypes; r++) rates_hw_[r].fill(et[r]);
+  }
+
+  void write(Long64_t goodLumiEventCount) {
+    file_->cd();
+    double norm = rateNorm(goodLumiEventCount);
+    writeRates(rates_emu_, "Rates_emu", norm);
+    writeRates(rates_hw_, "Rates_hw", norm);
+  }
+
+private:
+  static void writeRates(const std::vector<CumulativeRate>& curves, const std::string& suffix, double norm) {
+    std::string axR = ";Threshold E_{T} (GeV);rate (Hz)";
+    for (int r=0; r<kNRateTypes; r++) {
+      std::string name(rateNames[r]);
+      name += suffix;
+      TH1F* rateHist = new TH1F(name.c_str(), axR.c_str(), curves[r].nBins(), curves[r].lo(), curves[r].hi());
+      curves[r].fillHist(rateHist);
+      rateHist->Scale(norm);
+      rateHist->Write();
+    }
+  }
+
+  TFile* file_;
+  std::vector<CumulativeRate> rates_emu_, rates_hw_;
+};
+
+// the hcal/ecal TP spectra: emulator and hardware into the rates file,
+// the emulator also into the analysis file, as the separate tools do
+class TPSpectraModule : public AnalysisModule {
+public:
+  TPSpectraModule(TFile* ratesFile, TFile* analysisFile)
+    : ratesFile_(ratesFile), analysisFile_(analysisFile),
+      hcalTP_emu_(bookTPCounts()), ecalTP_emu_(bookTPCounts()), hcalTP_hw_(bookTPCounts()), ecalTP_hw_(bookTPCounts()) {}
+
+  unsigned trees() const { return kEmuTPTree | (ratesFile_ ? kHwTPTree : 0); }
+
+  void analyze(const ValidationEvent& event) {
+    fillTPs(event.tpEmu, hcalTP_emu_, ecalTP_emu_);
+    if (ratesFile_) fillTPs(event.tpHw, hcalTP_hw_, ecalTP_hw_);
+  }
+
+  void write(Long64_t) {
+    if (ratesFile_) {
+      ratesFile_->cd();
+      writeTPHist(hcalTP_emu_, "hcalTP_emu");
+      writeTPHist(ecalTP_emu_, "ecalTP_emu");
+      writeTPHist(hcalTP_hw_, "hcalTP_hw");
+      writeTPHist(ecalTP_hw_, "ecalTP_hw");
+    }
+    if (analysisFile_) {
+      analysisFile_->cd();
+      writeTPHist(hcalTP_emu_, "hcalTP_emu");
+      writeTPHist(ecalTP_emu_, "ecalTP_emu");
+    }
+  }
+
+private:
+  TFile *ratesFile_, *analysisFile_;
+  BatchHistogram hcalTP_emu_, ecalTP_emu_, hcalTP_hw_, ecalTP_hw_;
+};
+
+// the efficiency, resolution and L1 distribution histograms of l1jetanalysis.exe
+class JetAnalysisModule : public AnalysisModule {
+public:
+  explicit JetAnalysisModule(TFile* file) : file_(file) {}
+
+  unsigned trees() const { return kEmuTree | kRecoTree; }
+
+  void analyze(const ValidationEvent& event) {
+    JetEventQuantities q;
+    l1Quantities(event.l1emu, q);
+    recoQuantities(event.l1emu, event.jet, event.met, event.metfilter, matcher_, q);
+    hists_.fill(q);
+  }
+
+  void write(Long64_t) {
+    file_->cd();
+    hists_.write();
+  }
+
+private:
+  TFile* file_;
+  JetHistograms hists_;  // booked in file_, the current directory when constructed
+  JetMatcher matcher_;
+};
+
+// run number of the first event, for the record in extraInfo.txt
+unsigned firstRunNumber(const std::string& inputFile)
+{
+  TChain eventTree("l1EventTree/L1EventTree");
+  eventTree.Add(inputFile.c_str());
+  L1Analysis::L1AnalysisEventDataFormat* event_ = new L1Analysis::L1AnalysisEventDataFormat();
+  eventTree.SetBranchAddress("Event", &event_);
+  eventTree.SetBranchStatus("*", 0);
+  eventTree.SetBranchStatus("run", 1);
+  eventTree.GetEntry(0);
+  unsigned run = event_->run;
+  delete event_;
+  return run;
+}
+
+void validation(bool newConditions, const std::string& inputFileDirectory, bool ratesOn, bool tpOn, bool analysisOn){
+
+  if (!ratesOn && !tpOn && !analysisOn){
+    std::cout << "exiting as no module selected" << std::endl;
+    return;
+  }
+
+  StageClock jobClock;
+  std::string inputFile(ntupleFiles(inputFileDirectory));
+  std::string outputDirectory = "emu";  //***runNumber, triggerType, version, hw/emu/both***MAKE SURE IT EXISTS
+
+  // the TP spectra alone go into the rates file
+  TFile* ratesFile = 0;
+  if (ratesOn || (tpOn && !analysisOn)) {
+    std::string outputFilename = newConditions ? "rates_new_cond.root" : "rates_def.root";
+    ratesFile = TFile::Open(outputFilename.c_str(), "recreate");
+    if (!ratesFile || ratesFile->IsZombie()) {
+      std::cout << "Cannot write " << outputFilename << std::endl;
+      exit(1);
+    }
+  }
+  TFile* analysisFile = 0;
+  if (analysisOn) {
+    std::string outputFilename = newConditions ? "l1analysis_new_cond.root" : "l1analysis_def.root";
+    analysisFile = TFile::Open(outputFilename.c_str(), "recreate");
+    if (!analysisFile || analysisFile->IsZombie()) {
+      std::cout << "Cannot write " << outputFilename << std::endl;
+      exit(1);
+    }
+  }
+
+  std::vector<AnalysisModule*> modules;
+  if (ratesOn) modules.push_back(new RatesModule(ratesFile));
+  if (tpOn) modules.push_back(new TPSpectraModule(ratesFile, analysisFile));
+  if (analysisOn) {
+    analysisFile->cd();
+    modules.push_back(new JetAnalysisModule(analysisFile));
+  }
+
+  std::cout << "Loading up the ntuples..." << std::endl;
+  StageTimes times;
+  Long64_t goodLumiEventCount, entryCount;
+  double loopSeconds;
+  {
+    StageClock openClock;
+    EventStream stream(inputFile, ntupleIndexPath, modules);
+    times.add(times.stage("index files"), openClock.lap());
+    EventProgress progress(stream.entries());
+    goodLumiEventCount = stream.run(goodLumiMask, progress, times);
+    entryCount = progress.nDone();
+    loopSeconds = progress.seconds();
+  }
+
+  StageClock writeClock;
+  for (AnalysisModule* module : modules) {
+    module->write(goodLumiEventCount);
+    delete module;
+  }
+  if (ratesFile) ratesFile->Close();
+  if (analysisFile) analysisFile->Close();
+  times.add(times.stage("write"), writeClock.lap());
+
+  std::string outputTxtFilename = "output_rates/" + outputDirectory + "/extraInfo.txt";
+  std::ofstream myfile; // save info about the run, including rates for a given lumi section, and number of events we used.
+  myfile.open(outputTxtFilename.c_str());
+  myfile << "run number = " << firstRunNumber(inputFile) << std::endl;
+  myfile << "using the following ntuple: " << inputFile << std::endl;
+  myfile << "number of colliding bunches = " << numBunch << std::endl;
+  myfile << "run luminosity = " << runLum << std::endl;
+  myfile << "expected luminosity = " << expectedLum << std::endl;
+  myfile << "norm factor used = " << rateNorm(goodLumiEventCount) << std::endl;
+  myfile << "number of good events = " << goodLumiEventCount << std::endl;
+  myfile.close();
+
+  std::string reportFilename = newConditions ? "l1validation_new_cond.json" : "l1validation_def.json";
+  if (!writeRunReport(reportFilename, "l1validation", inputFile, 1, entryCount, goodLumiEventCount,
+		      loopSeconds, jobClock.lap(), times)) {
+    std::cout << "Cannot write " << reportFilename << std::endl;
+  }
+}//closes the function 'validation'
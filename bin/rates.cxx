@@ -3,68 +3,303 @@
 #include "TMath.h"
 #include "TFile.h"
 #include "TTree.h"
+#include "TH1D.h"
 #include "TH1F.h"
+#include "TH2F.h"
+#include "TGraph.h"
 #include "TChain.h"
+#include "TParameter.h"
+#include "TROOT.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
 #include "L1Trigger/L1TNtuples/interface/L1AnalysisEventDataFormat.h"
 #include "L1Trigger/L1TNtuples/interface/L1AnalysisL1UpgradeDataFormat.h"
 #include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoVertexDataFormat.h"
 #include "L1Trigger/L1TNtuples/interface/L1AnalysisCaloTPDataFormat.h"
 
-
-/* TODO: put errors in rates...
-creates the the rates and distributions for l1 trigger objects
+#include "HcalTrigger/Validation/interface/BatchHistogram.h"
+#include "HcalTrigger/Validation/interface/BootstrapRate.h"
+#include "HcalTrigger/Validation/interface/CaloTPColumns.h"
+#include "HcalTrigger/Validation/interface/CumulativeRate.h"
+#include "HcalTrigger/Validation/interface/EventIndex.h"
+#include "HcalTrigger/Validation/interface/EventSkim.h"
+#include "HcalTrigger/Validation/interface/ExactRate.h"
+#include "HcalTrigger/Validation/interface/FixedHist.h"
+#include "HcalTrigger/Validation/interface/GoodLumiMask.h"
+#include "HcalTrigger/Validation/interface/L1UpgradeColumns.h"
+#include "HcalTrigger/Validation/interface/LumiRates.h"
+#include "HcalTrigger/Validation/interface/NtupleReader.h"
+#include "HcalTrigger/Validation/interface/PairedRate.h"
+#include "HcalTrigger/Validation/interface/PileupRates.h"
+#include "HcalTrigger/Validation/interface/RateQuantities.h"
+#include "HcalTrigger/Validation/interface/ResultCache.h"
+#include "HcalTrigger/Validation/interface/RunReport.h"
+#include "HcalTrigger/Validation/interface/SeedMenu.h"
+
+
+/* creates the the rates and distributions for l1 trigger objects
 How to use:
-1. input the number of bunches in the run (~line 35)
-2. change the variables "newConditionsNtuples" and "oldConditionsNtuples" to ntuple paths
-3. If good run JSON is not applied during ntuple production, modify isGoodLumiSection()
-
-Optionally, if you want to rescale to a given instantaneous luminosity:
-1. input the instantaneous luminosity of the run (~line 32) [only if we scale to 2016 nominal]
-2. select whether you rescale to L=1.5e34 (~line606??...) generally have it setup to rescale
-nb: for 2&3 I have provided the info in runInfoForRates.txt
+1. set numBunch below to the number of colliding bunches of the run
+2. run "rates.exe def [ntuples]" and "rates.exe new [ntuples]" (rates.exe alone lists the options):
+   -j threads, -l good run JSON (or modify isGoodLumiSection()), -L per-LS rates,
+   -c cache / -s skim, -m seed menu, -x / -t exact rates and thresholds,
+   -b bootstrap errors, -p / -e rates vs pileup, -r / -w / merge split jobs (scripts/run_local.py)
+3. or run "rates.exe pair [def ntuples] [new ntuples]" on the events both have
+4. draw the outputs with draw_rates.exe
+
+Optionally, to rescale to a given instantaneous luminosity, set runLum and
+expectedLum below and use the rescaled norm in rateNorm(); with -p the pileup
+fits are extrapolated to expectedLum instead.
 */
 
 // configurable parameters
 double numBunch = 1537; //the number of bunches colliding for the run of interest
 double runLum = 0.02; // 0.44: 275783  0.58:  276363 //luminosity of the run of interest (*10^34)
-double expectedLum = 1.15; //expected luminosity of 2016 runs (*10^34)
+double expectedLum = 1.15; //expected luminosity of 2016 runs (*10^34), or given with -e; with -p the rates are extrapolated to it
+const GoodLumiMask* goodLumiMask = 0; //certified lumi sections given with -l (none: see isGoodLumiSection())
+const SeedMenu* seedMenu = 0; //L1 seeds given with -m (none: no menu rates)
+bool exactRates = false; //keep every value for unbinned rate curves (-x)
+std::vector<double> targetRates; //rates (Hz) to find the exact thresholds of, given with -t (implies -x)
+int nReplicas = 0; //Poisson bootstrap replicas for the rate errors, given with -b (0: no bootstrap)
+bool binByPileUp = false; //also bin the rates in pileup, given with -p
+const PileupTable* pileupTable = 0; //per-LS pileup of -p lumi.csv (none: the number of vertices, -p nvtx)
+Long64_t firstEntry = 0, lastEntry = -1; //only the entries [firstEntry, lastEntry) of the input, given with -r (-1: to the end)
+std::string partialOutput(""); //write the counts there instead of the rates (-w), to be added up by merge
+std::string ntupleIndexPath(ntupleIndexFile()); //entry-count index of the ntuples, given with -i (default: in the working directory)
+
+void rates(bool newConditions, const std::string& inputFileDirectory, int nThreads, bool perLumi,
+	   const std::string& cacheDirectory, const std::string& skimFile);
+void pairedRates(const std::string& defFileDirectory, const std::string& newFileDirectory, int nThreads);
+void mergeRates(bool newConditions, const std::vector<std::string>& partialFiles);
+
+// an option argument that is a number and nothing else
+bool parseInteger(const char* text, long long& value)
+{
+  char extra;
+  return sscanf(text, "%lld%c", &value, &extra) == 1;
+}
 
-void rates(bool newConditions, const std::string& inputFileDirectory);
+bool parseReal(const char* text, double& value)
+{
+  char extra;
+  return sscanf(text, "%lf%c", &value, &extra) == 1;
+}
 
 int main(int argc, char *argv[])
 {
   bool newConditions = true;
+  bool paired = false;
+  bool merge = false;
   std::string ntuplePath("");
+  std::string newNtuplePath("");
+  int nThreads = 1;
+  bool perLumi = false;
+  std::string lumiMaskFile("");
+  std::string cacheDirectory("");
+  std::string skimFile("");
+  std::string menuFile("");
+  std::string pileupSource("");
+  bool badOption = false;
+
+  // getopt reports unknown options and missing arguments itself
+  int opt;
+  while ((opt = getopt(argc, argv, "j:Ll:c:s:m:xt:b:p:e:r:w:i:")) != -1) {
+    long long number;
+    double real;
+    if (opt == 'j') {
+      if (!parseInteger(optarg, number)) {
+	std::cout << "-j " << optarg << ": not a number of threads" << std::endl;
+	badOption = true;
+      }
+      else if (number < 1) {
+	std::cout << "-j " << optarg << ": at least one thread is needed" << std::endl;
+	badOption = true;
+      }
+      else nThreads = number;
+    }
+    else if (opt == 'L') perLumi = true;
+    else if (opt == 'l') lumiMaskFile = optarg;
+    else if (opt == 'c') cacheDirectory = optarg;
+    else if (opt == 's') skimFile = optarg;
+    else if (opt == 'm') menuFile = optarg;
+    else if (opt == 'x') exactRates = true;
+    else if (opt == 't') {
+      exactRates = true;
+      if (parseReal(optarg, real) && real > 0.) targetRates.push_back(real);
+      else {
+	std::cout << "-t " << optarg << ": not a rate in Hz" << std::endl;
+	badOption = true;
+      }
+    }
+    else if (opt == 'b') {
+      if (parseInteger(optarg, number) && number >= 1) nReplicas = number;
+      else {
+	std::cout << "-b " << optarg << ": not a number of replicas" << std::endl;
+	badOption = true;
+      }
+    }
+    else if (opt == 'p') pileupSource = optarg;
+    else if (opt == 'e') {
+      if (parseReal(optarg, real) && real > 0.) expectedLum = real;
+      else {
+	std::cout << "-e " << optarg << ": not a luminosity" << std::endl;
+	badOption = true;
+      }
+    }
+    else if (opt == 'r') {
+      std::string range(optarg);
+      size_t colon = range.find(':');
+      long long last;
+      if (colon == std::string::npos || !parseInteger(range.substr(0, colon).c_str(), number)
+	  || !parseInteger(range.substr(colon+1).c_str(), last) || number < 0 || last < number) {
+	std::cout << "-r " << optarg << ": not an entry range first:last" << std::endl;
+	badOption = true;
+      }
+      else {
+	firstEntry = number;
+	lastEntry = last;
+      }
+    }
+    else if (opt == 'w') partialOutput = optarg;
+    else if (opt == 'i') ntupleIndexPath = optarg;
+    else badOption = true;
+  }
 
-  if (argc != 3) {
-    std::cout << "Usage: rates.exe [new/def] [path to ntuples]\n"
-	      << "[new/def] indicates new or default (existing) conditions" << std::endl;
+  std::string par1(optind < argc ? argv[optind] : "");
+  std::transform(par1.begin(), par1.end(), par1.begin(), ::tolower);
+  if (par1.compare("pair") == 0) paired = true;
+  if (par1.compare("merge") == 0) merge = true;
+
+  if ((merge ? argc-optind < 3 : argc-optind != (paired ? 3 : 2)) || badOption) {
+    std::cout << "Usage: rates.exe [-j nThreads] [-l lumimask.json] [-L | -c cacheDir] [-s skim] [-m menu.txt] [-x] [-t rate ...] [-b nReplicas] [-p nvtx | -p lumi.csv] [-e lumi] [-r first:last] [-w partial.root] [-i index.txt] [new/def] [path to ntuples or skim]\n"
+	      << "       rates.exe [-j nThreads] [-l lumimask.json] [-x] [-t rate ...] [-b nReplicas] [-i index.txt] pair [path to default ntuples] [path to new ntuples]\n"
+	      << "       rates.exe [-w partial.root] merge [new/def] [partial outputs ...]\n"
+	      << "[new/def] indicates new or default (existing) conditions\n"
+	      << "the ntuples are a directory of L1Ntuple_*.root files, or a file (or pattern) ending in .root\n"
+	      << "pair compares both conditions on the events they have in common (draw_rates.exe -p draws its ratios)\n"
+	      << "merge adds up partial outputs written with -w into the rates of new/def (or, with -w, into another partial output)\n"
+	      << "-j runs the event loop on nThreads threads (default 1)\n"
+	      << "-l only uses the lumi sections certified in a good run JSON\n"
+	      << "-L also stores the rates of every lumi section\n"
+	      << "-c keeps the results of every input file in cacheDir and only processes new or changed files\n"
+	      << "-s also writes a skim of the good events, which can be given instead of the ntuple path\n"
+	      << "-m also computes the total, pure and overlap rates of the L1 seeds in a menu file (see SeedMenu.h)\n"
+	      << "-x also writes unbinned rate curves, exact at any threshold\n"
+	      << "-t writes the lowest thresholds giving at most this rate in Hz to extraInfo.txt (can be repeated, implies -x)\n"
+	      << "-b sets the rate errors from nReplicas Poisson bootstrap replicas, seeded by the event, and writes the replicas and a 68% band\n"
+	      << "-p also bins the rates in the number of vertices or in the per-LS pileup of a brilcalc CSV, and fits rate vs pileup\n"
+	      << "-e sets the luminosity (10^34) the pileup fits are extrapolated to (default " << expectedLum << ")\n"
+	      << "-r only processes the entries [first, last) of the ntuples\n"
+	      << "-w writes the counts to a partial output instead of the rates, see merge and scripts/run_local.py\n"
+	      << "-i keeps the entries of the ntuple files in this index (default " << ntupleIndexFile() << " in the working directory)" << std::endl;
     exit(1);
   }
   else {
-    std::string par1(argv[1]);
-    std::transform(par1.begin(), par1.end(), par1.begin(), ::tolower);
-    if(par1.compare("new") == 0) newConditions = true;
-    else if(par1.compare("def") == 0) newConditions = false;
+    std::string condition(merge ? argv[optind+1] : par1);
+    std::transform(condition.begin(), condition.end(), condition.begin(), ::tolower);
+    if(paired) newConditions = false;
+    else if(condition.compare("new") == 0) newConditions = true;
+    else if(condition.compare("def") == 0) newConditions = false;
     else {
-      std::cout << "First parameter must be \"new\" or \"def\"" << std::endl;
+      std::cout << (merge ? "merge must be followed by \"new\" or \"def\"" : "First parameter must be \"new\", \"def\", \"pair\" or \"merge\"") << std::endl;
+      exit(1);
+    }
+    if(!merge) ntuplePath = argv[optind+1];
+    if(paired) newNtuplePath = argv[optind+2];
+  }
+
+  bool partial = merge || !partialOutput.empty() || lastEntry >= 0;
+  if (partial && (paired || perLumi || !cacheDirectory.empty() || !skimFile.empty() || !menuFile.empty()
+		  || exactRates || nReplicas > 0 || !pileupSource.empty())) {
+    std::cout << "-r, -w and merge cannot be combined with pair, -L, -c, -s, -m, -x, -t, -b or -p" << std::endl;
+    exit(1);
+  }
+  if (partial && !merge && SkimReader::isSkim(ntuplePath)) {
+    std::cout << "-r and -w need ntuples, not a skim" << std::endl;
+    exit(1);
+  }
+
+  if (!cacheDirectory.empty() && (paired || perLumi)) {
+    std::cout << "-c cannot be combined with pair or -L" << std::endl;
+    exit(1);
+  }
+  if (!skimFile.empty() && (paired || !cacheDirectory.empty())) {
+    std::cout << "-s cannot be combined with pair or -c" << std::endl;
+    exit(1);
+  }
+  if (!paired && SkimReader::isSkim(ntuplePath) && (!cacheDirectory.empty() || !skimFile.empty() || !menuFile.empty())) {
+    std::cout << "-c, -s and -m need ntuples, not a skim" << std::endl;
+    exit(1);
+  }
+  if (!menuFile.empty() && (paired || !cacheDirectory.empty())) {
+    std::cout << "-m cannot be combined with pair or -c" << std::endl;
+    exit(1);
+  }
+  if ((exactRates || nReplicas > 0) && !cacheDirectory.empty()) {
+    std::cout << "-x, -t and -b cannot be combined with -c" << std::endl;
+    exit(1);
+  }
+  if (!pileupSource.empty() && (paired || !cacheDirectory.empty())) {
+    std::cout << "-p cannot be combined with pair or -c" << std::endl;
+    exit(1);
+  }
+  if (pileupSource == "nvtx" && SkimReader::isSkim(ntuplePath)) {
+    std::cout << "-p nvtx needs ntuples, not a skim" << std::endl;
+    exit(1);
+  }
+
+  if (!lumiMaskFile.empty()) {
+    GoodLumiMask* mask = new GoodLumiMask();
+    if (!mask->load(lumiMaskFile)) {
+      std::cout << "Cannot read good lumi JSON " << lumiMaskFile << std::endl;
+      exit(1);
+    }
+    goodLumiMask = mask;
+  }
+
+  if (!menuFile.empty()) {
+    SeedMenu* menu = new SeedMenu();
+    std::string error;
+    if (!menu->load(menuFile, error)) {
+      std::cout << "Cannot read menu: " << error << std::endl;
       exit(1);
     }
-    ntuplePath = argv[2];
+    seedMenu = menu;
+  }
+
+  if (!pileupSource.empty()) {
+    binByPileUp = true;
+    if (pileupSource != "nvtx") {
+      PileupTable* table = new PileupTable();
+      if (!table->load(pileupSource)) {
+	std::cout << "Cannot read luminosity table " << pileupSource << std::endl;
+	exit(1);
+      }
+      pileupTable = table;
+    }
   }
 
-  rates(newConditions, ntuplePath);
+  if(paired) pairedRates(ntuplePath, newNtuplePath, nThreads);
+  else if(merge) mergeRates(newConditions, std::vector<std::string>(argv+optind+2, argv+argc));
+  else rates(newConditions, ntuplePath, nThreads, perLumi, cacheDirectory, skimFile);
 
   return 0;
 }
 
 // only need to edit this section if good run JSON
-// is not used during ntuple production
-bool isGoodLumiSection(int lumiBlock)
+// is not used during ntuple production and not given with -l
+bool isGoodLumiSection(unsigned run, int lumiBlock)
 {
+  if (goodLumiMask) return goodLumiMask->contains(run, lumiBlock);
+
   if (lumiBlock >= 1
       || lumiBlock <= 10000) {
     return true;
@@ -73,641 +308,1498 @@ bool isGoodLumiSection(int lumiBlock)
   return false;
 }
 
-void rates(bool newConditions, const std::string& inputFileDirectory){
-  
-  bool hwOn = true;   //are we using data from hardware? (upgrade trigger had to be running!!!)
-  bool emuOn = true;  //are we using data from emulator?
+// the ntuple trees read by the rate tools
+std::vector<std::string> rateTreeNames(bool emuOn, bool hwOn, bool vtxOn = false)
+{
+  std::vector<std::string> names(1, "l1EventTree/L1EventTree");
+  // PU info, for the rates in bins of vertices
+  if (vtxOn) names.push_back("l1RecoTree/RecoTree");
+  if (emuOn) {
+    names.push_back("l1UpgradeEmuTree/L1UpgradeTree");
+    names.push_back("l1CaloTowerEmuTree/L1CaloTowerTree");
+  }
+  if (hwOn) {
+    names.push_back("l1UpgradeTree/L1UpgradeTree");
+    names.push_back("l1CaloTowerTree/L1CaloTowerTree");
+  }
+  return names;
+}
 
-  if (hwOn==false && emuOn==false){
-    std::cout << "exiting as neither hardware or emulator selected" << std::endl;
-    return;
+// ntuple trees and the objects they are read into; each thread gets its own.
+// The trees are those of the index, read together one file at a time.
+struct RateReader {
+  RateReader(const NtupleIndex& index, bool menuOn = false);
+  ~RateReader();
+
+  // the entry in its file of an entry of the input, opening the file if needed
+  Long64_t load(Long64_t entry) { return ntuples.load(entry); }
+  TTree* tree(int t) const { return ntuples.tree(t); }
+
+  NtupleReader ntuples;
+  // indices of the trees in the index, -1 if not read
+  int eventTree, vtxTree, treeL1emu, treeL1hw, treeL1TPemu, treeL1TPhw;
+  L1UpgradeColumns *l1emu_, *l1hw_;
+  L1Analysis::L1AnalysisEventDataFormat *event_;
+  L1Analysis::L1AnalysisRecoVertexDataFormat *vtx_;
+  CaloTPColumns *l1TPemu_, *l1TPhw_;
+};
+
+RateReader::RateReader(const NtupleIndex& index, bool menuOn)
+  : ntuples(index), eventTree(index.tree("l1EventTree/L1EventTree")), vtxTree(index.tree("l1RecoTree/RecoTree")),
+    treeL1emu(index.tree("l1UpgradeEmuTree/L1UpgradeTree")), treeL1hw(index.tree("l1UpgradeTree/L1UpgradeTree")),
+    treeL1TPemu(index.tree("l1CaloTowerEmuTree/L1CaloTowerTree")), treeL1TPhw(index.tree("l1CaloTowerTree/L1CaloTowerTree"))
+{
+  // only the leaves used below are read
+  l1emu_ = new L1UpgradeColumns(0, menuOn);
+  l1hw_ = new L1UpgradeColumns(0, menuOn);
+  if (treeL1emu >= 0) ntuples.bind(treeL1emu, *l1emu_);
+  if (treeL1hw >= 0) ntuples.bind(treeL1hw, *l1hw_);
+  event_ = new L1Analysis::L1AnalysisEventDataFormat();
+  ntuples.bind(eventTree, [this](TTree* tree) {
+      tree->SetBranchAddress("Event", &event_);
+      // read first for every entry, so only what the lumi check, matching and skim need
+      tree->SetBranchStatus("*", 0);
+      tree->SetBranchStatus("run", 1);
+      tree->SetBranchStatus("lumi", 1);
+      tree->SetBranchStatus("event", 1);
+      tree->SetBranchStatus("bx", 1);
+    });
+  vtx_ = new L1Analysis::L1AnalysisRecoVertexDataFormat();
+  if (vtxTree >= 0) {
+    ntuples.bind(vtxTree, [this](TTree* tree) {
+	tree->SetBranchAddress("Vertex", &vtx_);
+	tree->SetBranchStatus("*", 0);
+	tree->SetBranchStatus("nVtx", 1);
+      });
   }
 
-  std::string inputFile(inputFileDirectory);
-  inputFile += "/L1Ntuple_*.root";
-  std::string outputDirectory = "emu";  //***runNumber, triggerType, version, hw/emu/both***MAKE SURE IT EXISTS
-  std::string outputFilename = "rates_def.root";
-  if(newConditions) outputFilename = "rates_new_cond.root";
-  TFile* kk = TFile::Open( outputFilename.c_str() , "recreate");
-  // if (kk!=0){
-  //   cout << "TERMINATE: not going to overwrite file " << outputFilename << endl;
-  //   return;
-  // }
+  l1TPemu_ = new CaloTPColumns(0);
+  l1TPhw_ = new CaloTPColumns(0);
+  if (treeL1TPemu >= 0) ntuples.bind(treeL1TPemu, *l1TPemu_);
+  if (treeL1TPhw >= 0) ntuples.bind(treeL1TPhw, *l1TPhw_);
+}
 
+RateReader::~RateReader()
+{
+  // the files are closed before the objects their trees point to go
+  ntuples.close();
+  delete l1emu_;
+  delete l1hw_;
+  delete event_;
+  delete vtx_;
+  delete l1TPemu_;
+  delete l1TPhw_;
+}
 
-  // make trees
-  std::cout << "Loading up the TChain..." << std::endl;
-  TChain * treeL1emu = new TChain("l1UpgradeEmuTree/L1UpgradeTree");
-  if (emuOn){
-    treeL1emu->Add(inputFile.c_str());
+// L1 objects in bx 0 and the sums, as the menu seeds see them
+void menuEvent(const L1UpgradeColumns* l1_, const L1Analysis::L1AnalysisEventDataFormat* event_, MenuEvent& event)
+{
+  event.id = EventIndex::key(event_->run, event_->lumi, event_->event);
+  for (int t=0; t<kNMenuObjectTypes; t++) event.objects[t].clear();
+  for (unsigned c=0; c<l1_->nJets; c++) {
+    if (l1_->jetBx[c]==0) event.objects[kMenuJet].push_back(MenuObject{l1_->jetEt[c], l1_->jetEta[c], false});
   }
-  TChain * treeL1hw = new TChain("l1UpgradeTree/L1UpgradeTree");
-  if (hwOn){
-    treeL1hw->Add(inputFile.c_str());
+  for (unsigned c=0; c<l1_->nEGs; c++) {
+    if (l1_->egBx[c]==0) event.objects[kMenuEg].push_back(MenuObject{l1_->egEt[c], l1_->egEta[c], l1_->egIso[c]==1});
   }
-  TChain * eventTree = new TChain("l1EventTree/L1EventTree");
-  eventTree->Add(inputFile.c_str());
+  for (unsigned c=0; c<l1_->nTaus; c++) {
+    if (l1_->tauBx[c]==0) event.objects[kMenuTau].push_back(MenuObject{l1_->tauEt[c], l1_->tauEta[c], l1_->tauIso[c]>0});
+  }
+  sumQuantities(l1_, event.sums[kMenuHtSum], event.sums[kMenuMhtSum], event.sums[kMenuEtSum],
+		event.sums[kMenuMetSum], event.sums[kMenuMetHFSum]);
+}
 
-  // In case you want to include PU info
-  // TChain * vtxTree = new TChain("l1RecoTree/RecoTree");
-  // if(binByPileUp){
-  //   vtxTree->Add(inputFile.c_str());
-  // }
+// empty pileup-binned rates for the curves (no bins unless binByPileUp)
+PileupRates bookPileupRates(const std::vector<CumulativeRate>& curves)
+{
+  // pileup (or vertex) bins
+  int nPileupBins = 100;
+  float pileupLo = 0.;
+  float pileupHi = 100.;
+
+  return PileupRates(curves, binByPileUp ? nPileupBins : 0, pileupLo, pileupHi);
+}
 
+// everything filled in the event loop; one set per thread, merged afterwards
+struct RateAccumulators {
+  explicit RateAccumulators(const std::vector<CumulativeRate>& curves, bool perLumi_ = false,
+			    const SeedMenu* menu = 0);
+  void add(const RateAccumulators& other);
+  // store the counts (not the per-LS ones) in a cache entry and add them back
+  void writeCache(TDirectory* dir) const;
+  bool addCache(TDirectory* dir);
+
+  // differential counts per threshold, turned into the rate histograms at write time
+  std::vector<CumulativeRate> rates_emu;
+  std::vector<CumulativeRate> rates_hw;
+  BatchHistogram hcalTP_emu, ecalTP_emu, hcalTP_hw, ecalTP_hw;
+  Long64_t goodLumiEventCount;
+  // the same counts split by lumi section, if requested
+  bool perLumi;
+  LumiRates lumiRates_emu, lumiRates_hw;
+  // the menu seeds, if a menu was given
+  MenuRates menu_emu, menu_hw;
+  // every value of every quantity, if exactRates (else empty)
+  std::vector<ExactRate> exact_emu, exact_hw;
+  // bootstrap replicas of the rates and of the event count, if nReplicas > 0
+  std::vector<BootstrapRate> boot_emu, boot_hw;
+  BootstrapRate bootEvents;
+  // the counts in bins of pileup, if binByPileUp
+  PileupRates pileup_emu, pileup_hw;
+  // entries read, wall time of the event loop and time per stage, for the run report
+  Long64_t entryCount;
+  double loopSeconds;
+  StageTimes times;
+};
+
+RateAccumulators::RateAccumulators(const std::vector<CumulativeRate>& curves, bool perLumi_, const SeedMenu* menu)
+  : rates_emu(curves), rates_hw(curves),
+    hcalTP_emu(bookTPCounts()), ecalTP_emu(bookTPCounts()), hcalTP_hw(bookTPCounts()), ecalTP_hw(bookTPCounts()),
+    goodLumiEventCount(0), perLumi(perLumi_), menu_emu(menu), menu_hw(menu),
+    exact_emu(exactRates ? kNRateTypes : 0), exact_hw(exactRates ? kNRateTypes : 0),
+    bootEvents(1, nReplicas), pileup_emu(bookPileupRates(curves)), pileup_hw(bookPileupRates(curves)),
+    entryCount(0), loopSeconds(0.)
+{
+  if (nReplicas > 0) {
+    for (int r=0; r<kNRateTypes; r++) {
+      boot_emu.push_back(BootstrapRate(curves[r].nBins(), nReplicas));
+      boot_hw.push_back(BootstrapRate(curves[r].nBins(), nReplicas));
+    }
+  }
+}
 
-  TChain * treeL1TPemu = new TChain("l1CaloTowerEmuTree/L1CaloTowerTree");
-  if (emuOn){
-    treeL1TPemu->Add(inputFile.c_str());
+void RateAccumulators::add(const RateAccumulators& other)
+{
+  for (int r=0; r<kNRateTypes; r++) {
+    rates_emu[r].add(other.rates_emu[r]);
+    rates_hw[r].add(other.rates_hw[r]);
+  }
+  hcalTP_emu.add(other.hcalTP_emu);
+  ecalTP_emu.add(other.ecalTP_emu);
+  hcalTP_hw.add(other.hcalTP_hw);
+  ecalTP_hw.add(other.ecalTP_hw);
+  goodLumiEventCount += other.goodLumiEventCount;
+  lumiRates_emu.add(other.lumiRates_emu);
+  lumiRates_hw.add(other.lumiRates_hw);
+  menu_emu.add(other.menu_emu);
+  menu_hw.add(other.menu_hw);
+  for (size_t r=0; r<exact_emu.size(); r++) {
+    exact_emu[r].add(other.exact_emu[r]);
+    exact_hw[r].add(other.exact_hw[r]);
+  }
+  for (size_t r=0; r<boot_emu.size(); r++) {
+    boot_emu[r].add(other.boot_emu[r]);
+    boot_hw[r].add(other.boot_hw[r]);
   }
+  bootEvents.add(other.bootEvents);
+  pileup_emu.add(other.pileup_emu);
+  pileup_hw.add(other.pileup_hw);
+  entryCount += other.entryCount;
+  loopSeconds += other.loopSeconds;
+  times.add(other.times);
+}
 
-  TChain * treeL1TPhw = new TChain("l1CaloTowerTree/L1CaloTowerTree");
-  if (hwOn){
-    treeL1TPhw->Add(inputFile.c_str());
+void writeCounts(const std::vector<CumulativeRate>& rates, const std::string& suffix)
+{
+  for (int r=0; r<kNRateTypes; r++) {
+    std::string name(rateNames[r]);
+    name += suffix;
+    TH1D counts(name.c_str(), "", rates[r].nBins(), rates[r].lo(), rates[r].hi());
+    rates[r].fillCounts(&counts);
+    counts.Write();
   }
+}
 
-  L1Analysis::L1AnalysisL1UpgradeDataFormat    *l1emu_ = new L1Analysis::L1AnalysisL1UpgradeDataFormat();
-  treeL1emu->SetBranchAddress("L1Upgrade", &l1emu_);
-  L1Analysis::L1AnalysisL1UpgradeDataFormat    *l1hw_ = new L1Analysis::L1AnalysisL1UpgradeDataFormat();
-  treeL1hw->SetBranchAddress("L1Upgrade", &l1hw_);
-  L1Analysis::L1AnalysisEventDataFormat    *event_ = new L1Analysis::L1AnalysisEventDataFormat();
-  eventTree->SetBranchAddress("Event", &event_);
-  // L1Analysis::L1AnalysisRecoVertexDataFormat    *vtx_ = new L1Analysis::L1AnalysisRecoVertexDataFormat();
-  // vtxTree->SetBranchAddress("Vertex", &vtx_);
+void writeTPCounts(const BatchHistogram& tp, const char* name)
+{
+  TH1D counts(name, "", tp.nBins(), tp.lo(), tp.hi());
+  tp.fillHist(&counts);
+  counts.Write();
+}
 
-  L1Analysis::L1AnalysisCaloTPDataFormat    *l1TPemu_ = new L1Analysis::L1AnalysisCaloTPDataFormat();
-  treeL1TPemu->SetBranchAddress("CaloTP", &l1TPemu_);
-  L1Analysis::L1AnalysisCaloTPDataFormat    *l1TPhw_ = new L1Analysis::L1AnalysisCaloTPDataFormat();
-  treeL1TPhw->SetBranchAddress("CaloTP", &l1TPhw_);
+void RateAccumulators::writeCache(TDirectory* dir) const
+{
+  dir->cd();
+  writeCounts(rates_emu, "Counts_emu");
+  writeCounts(rates_hw, "Counts_hw");
+  writeTPCounts(hcalTP_emu, "hcalTP_emu");
+  writeTPCounts(ecalTP_emu, "ecalTP_emu");
+  writeTPCounts(hcalTP_hw, "hcalTP_hw");
+  writeTPCounts(ecalTP_hw, "ecalTP_hw");
+  TParameter<Long64_t> count("goodLumiEventCount", goodLumiEventCount);
+  count.Write();
+}
 
+// false (and nothing added) if the entry is incomplete
+bool RateAccumulators::addCache(TDirectory* dir)
+{
+  std::vector<TH1*> counts_emu, counts_hw;
+  for (int r=0; r<kNRateTypes; r++) {
+    std::string name(rateNames[r]);
+    counts_emu.push_back(dynamic_cast<TH1*>(dir->Get((name + "Counts_emu").c_str())));
+    counts_hw.push_back(dynamic_cast<TH1*>(dir->Get((name + "Counts_hw").c_str())));
+    if (!counts_emu.back() || !counts_hw.back()) return false;
+  }
+  const char* tpNames[4] = {"hcalTP_emu", "ecalTP_emu", "hcalTP_hw", "ecalTP_hw"};
+  TH1* tps[4];
+  for (int i=0; i<4; i++) {
+    tps[i] = dynamic_cast<TH1*>(dir->Get(tpNames[i]));
+    if (!tps[i]) return false;
+  }
+  TParameter<Long64_t>* count = dynamic_cast<TParameter<Long64_t>*>(dir->Get("goodLumiEventCount"));
+  if (!count) return false;
 
-  // get number of entries
-  Long64_t nentries;
-  if (emuOn) nentries = treeL1emu->GetEntries();
-  else nentries = treeL1hw->GetEntries();
-  int goodLumiEventCount = 0;
+  for (int r=0; r<kNRateTypes; r++) {
+    rates_emu[r].addCounts(counts_emu[r]);
+    rates_hw[r].addCounts(counts_hw[r]);
+  }
+  hcalTP_emu.add(tps[0]);
+  ecalTP_emu.add(tps[1]);
+  hcalTP_hw.add(tps[2]);
+  ecalTP_hw.add(tps[3]);
+  goodLumiEventCount += count->GetVal();
+  return true;
+}
 
-  std::string outputTxtFilename = "output_rates/" + outputDirectory + "/extraInfo.txt";
-  std::ofstream myfile; // save info about the run, including rates for a given lumi section, and number of events we used.
-  myfile.open(outputTxtFilename.c_str());
-  eventTree->GetEntry(0);
-  myfile << "run number = " << event_->run << std::endl;
-
-  // set parameters for histograms
-  // jet bins
-  int nJetBins = 400;
-  float jetLo = 0.;
-  float jetHi = 400.;
-  float jetBinWidth = (jetHi-jetLo)/nJetBins;
-
-  // EG bins
-  int nEgBins = 300;
-  float egLo = 0.;
-  float egHi = 300.;
-  float egBinWidth = (egHi-egLo)/nEgBins;
-
-  // tau bins
-  int nTauBins = 300;
-  float tauLo = 0.;
-  float tauHi = 300.;
-  float tauBinWidth = (tauHi-tauLo)/nTauBins;
-
-  // htSum bins
-  int nHtSumBins = 600;
-  float htSumLo = 0.;
-  float htSumHi = 600.;
-  float htSumBinWidth = (htSumHi-htSumLo)/nHtSumBins;
-
-  // mhtSum bins
-  int nMhtSumBins = 300;
-  float mhtSumLo = 0.;
-  float mhtSumHi = 300.;
-  float mhtSumBinWidth = (mhtSumHi-mhtSumLo)/nMhtSumBins;
-
-  // etSum bins
-  int nEtSumBins = 600;
-  float etSumLo = 0.;
-  float etSumHi = 600.;
-  float etSumBinWidth = (etSumHi-etSumLo)/nEtSumBins;
-
-  // metSum bins
-  int nMetSumBins = 300;
-  float metSumLo = 0.;
-  float metSumHi = 300.;
-  float metSumBinWidth = (metSumHi-metSumLo)/nMetSumBins;
-
-  // metHFSum bins
-  int nMetHFSumBins = 300;
-  float metHFSumLo = 0.;
-  float metHFSumHi = 300.;
-  float metHFSumBinWidth = (metHFSumHi-metHFSumLo)/nMetHFSumBins;
-
-  // tp bins
-  int nTpBins = 100;
-  float tpLo = 0.;
-  float tpHi = 100.;
+// E_T^new - E_T^def (GeV)
+typedef FixedHist<FixedBinning<400, -100, 100> > ShiftHist;
 
-  std::string axR = ";Threshold E_{T} (GeV);rate (Hz)";
-  std::string axD = ";E_{T} (GeV);events/bin";
-
-  //make histos
-  TH1F* singleJetRates_emu = new TH1F("singleJetRates_emu", axR.c_str(), nJetBins, jetLo, jetHi);
-  TH1F* doubleJetRates_emu = new TH1F("doubleJetRates_emu", axR.c_str(), nJetBins, jetLo, jetHi);
-  TH1F* tripleJetRates_emu = new TH1F("tripleJetRates_emu", axR.c_str(), nJetBins, jetLo, jetHi);
-  TH1F* quadJetRates_emu = new TH1F("quadJetRates_emu", axR.c_str(), nJetBins, jetLo, jetHi);
-  TH1F* singleEgRates_emu = new TH1F("singleEgRates_emu", axR.c_str(), nEgBins, egLo, egHi);
-  TH1F* doubleEgRates_emu = new TH1F("doubleEgRates_emu", axR.c_str(), nEgBins, egLo, egHi);
-  TH1F* singleTauRates_emu = new TH1F("singleTauRates_emu", axR.c_str(), nTauBins, tauLo, tauHi);
-  TH1F* doubleTauRates_emu = new TH1F("doubleTauRates_emu", axR.c_str(), nTauBins, tauLo, tauHi);
-  TH1F* singleISOEgRates_emu = new TH1F("singleISOEgRates_emu", axR.c_str(), nEgBins, egLo, egHi);
-  TH1F* doubleISOEgRates_emu = new TH1F("doubleISOEgRates_emu", axR.c_str(), nEgBins, egLo, egHi);
-  TH1F* singleISOTauRates_emu = new TH1F("singleISOTauRates_emu", axR.c_str(), nTauBins, tauLo, tauHi);
-  TH1F* doubleISOTauRates_emu = new TH1F("doubleISOTauRates_emu", axR.c_str(), nTauBins, tauLo, tauHi);
-  TH1F* htSumRates_emu = new TH1F("htSumRates_emu",axR.c_str(), nHtSumBins, htSumLo, htSumHi);
-  TH1F* mhtSumRates_emu = new TH1F("mhtSumRates_emu",axR.c_str(), nMhtSumBins, mhtSumLo, mhtSumHi);
-  TH1F* etSumRates_emu = new TH1F("etSumRates_emu",axR.c_str(), nEtSumBins, etSumLo, etSumHi);
-  TH1F* metSumRates_emu = new TH1F("metSumRates_emu",axR.c_str(), nMetSumBins, metSumLo, metSumHi); 
-  TH1F* metHFSumRates_emu = new TH1F("metHFSumRates_emu",axR.c_str(), nMetHFSumBins, metHFSumLo, metHFSumHi); 
-  
-  TH1F* singleJetRates_hw = new TH1F("singleJetRates_hw", axR.c_str(), nJetBins, jetLo, jetHi);
-  TH1F* doubleJetRates_hw = new TH1F("doubleJetRates_hw", axR.c_str(), nJetBins, jetLo, jetHi);
-  TH1F* tripleJetRates_hw = new TH1F("tripleJetRates_hw", axR.c_str(), nJetBins, jetLo, jetHi);
-  TH1F* quadJetRates_hw = new TH1F("quadJetRates_hw", axR.c_str(), nJetBins, jetLo, jetHi);
-  TH1F* singleEgRates_hw = new TH1F("singleEgRates_hw", axR.c_str(), nEgBins, egLo, egHi);
-  TH1F* doubleEgRates_hw = new TH1F("doubleEgRates_hw", axR.c_str(), nEgBins, egLo, egHi);
-  TH1F* singleTauRates_hw = new TH1F("singleTauRates_hw", axR.c_str(), nTauBins, tauLo, tauHi);
-  TH1F* doubleTauRates_hw = new TH1F("doubleTauRates_hw", axR.c_str(), nTauBins, tauLo, tauHi);
-  TH1F* singleISOEgRates_hw = new TH1F("singleISOEgRates_hw", axR.c_str(), nEgBins, egLo, egHi);
-  TH1F* doubleISOEgRates_hw = new TH1F("doubleISOEgRates_hw", axR.c_str(), nEgBins, egLo, egHi);
-  TH1F* singleISOTauRates_hw = new TH1F("singleISOTauRates_hw", axR.c_str(), nTauBins, tauLo, tauHi);
-  TH1F* doubleISOTauRates_hw = new TH1F("doubleISOTauRates_hw", axR.c_str(), nTauBins, tauLo, tauHi);
-  TH1F* htSumRates_hw = new TH1F("htSumRates_hw",axR.c_str(), nHtSumBins, htSumLo, htSumHi);
-  TH1F* mhtSumRates_hw = new TH1F("mhtSumRates_hw",axR.c_str(), nMhtSumBins, mhtSumLo, mhtSumHi);
-  TH1F* etSumRates_hw = new TH1F("etSumRates_hw",axR.c_str(), nEtSumBins, etSumLo, etSumHi);
-  TH1F* metSumRates_hw = new TH1F("metSumRates_hw",axR.c_str(), nMetHFSumBins, metHFSumLo, metHFSumHi); 
-  TH1F* metHFSumRates_hw = new TH1F("metHFSumRates_hw",axR.c_str(), nMetHFSumBins, metHFSumLo, metHFSumHi); 
-
-  TH1F* hcalTP_emu = new TH1F("hcalTP_emu", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
-  TH1F* ecalTP_emu = new TH1F("ecalTP_emu", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
-
-  TH1F* hcalTP_hw = new TH1F("hcalTP_hw", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
-  TH1F* ecalTP_hw = new TH1F("ecalTP_hw", ";TP E_{T}; # Entries", nTpBins, tpLo, tpHi);
+// per-event comparison of the emulator quantities with default and new conditions
+struct PairedAccumulators {
+  explicit PairedAccumulators(const std::vector<CumulativeRate>& curves);
+  void add(const PairedAccumulators& other);
 
-  /////////////////////////////////
-  // loop through all the entries//
-  /////////////////////////////////
-  for (Long64_t jentry=0; jentry<nentries; jentry++){
-    if((jentry%10000)==0) std::cout << "Done " << jentry  << " events of " << nentries << std::endl;
+  std::vector<PairedRate> flips_emu;
+  std::vector<ShiftHist> shifts_emu;
+  Long64_t unmatchedEventCount;
+};
+
+PairedAccumulators::PairedAccumulators(const std::vector<CumulativeRate>& curves)
+  : unmatchedEventCount(0)
+{
+  for (int r=0; r<kNRateTypes; r++) {
+    flips_emu.push_back(PairedRate(curves[r].nBins()));
+    shifts_emu.push_back(ShiftHist());
+  }
+}
+
+void PairedAccumulators::add(const PairedAccumulators& other)
+{
+  for (int r=0; r<kNRateTypes; r++) {
+    flips_emu[r].add(other.flips_emu[r]);
+    shifts_emu[r].add(other.shifts_emu[r]);
+  }
+  unmatchedEventCount += other.unmatchedEventCount;
+}
+
+// skim of the good events: the event id, the quantities of the rate curves
+// and the TP spectra at the TP resolution, enough to redo every histogram
+std::vector<SkimColumn> rateSkimColumns(bool emuOn, bool hwOn)
+{
+  std::vector<SkimColumn> columns = {{"run", kSkimUInt32}, {"lumi", kSkimUInt32},
+				     {"event", kSkimUInt64}, {"bx", kSkimUInt32}};
+  for (int r=0; r<kNRateTypes; r++) {
+    if (emuOn) columns.push_back(SkimColumn{std::string("emu_") + rateNames[r], kSkimEt});
+  }
+  for (int r=0; r<kNRateTypes; r++) {
+    if (hwOn) columns.push_back(SkimColumn{std::string("hw_") + rateNames[r], kSkimEt});
+  }
+  return columns;
+}
+
+BatchHistogram bookSkimTPCounts()
+{
+  return BatchHistogram(512, 0., 512*skim::kEtLsb);
+}
+
+// per-thread rows and TP spectra of the skim
+struct SkimFiller {
+  SkimFiller(SkimWriter* writer_, bool emuOn, bool hwOn);
+
+  SkimWriter* writer;
+  SkimRows rows;
+  int emuColumn, hwColumn;
+  BatchHistogram hcalTP_emu, ecalTP_emu, hcalTP_hw, ecalTP_hw;
+};
+
+SkimFiller::SkimFiller(SkimWriter* writer_, bool emuOn, bool hwOn)
+  : writer(writer_), rows(writer_->columns()),
+    emuColumn(emuOn ? writer_->columns().size() - (hwOn ? 2 : 1)*kNRateTypes : -1),
+    hwColumn(hwOn ? writer_->columns().size() - kNRateTypes : -1),
+    hcalTP_emu(bookSkimTPCounts()), ecalTP_emu(bookSkimTPCounts()), hcalTP_hw(bookSkimTPCounts()), ecalTP_hw(bookSkimTPCounts())
+{
+}
+
+// split [first, last) into about nChunks entry ranges that start on cluster
+// boundaries of a tree, so that no basket is decompressed by two threads.
+// With at least nChunks files in the range, the file boundaries are enough
+// and no file is opened before the loop.
+std::vector<std::pair<Long64_t, Long64_t> > clusterChunks(NtupleReader& ntuples, int tree, Long64_t first, Long64_t last,
+							  int nChunks)
+{
+  const NtupleIndex& index = ntuples.index();
+  bool byFile = index.fileOf(last-1) - index.fileOf(first) + 1 >= size_t(nChunks);
+  std::vector<Long64_t> starts(1, first);
+  for (size_t f=0; f<index.nFiles() && index.offset(f) < last; f++) {
+    if (index.offset(f+1) <= first) continue;
+    if (byFile) {
+      if (index.offset(f) > first) starts.push_back(index.offset(f));
+      continue;
+    }
+    if (ntuples.load(index.offset(f)) < 0) continue;
+    TTree::TClusterIterator clusters = ntuples.tree(tree)->GetClusterIterator(0);
+    Long64_t start;
+    while ((start = clusters()) < ntuples.tree(tree)->GetEntries()) {
+      if (index.offset(f) + start > first && index.offset(f) + start < last) starts.push_back(index.offset(f) + start);
+    }
+  }
+  ntuples.close();
+  starts.push_back(last);
+
+  std::vector<std::pair<Long64_t, Long64_t> > chunks;
+  Long64_t chunkSize = (last-first)/nChunks + 1;
+  Long64_t begin = first;
+  for (unsigned i=1; i<starts.size(); i++) {
+    if (starts[i]-begin < chunkSize && i+1 < starts.size()) continue;
+    chunks.push_back(std::make_pair(begin, starts[i]));
+    begin = starts[i];
+  }
+  return chunks;
+}
 
+// call work(thread, first, last) on nThreads threads until [first, last)
+// is covered; threads take the next free chunk until none is left
+template <typename Work>
+void runChunks(NtupleReader& ntuples, int tree, Long64_t first, Long64_t last, int nThreads, Work work)
+{
+  std::vector<std::pair<Long64_t, Long64_t> > chunks;
+  if (nThreads == 1) chunks.push_back(std::make_pair(first, last));
+  else chunks = clusterChunks(ntuples, tree, first, last, 8*nThreads);
+
+  std::atomic<unsigned> nextChunk(0);
+  auto loop = [&](int t) {
+    unsigned c;
+    while ((c = nextChunk++) < chunks.size()) work(t, chunks[c].first, chunks[c].second);
+  };
+  if (nThreads == 1) loop(0);
+  else {
+    std::vector<std::thread> threads;
+    for (int t=0; t<nThreads; t++) threads.emplace_back(loop, t);
+    for (auto& thread : threads) thread.join();
+  }
+}
+
+// event loop over the entries [first, last)
+void processEntries(RateReader& reader, RateAccumulators& acc, SkimFiller* skim, Long64_t first, Long64_t last,
+		    bool emuOn, bool hwOn, EventProgress& progress)
+{
+  MenuEvent seedEvent;
+  BootstrapWeights weights(nReplicas);
+  StageTimer timer(acc.times);
+  int eventStage = acc.times.stage("GetEntry l1EventTree");
+  int vtxStage = acc.times.stage("GetEntry l1RecoTree");
+  int tpEmuStage = acc.times.stage("GetEntry l1CaloTowerEmuTree");
+  int emuStage = acc.times.stage("GetEntry l1UpgradeEmuTree");
+  int tpHwStage = acc.times.stage("GetEntry l1CaloTowerTree");
+  int hwStage = acc.times.stage("GetEntry l1UpgradeTree");
+  int rankStage = acc.times.stage("rank objects");
+  int fillStage = acc.times.stage("fill");
+  int openStage = acc.times.stage("open files");
+  for (Long64_t jentry=first; jentry<last; jentry++){
+    progress.count();
+    timer.start(openStage);
+    Long64_t entry = reader.load(jentry);
 
     //lumi break clause
-    eventTree->GetEntry(jentry);
+    if (entry >= 0) timer.read(reader.tree(reader.eventTree), entry, eventStage);
+    timer.stop();
     //skip the corresponding event
-    if (!isGoodLumiSection(event_->lumi)) continue;
-    goodLumiEventCount++;
+    if (entry < 0 || !isGoodLumiSection(reader.event_->run, reader.event_->lumi)) continue;
+    timer.start(fillStage);
+    acc.goodLumiEventCount++;
+    if (nReplicas > 0) {
+      weights.generate(EventIndex::key(reader.event_->run, reader.event_->lumi, reader.event_->event));
+      acc.bootEvents.fill(0, weights.data());
+    }
+    if (binByPileUp) {
+      double pileup;
+      if (pileupTable) pileup = pileupTable->pileup(reader.event_->run, reader.event_->lumi);
+      else {
+	timer.read(reader.tree(reader.vtxTree), entry, vtxStage);
+	timer.start(fillStage);
+	pileup = reader.vtx_->nVtx;
+      }
+      int bin = acc.pileup_emu.pileupBin(pileup);
+      acc.pileup_emu.addEvent(bin);
+      acc.pileup_hw.addEvent(bin);
+    }
+    if (acc.perLumi) {
+      acc.lumiRates_emu.addEvent(reader.event_->run, reader.event_->lumi);
+      acc.lumiRates_hw.addEvent(reader.event_->run, reader.event_->lumi);
+    }
+    if (skim) {
+      skim->rows.setInteger(0, reader.event_->run);
+      skim->rows.setInteger(1, reader.event_->lumi);
+      skim->rows.setInteger(2, reader.event_->event);
+      skim->rows.setInteger(3, reader.event_->bx);
+    }
 
     //do routine for L1 emulator quantites
     if (emuOn){
+      timer.read(reader.tree(reader.treeL1TPemu), entry, tpEmuStage);
+      timer.start(fillStage);
+      fillTPs(reader.l1TPemu_, acc.hcalTP_emu, acc.ecalTP_emu);
+
+      timer.read(reader.tree(reader.treeL1emu), entry, emuStage);
+      timer.start(rankStage);
+      // record each quantity once; rate curves are built at write time
+      double et[kNRateTypes];
+      emuQuantities(reader.l1emu_, et);
+      timer.start(fillStage);
+      for (int r=0; r<kNRateTypes; r++) acc.rates_emu[r].fill(et[r]);
+      for (size_t r=0; r<acc.exact_emu.size(); r++) acc.exact_emu[r].fill(et[r]);
+      for (size_t r=0; r<acc.boot_emu.size(); r++) acc.boot_emu[r].fill(acc.rates_emu[r].thresholdBin(et[r]), weights.data());
+      if (binByPileUp) {
+	for (int r=0; r<kNRateTypes; r++) acc.pileup_emu.fill(r, acc.rates_emu[r].thresholdBin(et[r]));
+      }
+      if (acc.perLumi) {
+	for (int r=0; r<kNRateTypes; r++) acc.lumiRates_emu.fill(r, acc.rates_emu[r].thresholdBin(et[r]));
+      }
+      if (skim) {
+	fillTPs(reader.l1TPemu_, skim->hcalTP_emu, skim->ecalTP_emu);
+	for (int r=0; r<kNRateTypes; r++) skim->rows.setValue(skim->emuColumn+r, et[r]);
+      }
+      if (acc.menu_emu.active()) {
+	menuEvent(reader.l1emu_, reader.event_, seedEvent);
+	acc.menu_emu.fill(seedEvent);
+      }
+    }// closes if 'emuOn' is true
 
-      treeL1TPemu->GetEntry(jentry);
-      double tpEt(0.);
-      
-      for(int i=0; i < l1TPemu_->nHCALTP; i++){
-	tpEt = l1TPemu_->hcalTPet[i];
-	hcalTP_emu->Fill(tpEt);
-      }
-      for(int i=0; i < l1TPemu_->nECALTP; i++){
-	tpEt = l1TPemu_->ecalTPet[i];
-	ecalTP_emu->Fill(tpEt);
-      }
-
-      treeL1emu->GetEntry(jentry);
-      // get jetEt*, egEt*, tauEt, htSum, mhtSum, etSum, metSum
-      // ALL EMU OBJECTS HAVE BX=0...
-      double jetEt_1 = 0;
-      double jetEt_2 = 0;
-      double jetEt_3 = 0;
-      double jetEt_4 = 0;
-      if (l1emu_->nJets>0) jetEt_1 = l1emu_->jetEt[0];
-      if (l1emu_->nJets>1) jetEt_2 = l1emu_->jetEt[1];
-      if (l1emu_->nJets>2) jetEt_3 = l1emu_->jetEt[2];
-      if (l1emu_->nJets>3) jetEt_4 = l1emu_->jetEt[3];       
-      
-      double egEt_1 = 0;
-      double egEt_2 = 0;
-      //EG pt's are not given in descending order...bx?
-      for (UInt_t c=0; c<l1emu_->nEGs; c++){
-        if (l1emu_->egEt[c] > egEt_1){
-          egEt_2 = egEt_1;
-          egEt_1 = l1emu_->egEt[c];
-        }
-        else if (l1emu_->egEt[c] <= egEt_1 && l1emu_->egEt[c] > egEt_2){
-          egEt_2 = l1emu_->egEt[c];
-        }
-      }
-
-      double tauEt_1 = 0;
-      double tauEt_2 = 0;
-      //tau pt's are not given in descending order
-      for (UInt_t c=0; c<l1emu_->nTaus; c++){
-        if (l1emu_->tauEt[c] > tauEt_1){
-          tauEt_2 = tauEt_1;
-          tauEt_1 = l1emu_->tauEt[c];
-        }
-        else if (l1emu_->tauEt[c] <= tauEt_1 && l1emu_->tauEt[c] > tauEt_2){
-          tauEt_2 = l1emu_->tauEt[c];
-        }
-      }
-
-      double egISOEt_1 = 0;
-      double egISOEt_2 = 0;
-      //EG pt's are not given in descending order...bx?
-      for (UInt_t c=0; c<l1emu_->nEGs; c++){
-        if (l1emu_->egEt[c] > egISOEt_1 && l1emu_->egIso[c]==1){
-          egISOEt_2 = egISOEt_1;
-          egISOEt_1 = l1emu_->egEt[c];
-        }
-        else if (l1emu_->egEt[c] <= egISOEt_1 && l1emu_->egEt[c] > egISOEt_2 && l1emu_->egIso[c]==1){
-          egISOEt_2 = l1emu_->egEt[c];
-        }
-      }
-
-      double tauISOEt_1 = 0;
-      double tauISOEt_2 = 0;
-      //tau pt's are not given in descending order
-      for (UInt_t c=0; c<l1emu_->nTaus; c++){
-        if (l1emu_->tauEt[c] > tauISOEt_1 && l1emu_->tauIso[c]>0){
-          tauISOEt_2 = tauISOEt_1;
-          tauISOEt_1 = l1emu_->tauEt[c];
-        }
-        else if (l1emu_->tauEt[c] <= tauISOEt_1 && l1emu_->tauEt[c] > tauISOEt_2 && l1emu_->tauIso[c]>0){
-          tauISOEt_2 = l1emu_->tauEt[c];
-        }
-      }
-
-      double htSum(0.0);
-      double mhtSum(0.0);
-      double etSum(0.0);
-      double metSum(0.0);
-      double metHFSum(0.0);
-      for (unsigned int c=0; c<l1emu_->nSums; c++){
-          if( l1emu_->sumBx[c] != 0 ) continue;
-          if( l1emu_->sumType[c] == L1Analysis::kTotalEt ) etSum = l1emu_->sumEt[c];
-          if( l1emu_->sumType[c] == L1Analysis::kTotalHt ) htSum = l1emu_->sumEt[c];
-          if( l1emu_->sumType[c] == L1Analysis::kMissingEt ) metSum = l1emu_->sumEt[c];
-	  if( l1emu_->sumType[c] == L1Analysis::kMissingEtHF ) metHFSum = l1emu_->sumEt[c];
-          if( l1emu_->sumType[c] == L1Analysis::kMissingHt ) mhtSum = l1emu_->sumEt[c];
-      }
-
-      // for each bin fill according to whether our object has a larger corresponding energy
-      for(int bin=0; bin<nJetBins; bin++){
-        if( (jetEt_1) >= jetLo + (bin*jetBinWidth) ) singleJetRates_emu->Fill(jetLo+(bin*jetBinWidth));  //GeV
-      } 
-
-      for(int bin=0; bin<nJetBins; bin++){
-        if( (jetEt_2) >= jetLo + (bin*jetBinWidth) ) doubleJetRates_emu->Fill(jetLo+(bin*jetBinWidth));  //GeV
-      }  
-
-      for(int bin=0; bin<nJetBins; bin++){
-        if( (jetEt_3) >= jetLo + (bin*jetBinWidth) ) tripleJetRates_emu->Fill(jetLo+(bin*jetBinWidth));  //GeV
-      }  
-
-      for(int bin=0; bin<nJetBins; bin++){
-        if( (jetEt_4) >= jetLo + (bin*jetBinWidth) ) quadJetRates_emu->Fill(jetLo+(bin*jetBinWidth));  //GeV
-      }  
-             
-      for(int bin=0; bin<nEgBins; bin++){
-        if( (egEt_1) >= egLo + (bin*egBinWidth) ) singleEgRates_emu->Fill(egLo+(bin*egBinWidth));  //GeV
-      } 
-
-      for(int bin=0; bin<nEgBins; bin++){
-        if( (egEt_2) >= egLo + (bin*egBinWidth) ) doubleEgRates_emu->Fill(egLo+(bin*egBinWidth));  //GeV
-      }  
-
-      for(int bin=0; bin<nTauBins; bin++){
-        if( (tauEt_1) >= tauLo + (bin*tauBinWidth) ) singleTauRates_emu->Fill(tauLo+(bin*tauBinWidth));  //GeV
-      }
-
-      for(int bin=0; bin<nTauBins; bin++){
-        if( (tauEt_2) >= tauLo + (bin*tauBinWidth) ) doubleTauRates_emu->Fill(tauLo+(bin*tauBinWidth));  //GeV
-      } 
-
-      for(int bin=0; bin<nEgBins; bin++){
-        if( (egISOEt_1) >= egLo + (bin*egBinWidth) ) singleISOEgRates_emu->Fill(egLo+(bin*egBinWidth));  //GeV
-      } 
+    //do routine for L1 hardware quantities
+    if (hwOn){
+      timer.read(reader.tree(reader.treeL1TPhw), entry, tpHwStage);
+      timer.start(fillStage);
+      fillTPs(reader.l1TPhw_, acc.hcalTP_hw, acc.ecalTP_hw);
+
+      timer.read(reader.tree(reader.treeL1hw), entry, hwStage);
+      timer.start(rankStage);
+      double et[kNRateTypes];
+      hwQuantities(reader.l1hw_, et);
+      timer.start(fillStage);
+      for (int r=0; r<kNRateTypes; r++) acc.rates_hw[r].fill(et[r]);
+      for (size_t r=0; r<acc.exact_hw.size(); r++) acc.exact_hw[r].fill(et[r]);
+      for (size_t r=0; r<acc.boot_hw.size(); r++) acc.boot_hw[r].fill(acc.rates_hw[r].thresholdBin(et[r]), weights.data());
+      if (binByPileUp) {
+	for (int r=0; r<kNRateTypes; r++) acc.pileup_hw.fill(r, acc.rates_hw[r].thresholdBin(et[r]));
+      }
+      if (acc.perLumi) {
+	for (int r=0; r<kNRateTypes; r++) acc.lumiRates_hw.fill(r, acc.rates_hw[r].thresholdBin(et[r]));
+      }
+      if (skim) {
+	fillTPs(reader.l1TPhw_, skim->hcalTP_hw, skim->ecalTP_hw);
+	for (int r=0; r<kNRateTypes; r++) skim->rows.setValue(skim->hwColumn+r, et[r]);
+      }
+      if (acc.menu_hw.active()) {
+	menuEvent(reader.l1hw_, reader.event_, seedEvent);
+	acc.menu_hw.fill(seedEvent);
+      }
+    }// closes if 'hwOn' is true
 
-      for(int bin=0; bin<nEgBins; bin++){
-        if( (egISOEt_2) >= egLo + (bin*egBinWidth) ) doubleISOEgRates_emu->Fill(egLo+(bin*egBinWidth));  //GeV
-      }  
+    if (skim && !skim->rows.next()) skim->writer->append(skim->rows);
+    timer.stop();
 
-      for(int bin=0; bin<nTauBins; bin++){
-        if( (tauISOEt_1) >= tauLo + (bin*tauBinWidth) ) singleISOTauRates_emu->Fill(tauLo+(bin*tauBinWidth));  //GeV
-      }
+  }// closes loop through events
+}
 
-      for(int bin=0; bin<nTauBins; bin++){
-        if( (tauISOEt_2) >= tauLo + (bin*tauBinWidth) ) doubleISOTauRates_emu->Fill(tauLo+(bin*tauBinWidth));  //GeV
-      } 
+// index of the new-conditions events by (run, lumi, event), reading only
+// those leaves; the entries are numbered as in ntuples
+EventIndex buildEventIndex(const NtupleIndex& ntuples)
+{
+  RateReader reader(ntuples);
+  TTree* eventTree = 0;
+  Long64_t nentries = ntuples.entries();
+  EventIndex index(nentries);
+  for (Long64_t jentry=0; jentry<nentries; jentry++) {
+    Long64_t entry = reader.load(jentry);
+    if (entry < 0) continue;
+    if (reader.tree(reader.eventTree) != eventTree) {
+      eventTree = reader.tree(reader.eventTree);
+      eventTree->SetBranchStatus("bx", 0);
+    }
+    eventTree->GetEntry(entry);
+    index.insert(EventIndex::key(reader.event_->run, reader.event_->lumi, reader.event_->event), jentry);
+  }
+  return index;
+}
 
-      for(int bin=0; bin<nHtSumBins; bin++){
-        if( (htSum) >= htSumLo+(bin*htSumBinWidth) ) htSumRates_emu->Fill(htSumLo+(bin*htSumBinWidth)); //GeV
+// event loop over the default-conditions entries [first, last), each joined
+// with the same event in the new-conditions ntuples. Events without a
+// partner are skipped. The hardware does not depend on the conditions, so
+// its quantities are read once and go into both sets of rates. The partners
+// of the entries of one default file are looked up first and then read in
+// the order of the new entries, so each new file is opened once per
+// default file instead of whenever the join jumps to another one.
+void processPairedEntries(RateReader& defReader, RateReader& newReader, const EventIndex& newIndex,
+			  RateAccumulators& defAcc, RateAccumulators& newAcc, PairedAccumulators& pairAcc,
+			  Long64_t first, Long64_t last, bool hwOn, EventProgress& progress)
+{
+  const L1Analysis::L1AnalysisEventDataFormat* defEvent_ = defReader.event_;
+  const L1Analysis::L1AnalysisEventDataFormat* newEvent_ = newReader.event_;
+  BootstrapWeights weights(nReplicas);
+  // both conditions are timed in the default accumulators
+  StageTimer timer(defAcc.times);
+  int eventStage = defAcc.times.stage("GetEntry l1EventTree");
+  int newEventStage = defAcc.times.stage("GetEntry new l1EventTree");
+  int tpEmuStage = defAcc.times.stage("GetEntry l1CaloTowerEmuTree");
+  int newTpEmuStage = defAcc.times.stage("GetEntry new l1CaloTowerEmuTree");
+  int emuStage = defAcc.times.stage("GetEntry l1UpgradeEmuTree");
+  int newEmuStage = defAcc.times.stage("GetEntry new l1UpgradeEmuTree");
+  int tpHwStage = defAcc.times.stage("GetEntry l1CaloTowerTree");
+  int hwStage = defAcc.times.stage("GetEntry l1UpgradeTree");
+  int rankStage = defAcc.times.stage("rank objects");
+  int fillStage = defAcc.times.stage("fill");
+  int openStage = defAcc.times.stage("open files");
+
+  const NtupleIndex& defNtuples = defReader.ntuples.index();
+  std::vector<std::pair<Long64_t, Long64_t> > partners; // (new entry, default entry)
+  for (Long64_t fileFirst=first; fileFirst<last; ) {
+    Long64_t fileLast = std::min(last, defNtuples.offset(defNtuples.fileOf(fileFirst)+1));
+    partners.clear();
+    for (Long64_t jentry=fileFirst; jentry<fileLast; jentry++){
+      progress.count();
+      timer.start(openStage);
+      Long64_t entry = defReader.load(jentry);
+      if (entry >= 0) timer.read(defReader.tree(defReader.eventTree), entry, eventStage);
+      timer.stop();
+      if (entry < 0 || !isGoodLumiSection(defEvent_->run, defEvent_->lumi)) continue;
+
+      timer.start(fillStage);
+      Long64_t newEntry = newIndex.find(EventIndex::key(defEvent_->run, defEvent_->lumi, defEvent_->event));
+      if (newEntry >= 0) partners.push_back(std::make_pair(newEntry, jentry));
+      else pairAcc.unmatchedEventCount++;
+      timer.stop();
+    }
+    std::sort(partners.begin(), partners.end());
+    fileFirst = fileLast;
+
+    for (const std::pair<Long64_t, Long64_t>& partner : partners){
+      timer.start(openStage);
+      Long64_t entry = defReader.load(partner.second);
+      Long64_t newEntry = newReader.load(partner.first);
+      if (entry >= 0 && newEntry >= 0) {
+	timer.read(defReader.tree(defReader.eventTree), entry, eventStage);
+	timer.read(newReader.tree(newReader.eventTree), newEntry, newEventStage);
+	if (newEvent_->run != defEvent_->run || newEvent_->lumi != defEvent_->lumi
+	    || newEvent_->event != defEvent_->event) newEntry = -1;
       }
-
-      for(int bin=0; bin<nMhtSumBins; bin++){
-        if( (mhtSum) >= mhtSumLo+(bin*mhtSumBinWidth) ) mhtSumRates_emu->Fill(mhtSumLo+(bin*mhtSumBinWidth)); //GeV           
+      if (entry < 0 || newEntry < 0) {
+	pairAcc.unmatchedEventCount++;
+	timer.stop();
+	continue;
       }
-
-      for(int bin=0; bin<nEtSumBins; bin++){
-        if( (etSum) >= etSumLo+(bin*etSumBinWidth) ) etSumRates_emu->Fill(etSumLo+(bin*etSumBinWidth)); //GeV           
+      defAcc.goodLumiEventCount++;
+      newAcc.goodLumiEventCount++;
+      if (nReplicas > 0) {
+	weights.generate(EventIndex::key(defEvent_->run, defEvent_->lumi, defEvent_->event));
+	defAcc.bootEvents.fill(0, weights.data());
+	newAcc.bootEvents.fill(0, weights.data());
       }
 
-      for(int bin=0; bin<nMetSumBins; bin++){
-        if( (metSum) >= metSumLo+(bin*metSumBinWidth) ) metSumRates_emu->Fill(metSumLo+(bin*metSumBinWidth)); //GeV           
+      timer.read(defReader.tree(defReader.treeL1TPemu), entry, tpEmuStage);
+      timer.start(fillStage);
+      fillTPs(defReader.l1TPemu_, defAcc.hcalTP_emu, defAcc.ecalTP_emu);
+      timer.read(newReader.tree(newReader.treeL1TPemu), newEntry, newTpEmuStage);
+      timer.start(fillStage);
+      fillTPs(newReader.l1TPemu_, newAcc.hcalTP_emu, newAcc.ecalTP_emu);
+
+      timer.read(defReader.tree(defReader.treeL1emu), entry, emuStage);
+      timer.read(newReader.tree(newReader.treeL1emu), newEntry, newEmuStage);
+      timer.start(rankStage);
+      double defEt[kNRateTypes];
+      double newEt[kNRateTypes];
+      emuQuantities(defReader.l1emu_, defEt);
+      emuQuantities(newReader.l1emu_, newEt);
+      timer.start(fillStage);
+      for (int r=0; r<kNRateTypes; r++) {
+	defAcc.rates_emu[r].fill(defEt[r]);
+	newAcc.rates_emu[r].fill(newEt[r]);
+	pairAcc.flips_emu[r].fill(defAcc.rates_emu[r].thresholdBin(defEt[r]), newAcc.rates_emu[r].thresholdBin(newEt[r]));
+	pairAcc.shifts_emu[r].fill(newEt[r]-defEt[r]);
       }
-      for(int bin=0; bin<nMetHFSumBins; bin++){
-        if( (metHFSum) >= metHFSumLo+(bin*metHFSumBinWidth) ) metHFSumRates_emu->Fill(metHFSumLo+(bin*metHFSumBinWidth)); //GeV           
+      for (size_t r=0; r<defAcc.exact_emu.size(); r++) {
+	defAcc.exact_emu[r].fill(defEt[r]);
+	newAcc.exact_emu[r].fill(newEt[r]);
+      }
+      for (size_t r=0; r<defAcc.boot_emu.size(); r++) {
+	defAcc.boot_emu[r].fill(defAcc.rates_emu[r].thresholdBin(defEt[r]), weights.data());
+	newAcc.boot_emu[r].fill(newAcc.rates_emu[r].thresholdBin(newEt[r]), weights.data());
       }
 
+      if (hwOn){
+	timer.read(defReader.tree(defReader.treeL1TPhw), entry, tpHwStage);
+	timer.start(fillStage);
+	fillTPs(defReader.l1TPhw_, defAcc.hcalTP_hw, defAcc.ecalTP_hw);
+	fillTPs(defReader.l1TPhw_, newAcc.hcalTP_hw, newAcc.ecalTP_hw);
+
+	timer.read(defReader.tree(defReader.treeL1hw), entry, hwStage);
+	timer.start(rankStage);
+	double et[kNRateTypes];
+	hwQuantities(defReader.l1hw_, et);
+	timer.start(fillStage);
+	for (int r=0; r<kNRateTypes; r++) {
+	  defAcc.rates_hw[r].fill(et[r]);
+	  newAcc.rates_hw[r].fill(et[r]);
+	}
+	for (size_t r=0; r<defAcc.exact_hw.size(); r++) {
+	  defAcc.exact_hw[r].fill(et[r]);
+	  newAcc.exact_hw[r].fill(et[r]);
+	}
+	for (size_t r=0; r<defAcc.boot_hw.size(); r++) {
+	  int bin = defAcc.rates_hw[r].thresholdBin(et[r]);
+	  defAcc.boot_hw[r].fill(bin, weights.data());
+	  newAcc.boot_hw[r].fill(bin, weights.data());
+	}
+      }
+      timer.stop();
+    }// closes loop through the partners
+  }// closes loop through the default files
+}
 
-    }// closes if 'emuOn' is true
+// normalisation factor for rate histograms (11kHz is the orbit frequency)
+double rateNorm(Long64_t goodLumiEventCount)
+{
+  return 11246*(numBunch/goodLumiEventCount); // no lumi rescale
+  //  return 11246*(numBunch/goodLumiEventCount)*(expectedLum/runLum); //scale to nominal lumi
+}
 
+// histogram named <type><suffix> with the binning of the rate curve
+TH1F* bookRateHist(const CumulativeRate& curve, int type, const std::string& suffix, const std::string& axis)
+{
+  std::string name(rateNames[type]);
+  name += suffix;
+  return new TH1F(name.c_str(), axis.c_str(), curve.nBins(), curve.lo(), curve.hi());
+}
 
+void writeTPHist(const BatchHistogram& counts, const char* name)
+{
+  TH1F* tpHist = new TH1F(name, ";TP E_{T}; # Entries", counts.nBins(), counts.lo(), counts.hi());
+  counts.fillHist(tpHist);
+  tpHist->Write();
+}
 
+// Unbinned rate curves <type>ExactRates_<suffix>: one point per distinct
+// value v, at the rate of events with a quantity >= v. The rate is a step
+// function, constant for thresholds between two points and equal to the
+// upper one, so look the points up rather than interpolating.
+void writeExactRates(const std::vector<ExactRate>& exact, const std::string& suffix, double norm)
+{
+  for (int r=0; r<kNRateTypes; r++) {
+    ExactRateCurve curve = exact[r].curve();
+    std::vector<double> threshold(curve.size()), rate(curve.size());
+    for (size_t i=0; i<curve.size(); i++) {
+      threshold[i] = curve.value(i);
+      rate[i] = curve.passing(i)*norm;
+    }
+    TGraph* graph = new TGraph(curve.size(), threshold.data(), rate.data());
+    std::string name(rateNames[r]);
+    name += "ExactRates_" + suffix;
+    graph->SetName(name.c_str());
+    graph->SetTitle(";Threshold E_{T} (GeV);rate (Hz)");
+    graph->Write();
+  }
+}
 
+// Bootstrap uncertainties of a normalised rate histogram. Every replica is
+// normalised by its own weighted event count; the spread of the replicas
+// replaces the bin errors, which a Scale() of the cumulative counts gets
+// wrong as the bins are fully correlated. Also written: <type>RatesLow_ and
+// <type>RatesHigh_<suffix>, the 16% and 84% replica quantiles per bin, and
+// <type>RateReplicas_<suffix> with every replica curve (one y bin each),
+// which match replica by replica between def and new runs on the same events.
+void writeBootstrap(TH1F* rateHist, const BootstrapRate& boot, const BootstrapRate& events, int type,
+		    const std::string& suffix)
+{
+  int nBins = boot.nBins();
+  int nReplicas = boot.nReplicas();
+  std::vector<double> norms(nReplicas);
+  for (int k=0; k<nReplicas; k++) {
+    Long64_t n = events.counts(0, k);
+    norms[k] = n > 0 ? rateNorm(n) : 0.;
+  }
+  std::vector<unsigned long long> passing = boot.passing();
+
+  std::string name(rateNames[type]);
+  TH1F* low = (TH1F*) rateHist->Clone((name + "RatesLow_" + suffix).c_str());
+  TH1F* high = (TH1F*) rateHist->Clone((name + "RatesHigh_" + suffix).c_str());
+  name += "RateReplicas_" + suffix;
+  TH2F* replicas = new TH2F(name.c_str(), ";Threshold E_{T} (GeV);replica;rate (Hz)",
+			    nBins, rateHist->GetXaxis()->GetXmin(), rateHist->GetXaxis()->GetXmax(),
+			    nReplicas, 0., nReplicas);
+
+  std::vector<double> rates(nReplicas);
+  for (int bin=0; bin<nBins; bin++) {
+    double sum = 0.;
+    double sum2 = 0.;
+    for (int k=0; k<nReplicas; k++) {
+      rates[k] = passing[bin*nReplicas + k]*norms[k];
+      sum += rates[k];
+      sum2 += rates[k]*rates[k];
+      replicas->SetBinContent(bin+1, k+1, rates[k]);
+    }
+    double mean = sum/nReplicas;
+    rateHist->SetBinError(bin+1, nReplicas > 1 ? std::sqrt(std::max(0., (sum2 - nReplicas*mean*mean)/(nReplicas-1))) : 0.);
+    std::sort(rates.begin(), rates.end());
+    low->SetBinContent(bin+1, rates[static_cast<int>(0.1587*(nReplicas-1) + 0.5)]);
+    high->SetBinContent(bin+1, rates[static_cast<int>(0.8413*(nReplicas-1) + 0.5)]);
+    low->SetBinError(bin+1, 0.);
+    high->SetBinError(bin+1, 0.);
+  }
+  low->Write();
+  high->Write();
+  replicas->Write();
+}
 
-    //do routine for L1 hardware quantities
-    if (hwOn){
+// normalise and write the TP and rate histograms of the merged accumulators
+void writeRates(TFile* kk, const RateAccumulators& acc, bool emuOn, bool hwOn)
+{
+  kk->cd();
+  double norm = rateNorm(acc.goodLumiEventCount);
+  std::string axR = ";Threshold E_{T} (GeV);rate (Hz)";
 
-      treeL1TPhw->GetEntry(jentry);
-      double tpEt(0.);
-      
-      for(int i=0; i < l1TPhw_->nHCALTP; i++){
-	tpEt = l1TPhw_->hcalTPet[i];
-	hcalTP_hw->Fill(tpEt);
-      }
-      for(int i=0; i < l1TPhw_->nECALTP; i++){
-	tpEt = l1TPhw_->ecalTPet[i];
-	ecalTP_hw->Fill(tpEt);
-      }
-
-
-      treeL1hw->GetEntry(jentry);
-      // get jetEt*, egEt*, tauEt, htSum, mhtSum, etSum, metSum
-      // ***INCLUDES NON_ZERO bx*** can't just read values off
-      double jetEt_1 = 0;
-      double jetEt_2 = 0;
-      double jetEt_3 = 0;
-      double jetEt_4 = 0;
-      for (UInt_t c=0; c<l1hw_->nJets; c++){
-        if (l1hw_->jetBx[c]==0 && l1hw_->jetEt[c] > jetEt_1){
-          jetEt_4 = jetEt_3;
-          jetEt_3 = jetEt_2;
-          jetEt_2 = jetEt_1;
-          jetEt_1 = l1hw_->jetEt[c];
-        }
-        else if (l1hw_->jetBx[c]==0 && l1hw_->jetEt[c] <= jetEt_1 && l1hw_->jetEt[c] > jetEt_2){
-          jetEt_4 = jetEt_3;
-          jetEt_3 = jetEt_2;      
-          jetEt_2 = l1hw_->jetEt[c];
-        }
-        else if (l1hw_->jetBx[c]==0 && l1hw_->jetEt[c] <= jetEt_2 && l1hw_->jetEt[c] > jetEt_3){
-          jetEt_4 = jetEt_3;     
-          jetEt_3 = l1hw_->jetEt[c];
-        }
-        else if (l1hw_->jetBx[c]==0 && l1hw_->jetEt[c] <= jetEt_3 && l1hw_->jetEt[c] > jetEt_4){   
-          jetEt_4 = l1hw_->jetEt[c];
-        }
-      }
-
-      double egEt_1 = 0;
-      double egEt_2 = 0;
-      for (UInt_t c=0; c<l1hw_->nEGs; c++){
-        if (l1hw_->egBx[c]==0 && l1hw_->egEt[c] > egEt_1){
-          egEt_2 = egEt_1;
-          egEt_1 = l1hw_->egEt[c];
-        }
-        else if (l1hw_->egBx[c]==0 && l1hw_->egEt[c] <= egEt_1 && l1hw_->egEt[c] > egEt_2){
-          egEt_2 = l1hw_->egEt[c];
-        }
-      }
-
-      double tauEt_1 = 0;
-      double tauEt_2 = 0;
-      //tau pt's are not given in descending order
-      for (UInt_t c=0; c<l1hw_->nTaus; c++){
-        if (l1hw_->tauBx[c]==0 && l1hw_->tauEt[c] > tauEt_1){
-          tauEt_1 = l1hw_->tauEt[c];
-        }
-        else if (l1hw_->tauBx[c]==0 && l1hw_->tauEt[c] <= tauEt_1 && l1hw_->tauEt[c] > tauEt_2){
-          tauEt_2 = l1hw_->tauEt[c];
-        }
-      }
-
-      double egISOEt_1 = 0;
-      double egISOEt_2 = 0;
-      //EG pt's are not given in descending order...bx?
-      for (UInt_t c=0; c<l1hw_->nEGs; c++){
-        if (l1hw_->egBx[c]==0 && l1hw_->egEt[c] > egISOEt_1 && l1hw_->egIso[c]==1){
-          egISOEt_2 = egISOEt_1;
-          egISOEt_1 = l1hw_->egEt[c];
-        }
-        else if (l1hw_->egBx[c]==0 && l1hw_->egEt[c] <= egISOEt_1 && l1hw_->egEt[c] > egISOEt_2 && l1hw_->egIso[c]==1){
-          egISOEt_2 = l1hw_->egEt[c];
-        }
-      }
-
-      double tauISOEt_1 = 0;
-      double tauISOEt_2 = 0;
-      //tau pt's are not given in descending order
-      for (UInt_t c=0; c<l1hw_->nTaus; c++){
-        if (l1hw_->tauBx[c]==0 && l1hw_->tauEt[c] > tauISOEt_1 && l1hw_->tauIso[c]>0){
-          tauISOEt_2 = tauISOEt_1;
-          tauISOEt_1 = l1hw_->tauEt[c];
-        }
-        else if (l1hw_->tauBx[c]==0 && l1hw_->tauEt[c] <= tauISOEt_1 && l1hw_->tauEt[c] > tauISOEt_2 && l1hw_->tauIso[c]>0){
-          tauISOEt_2 = l1hw_->tauEt[c];
-        }
-      }
-
-      double htSum = 0;
-      double mhtSum = 0;
-      double etSum = 0;
-      double metSum = 0;
-      double metHFSum = 0;
-      // HW includes -2,-1,0,1,2 bx info (hence the different numbers, could cause a seg fault if this changes)
-      for (unsigned int c=0; c<l1hw_->nSums; c++){
-          if( l1hw_->sumBx[c] != 0 ) continue;
-          if( l1hw_->sumType[c] == L1Analysis::kTotalEt ) etSum = l1hw_->sumEt[c];
-          if( l1hw_->sumType[c] == L1Analysis::kTotalHt ) htSum = l1hw_->sumEt[c];
-          if( l1hw_->sumType[c] == L1Analysis::kMissingEt ) metSum = l1hw_->sumEt[c];
-	  if( l1hw_->sumType[c] == L1Analysis::kMissingEtHF ) metHFSum = l1hw_->sumEt[c];
-          if( l1hw_->sumType[c] == L1Analysis::kMissingHt ) mhtSum = l1hw_->sumEt[c];
-      }
-
-      // for each bin fill according to whether our object has a larger corresponding energy
-      for(int bin=0; bin<nJetBins; bin++){
-        if( (jetEt_1) >= jetLo + (bin*jetBinWidth) ) singleJetRates_hw->Fill(jetLo+(bin*jetBinWidth));  //GeV
-      } 
-
-      for(int bin=0; bin<nJetBins; bin++){
-        if( (jetEt_2) >= jetLo + (bin*jetBinWidth) ) doubleJetRates_hw->Fill(jetLo+(bin*jetBinWidth));  //GeV
-      }  
-
-      for(int bin=0; bin<nJetBins; bin++){
-        if( (jetEt_3) >= jetLo + (bin*jetBinWidth) ) tripleJetRates_hw->Fill(jetLo+(bin*jetBinWidth));  //GeV
-      }  
-
-      for(int bin=0; bin<nJetBins; bin++){
-        if( (jetEt_4) >= jetLo + (bin*jetBinWidth) ) quadJetRates_hw->Fill(jetLo+(bin*jetBinWidth));  //GeV
-      }  
-             
-      for(int bin=0; bin<nEgBins; bin++){
-        if( (egEt_1) >= egLo + (bin*egBinWidth) ) singleEgRates_hw->Fill(egLo+(bin*egBinWidth));  //GeV
-      } 
-
-      for(int bin=0; bin<nEgBins; bin++){
-        if( (egEt_2) >= egLo + (bin*egBinWidth) ) doubleEgRates_hw->Fill(egLo+(bin*egBinWidth));  //GeV
-      }  
-
-      for(int bin=0; bin<nTauBins; bin++){
-        if( (tauEt_1) >= tauLo + (bin*tauBinWidth) ) singleTauRates_hw->Fill(tauLo+(bin*tauBinWidth));  //GeV
-      } 
-
-      for(int bin=0; bin<nTauBins; bin++){
-        if( (tauEt_2) >= tauLo + (bin*tauBinWidth) ) doubleTauRates_hw->Fill(tauLo+(bin*tauBinWidth));  //GeV
-      } 
-
-      for(int bin=0; bin<nEgBins; bin++){
-        if( (egISOEt_1) >= egLo + (bin*egBinWidth) ) singleISOEgRates_hw->Fill(egLo+(bin*egBinWidth));  //GeV
-      } 
-
-      for(int bin=0; bin<nEgBins; bin++){
-        if( (egISOEt_2) >= egLo + (bin*egBinWidth) ) doubleISOEgRates_hw->Fill(egLo+(bin*egBinWidth));  //GeV
-      }  
-
-      for(int bin=0; bin<nTauBins; bin++){
-        if( (tauISOEt_1) >= tauLo + (bin*tauBinWidth) ) singleISOTauRates_hw->Fill(tauLo+(bin*tauBinWidth));  //GeV
-      }
-
-      for(int bin=0; bin<nTauBins; bin++){
-        if( (tauISOEt_2) >= tauLo + (bin*tauBinWidth) ) doubleISOTauRates_hw->Fill(tauLo+(bin*tauBinWidth));  //GeV
-      } 
-
-      for(int bin=0; bin<nHtSumBins; bin++){
-        if( (htSum) >= htSumLo+(bin*htSumBinWidth) ) htSumRates_hw->Fill(htSumLo+(bin*htSumBinWidth)); //GeV
-      }
-
-      for(int bin=0; bin<nMhtSumBins; bin++){
-        if( (mhtSum) >= mhtSumLo+(bin*mhtSumBinWidth) ) mhtSumRates_hw->Fill(mhtSumLo+(bin*mhtSumBinWidth)); //GeV           
-      }
-
-      for(int bin=0; bin<nEtSumBins; bin++){
-        if( (etSum) >= etSumLo+(bin*etSumBinWidth) ) etSumRates_hw->Fill(etSumLo+(bin*etSumBinWidth)); //GeV           
-      }
-
-      for(int bin=0; bin<nMetSumBins; bin++){
-        if( (metSum) >= metSumLo+(bin*metSumBinWidth) ) metSumRates_hw->Fill(metSumLo+(bin*metSumBinWidth)); //GeV           
-      } 
-      for(int bin=0; bin<nMetHFSumBins; bin++){
-        if( (metHFSum) >= metHFSumLo+(bin*metHFSumBinWidth) ) metHFSumRates_hw->Fill(metHFSumLo+(bin*metHFSumBinWidth)); //GeV           
-      } 
+  if (emuOn){
+    writeTPHist(acc.hcalTP_emu, "hcalTP_emu");
+    writeTPHist(acc.ecalTP_emu, "ecalTP_emu");
+    for (int r=0; r<kNRateTypes; r++) {
+      TH1F* rateHist = bookRateHist(acc.rates_emu[r], r, "Rates_emu", axR);
+      acc.rates_emu[r].fillHist(rateHist);
+      rateHist->Scale(norm);
+      // with -b the errors of the rates come from the bootstrap replicas
+      if (!acc.boot_emu.empty()) writeBootstrap(rateHist, acc.boot_emu[r], acc.bootEvents, r, "emu");
+      rateHist->Write();
+    }
+    if (!acc.exact_emu.empty()) writeExactRates(acc.exact_emu, "emu", norm);
+  }
 
-    }// closes if 'hwOn' is true
+  if (hwOn){
+    writeTPHist(acc.hcalTP_hw, "hcalTP_hw");
+    writeTPHist(acc.ecalTP_hw, "ecalTP_hw");
+    for (int r=0; r<kNRateTypes; r++) {
+      TH1F* rateHist = bookRateHist(acc.rates_hw[r], r, "Rates_hw", axR);
+      acc.rates_hw[r].fillHist(rateHist);
+      rateHist->Scale(norm);
+      if (!acc.boot_hw.empty()) writeBootstrap(rateHist, acc.boot_hw[r], acc.bootEvents, r, "hw");
+      rateHist->Write();
+    }
+    if (!acc.exact_hw.empty()) writeExactRates(acc.exact_hw, "hw", norm);
+  }
+}
 
-  }// closes loop through events
+// Per-LS counts as two trees: lumiSections holds the events of every LS,
+// lumiRates_<suffix> one entry per LS and rate type with the differential
+// counts of the threshold bins that occurred. The rate above threshold bin b
+// in an LS is rateNorm(nEvents) times the sum of its counts with bin >= b;
+// the thresholds are the low edges of the <type>Rates_<suffix> histograms.
+void writeLumiRates(TFile* kk, const LumiRates& lumiRates, const std::string& suffix, bool writeEvents)
+{
+  kk->cd();
+  UInt_t run, lumi;
+  Long64_t nEvents;
+  Int_t type;
+  std::vector<Short_t> bin;
+  std::vector<UInt_t> count;
+
+  TTree* lumiTree = 0;
+  if (writeEvents) {
+    lumiTree = new TTree("lumiSections", "good events per lumi section");
+    lumiTree->Branch("run", &run, "run/i");
+    lumiTree->Branch("lumi", &lumi, "lumi/i");
+    lumiTree->Branch("nEvents", &nEvents, "nEvents/L");
+  }
+  std::string name = "lumiRates_" + suffix;
+  TTree* rateTree = new TTree(name.c_str(), "differential threshold counts per lumi section");
+  rateTree->Branch("run", &run, "run/i");
+  rateTree->Branch("lumi", &lumi, "lumi/i");
+  rateTree->Branch("type", &type, "type/I");
+  rateTree->Branch("bin", &bin);
+  rateTree->Branch("count", &count);
+
+  for (uint64_t key : lumiRates.lumiKeys()) {
+    run = LumiRates::run(key);
+    lumi = LumiRates::lumi(key);
+    nEvents = lumiRates.nEvents(key);
+    if (lumiTree) lumiTree->Fill();
+    for (type=0; type<kNRateTypes; type++) {
+      bin.clear();
+      count.clear();
+      for (const auto& binCount : lumiRates.counts(key, type)) {
+	bin.push_back(binCount.first);
+	count.push_back(binCount.second);
+      }
+      if (!bin.empty()) rateTree->Fill();
+    }
+  }
+  if (lumiTree) lumiTree->Write();
+  rateTree->Write();
+}
 
-  //  TFile g( outputFilename.c_str() , "new");
+// average pileup at a luminosity (10^34), for the minimum bias cross
+// section of 80 mb brilcalc also uses for avgpu
+double pileupAtLumi(double lumi)
+{
+  return lumi*1e34 * 80e-27 / (11246*numBunch);
+}
+
+// Rates in bins of pileup: pileupEvents (if writeEvents) has the good
+// events per pileup bin, <type>RatesVsPileup_<suffix> the rate above every
+// threshold (x) in every pileup bin (y). The fraction of events passing
+// each threshold is fitted as a + b*pileup; <type>RateFitOffset_ and
+// <type>RateFitSlope_<suffix> hold a and b as rates (Hz, Hz per pileup)
+// for numBunch bunches, so the rate at a pileup is offset + slope*pileup,
+// and <type>RatesExpected_<suffix> is that at the pileup of expectedLum.
+// With -p nvtx the pileup axis is the number of vertices.
+void writePileupRates(TFile* kk, const PileupRates& pileupRates, const std::vector<CumulativeRate>& curves,
+		      const std::string& suffix, bool writeEvents)
+{
   kk->cd();
-  // normalisation factor for rate histograms (11kHz is the orbit frequency)
-  double norm = 11246*(numBunch/goodLumiEventCount); // no lumi rescale
-  //  double norm = 11246*(numBunch/goodLumiEventCount)*(expectedLum/runLum); //scale to nominal lumi
+  int nBins = pileupRates.nBins();
+  if (writeEvents) {
+    TH1D* events = new TH1D("pileupEvents", ";pileup;events", nBins, pileupRates.lo(), pileupRates.hi());
+    for (int bin=0; bin<nBins; bin++) events->SetBinContent(bin+1, pileupRates.nEvents(bin));
+    events->Write();
+  }
 
-  if (emuOn){
-    singleJetRates_emu->Scale(norm);
-    doubleJetRates_emu->Scale(norm);
-    tripleJetRates_emu->Scale(norm);
-    quadJetRates_emu->Scale(norm);
-    singleEgRates_emu->Scale(norm);
-    doubleEgRates_emu->Scale(norm);
-    singleTauRates_emu->Scale(norm);
-    doubleTauRates_emu->Scale(norm);
-    singleISOEgRates_emu->Scale(norm);
-    doubleISOEgRates_emu->Scale(norm);
-    singleISOTauRates_emu->Scale(norm);
-    doubleISOTauRates_emu->Scale(norm);
-    htSumRates_emu->Scale(norm);
-    mhtSumRates_emu->Scale(norm);
-    etSumRates_emu->Scale(norm);
-    metSumRates_emu->Scale(norm);
-    metHFSumRates_emu->Scale(norm);
-
-    //set the errors for the rates
-    //want error -> error * sqrt(norm) ?
-
-    hcalTP_emu->Write();
-    ecalTP_emu->Write();
-    singleJetRates_emu->Write();
-    doubleJetRates_emu->Write();
-    tripleJetRates_emu->Write();
-    quadJetRates_emu->Write();
-    singleEgRates_emu->Write();
-    doubleEgRates_emu->Write();
-    singleTauRates_emu->Write();
-    doubleTauRates_emu->Write();
-    singleISOEgRates_emu->Write();
-    doubleISOEgRates_emu->Write();
-    singleISOTauRates_emu->Write();
-    doubleISOTauRates_emu->Write();
-    htSumRates_emu->Write();
-    mhtSumRates_emu->Write();
-    etSumRates_emu->Write();
-    metSumRates_emu->Write();
-    metHFSumRates_emu->Write();
+  double bunchRate = rateNorm(1);
+  double pileup = pileupAtLumi(expectedLum);
+  std::string axR = ";Threshold E_{T} (GeV);rate (Hz)";
+  for (int r=0; r<kNRateTypes; r++) {
+    const CumulativeRate& curve = curves[r];
+    std::string name = std::string(rateNames[r]) + "RatesVsPileup_" + suffix;
+    TH2F* vsPileup = new TH2F(name.c_str(), ";Threshold E_{T} (GeV);pileup;rate (Hz)",
+			      curve.nBins(), curve.lo(), curve.hi(), nBins, pileupRates.lo(), pileupRates.hi());
+    for (int bin=0; bin<nBins; bin++) {
+      if (pileupRates.nEvents(bin) == 0) continue;
+      double norm = rateNorm(pileupRates.nEvents(bin));
+      std::vector<unsigned long long> passing = pileupRates.passing(bin, r);
+      for (int t=0; t<curve.nBins(); t++) {
+	vsPileup->SetBinContent(t+1, bin+1, passing[t]*norm);
+	vsPileup->SetBinError(t+1, bin+1, std::sqrt(double(passing[t]))*norm);
+      }
+    }
+    vsPileup->Write();
+
+    std::vector<double> offset, slope;
+    pileupRates.fit(r, offset, slope);
+    TH1F* offsetHist = bookRateHist(curve, r, "RateFitOffset_" + suffix, axR);
+    TH1F* slopeHist = bookRateHist(curve, r, "RateFitSlope_" + suffix, ";Threshold E_{T} (GeV);rate per pileup (Hz)");
+    TH1F* expected = bookRateHist(curve, r, "RatesExpected_" + suffix, axR);
+    for (int t=0; t<curve.nBins(); t++) {
+      offsetHist->SetBinContent(t+1, offset[t]*bunchRate);
+      slopeHist->SetBinContent(t+1, slope[t]*bunchRate);
+      expected->SetBinContent(t+1, std::max(0., offset[t] + slope[t]*pileup)*bunchRate);
+    }
+    offsetHist->Write();
+    slopeHist->Write();
+    expected->Write();
   }
+}
 
-  if (hwOn){
+// Rates of the menu seeds after prescales: menuRates_<suffix> has one bin
+// per seed and the whole menu in the last, menuPureRates_<suffix> the rate
+// of events passing only that seed, and menuOverlapRates_<suffix> the rate
+// of events passing both seeds (the seed rates on the diagonal).
+void writeMenuRates(TFile* kk, const MenuRates& menuRates, const std::string& suffix, double norm)
+{
+  kk->cd();
+  int nSeeds = seedMenu->nSeeds();
+  std::string name = "menuRates_" + suffix;
+  TH1F* rates = new TH1F(name.c_str(), ";seed;rate (Hz)", nSeeds+1, 0., nSeeds+1);
+  name = "menuPureRates_" + suffix;
+  TH1F* pure = new TH1F(name.c_str(), ";seed;pure rate (Hz)", nSeeds, 0., nSeeds);
+  name = "menuOverlapRates_" + suffix;
+  TH2F* overlap = new TH2F(name.c_str(), ";seed;seed;rate (Hz)", nSeeds, 0., nSeeds, nSeeds, 0., nSeeds);
+
+  for (int s=0; s<nSeeds; s++) {
+    const char* label = seedMenu->name(s).c_str();
+    rates->GetXaxis()->SetBinLabel(s+1, label);
+    rates->SetBinContent(s+1, menuRates.fired(s)*norm);
+    rates->SetBinError(s+1, std::sqrt(double(menuRates.fired(s)))*norm);
+    pure->GetXaxis()->SetBinLabel(s+1, label);
+    pure->SetBinContent(s+1, menuRates.pure(s)*norm);
+    pure->SetBinError(s+1, std::sqrt(double(menuRates.pure(s)))*norm);
+    overlap->GetXaxis()->SetBinLabel(s+1, label);
+    overlap->GetYaxis()->SetBinLabel(s+1, label);
+    for (int t=0; t<nSeeds; t++) overlap->SetBinContent(s+1, t+1, menuRates.overlap(s, t)*norm);
+  }
+  rates->GetXaxis()->SetBinLabel(nSeeds+1, "total");
+  rates->SetBinContent(nSeeds+1, menuRates.total()*norm);
+  rates->SetBinError(nSeeds+1, std::sqrt(double(menuRates.total()))*norm);
 
-    singleJetRates_hw->Scale(norm);
-    doubleJetRates_hw->Scale(norm);
-    tripleJetRates_hw->Scale(norm);
-    quadJetRates_hw->Scale(norm);
-    singleEgRates_hw->Scale(norm);
-    doubleEgRates_hw->Scale(norm);
-    singleTauRates_hw->Scale(norm);
-    doubleTauRates_hw->Scale(norm);
-    singleISOEgRates_hw->Scale(norm);
-    doubleISOEgRates_hw->Scale(norm);
-    singleISOTauRates_hw->Scale(norm);
-    doubleISOTauRates_hw->Scale(norm);
-    htSumRates_hw->Scale(norm);
-    mhtSumRates_hw->Scale(norm);
-    etSumRates_hw->Scale(norm);
-    metSumRates_hw->Scale(norm);
-    metHFSumRates_hw->Scale(norm);
-
-    hcalTP_hw->Write();
-    ecalTP_hw->Write();
-    singleJetRates_hw->Write();
-    doubleJetRates_hw->Write();
-    tripleJetRates_hw->Write();
-    quadJetRates_hw->Write();
-    singleEgRates_hw->Write();
-    doubleEgRates_hw->Write();
-    singleTauRates_hw->Write();
-    doubleTauRates_hw->Write();
-    singleISOEgRates_hw->Write();
-    doubleISOEgRates_hw->Write();
-    singleISOTauRates_hw->Write();
-    doubleISOTauRates_hw->Write();
-    htSumRates_hw->Write();
-    mhtSumRates_hw->Write();
-    etSumRates_hw->Write();
-    metSumRates_hw->Write();
-    metHFSumRates_hw->Write();
+  rates->Write();
+  pure->Write();
+  overlap->Write();
+}
+
+void writeMenuTable(std::ofstream& myfile, const MenuRates& menuRates, const std::string& suffix, double norm)
+{
+  myfile << "menu rates (" << suffix << "): seed, prescale, rate (Hz), pure rate (Hz)" << std::endl;
+  for (size_t s=0; s<seedMenu->nSeeds(); s++) {
+    myfile << "  " << seedMenu->name(s) << " " << seedMenu->prescale(s) << " "
+	   << menuRates.fired(s)*norm << " " << menuRates.pure(s)*norm << std::endl;
+  }
+  myfile << "  total " << menuRates.total()*norm << std::endl;
+}
+
+// for every target rate given with -t, the lowest threshold of each
+// quantity whose exact rate does not exceed it
+void writeThresholdTable(std::ofstream& myfile, const std::vector<ExactRate>& exact, const std::string& suffix, double norm)
+{
+  if (targetRates.empty()) return;
+  std::vector<ExactRateCurve> curves;
+  for (int r=0; r<kNRateTypes; r++) curves.push_back(exact[r].curve());
+  for (double target : targetRates) {
+    long long maxPassing = std::floor(target/norm + 1e-9);
+    myfile << "thresholds for a rate <= " << target << " Hz (" << suffix << "): type, threshold (GeV), rate (Hz)" << std::endl;
+    for (int r=0; r<kNRateTypes; r++) {
+      double threshold = curves[r].threshold(maxPassing);
+      myfile << "  " << rateNames[r] << " ";
+      if (std::isnan(threshold)) myfile << "any" << std::endl;
+      else myfile << threshold << " " << curves[r].passing(threshold)*norm << std::endl;
+    }
   }
+}
+
+void writeExtraInfo(std::ofstream& myfile, const std::string& inputFile, Long64_t goodLumiEventCount)
+{
   myfile << "using the following ntuple: " << inputFile << std::endl;
   myfile << "number of colliding bunches = " << numBunch << std::endl;
   myfile << "run luminosity = " << runLum << std::endl;
   myfile << "expected luminosity = " << expectedLum << std::endl;
-  myfile << "norm factor used = " << norm << std::endl;
+  myfile << "norm factor used = " << rateNorm(goodLumiEventCount) << std::endl;
   myfile << "number of good events = " << goodLumiEventCount << std::endl;
-  myfile.close(); 
+}
+
+// run number of the first event, for the record in extraInfo.txt
+unsigned firstRunNumber(const std::string& inputFile)
+{
+  TChain eventTree("l1EventTree/L1EventTree");
+  eventTree.Add(inputFile.c_str());
+  L1Analysis::L1AnalysisEventDataFormat* event_ = new L1Analysis::L1AnalysisEventDataFormat();
+  eventTree.SetBranchAddress("Event", &event_);
+  eventTree.SetBranchStatus("*", 0);
+  eventTree.SetBranchStatus("run", 1);
+  eventTree.GetEntry(0);
+  unsigned run = event_->run;
+  delete event_;
+  return run;
+}
+
+// the counts of a job run with -w, as in a cache entry, and the run number,
+// to be added up by mergeRates()
+void writePartial(const std::string& fileName, const RateAccumulators& acc, unsigned runNumber)
+{
+  TFile* file = TFile::Open(fileName.c_str(), "recreate");
+  acc.writeCache(file);
+  TParameter<Long64_t> run("runNumber", runNumber);
+  run.Write();
+  file->Close();
+  delete file;
+}
+
+// run the event loop over inputFile (a file or a pattern) on nThreads
+// threads and return the merged accumulators; with a skimWriter, the
+// good events also go into the skim
+RateAccumulators* processInput(const std::string& inputFile, const std::vector<CumulativeRate>& curves,
+			       int nThreads, bool emuOn, bool hwOn, bool perLumi, SkimWriter* skimWriter)
+{
+  // make trees, one set of readers per thread
+  StageClock openClock;
+  NtupleIndex index(rateTreeNames(emuOn, hwOn, binByPileUp && !pileupTable));
+  index.build(inputFile, ntupleIndexPath);
+  std::vector<RateReader*> readers;
+  for (int t=0; t<nThreads; t++) readers.push_back(new RateReader(index, seedMenu != 0));
+
+  // get number of entries
+  Long64_t nentries = index.entries();
+  // or the range given with -r
+  Long64_t last = lastEntry >= 0 && lastEntry < nentries ? lastEntry : nentries;
+  Long64_t first = std::min(firstEntry, last);
+  double openSeconds = openClock.lap();
+
+  // per-thread accumulators
+  std::vector<RateAccumulators*> accs;
+  for (int t=0; t<nThreads; t++) accs.push_back(new RateAccumulators(curves, perLumi, seedMenu));
+  accs[0]->times.add(accs[0]->times.stage("index files"), openSeconds);
+  std::vector<SkimFiller*> skims(nThreads, 0);
+  if (skimWriter) {
+    for (int t=0; t<nThreads; t++) skims[t] = new SkimFiller(skimWriter, emuOn, hwOn);
+  }
+
+  /////////////////////////////////
+  // loop through all the entries//
+  /////////////////////////////////
+  EventProgress progress(last-first);
+  runChunks(readers[0]->ntuples, emuOn ? readers[0]->treeL1emu : readers[0]->treeL1hw, first, last, nThreads, [&](int t, Long64_t chunkFirst, Long64_t chunkLast) {
+      processEntries(*readers[t], *accs[t], skims[t], chunkFirst, chunkLast, emuOn, hwOn, progress);
+    });
+  accs[0]->entryCount = progress.nDone();
+  accs[0]->loopSeconds = progress.seconds();
+
+  if (skimWriter) {
+    for (int t=1; t<nThreads; t++) {
+      skims[0]->hcalTP_emu.add(skims[t]->hcalTP_emu);
+      skims[0]->ecalTP_emu.add(skims[t]->ecalTP_emu);
+      skims[0]->hcalTP_hw.add(skims[t]->hcalTP_hw);
+      skims[0]->ecalTP_hw.add(skims[t]->ecalTP_hw);
+    }
+    if (emuOn) {
+      skimWriter->addSpectrum("hcalTP_emu", skims[0]->hcalTP_emu);
+      skimWriter->addSpectrum("ecalTP_emu", skims[0]->ecalTP_emu);
+    }
+    if (hwOn) {
+      skimWriter->addSpectrum("hcalTP_hw", skims[0]->hcalTP_hw);
+      skimWriter->addSpectrum("ecalTP_hw", skims[0]->ecalTP_hw);
+    }
+    for (int t=0; t<nThreads; t++) {
+      skimWriter->append(skims[t]->rows);
+      delete skims[t];
+    }
+  }
+
+  // merge in thread order; everything is an integer count, so the result
+  // does not depend on which thread processed which chunk
+  for (int t=0; t<nThreads; t++) {
+    accs[t]->menu_emu.flush();
+    accs[t]->menu_hw.flush();
+  }
+  for (int t=1; t<nThreads; t++) {
+    accs[0]->add(*accs[t]);
+    delete accs[t];
+  }
+  for (int t=0; t<nThreads; t++) delete readers[t];
+  return accs[0];
+}
+
+// everything besides the input file the cached partial results depend on;
+// bump the version whenever the selection or the stored counts change
+std::string cacheConfig(const std::vector<CumulativeRate>& curves, bool emuOn, bool hwOn)
+{
+  std::ostringstream config;
+  config << "rates v1 emu=" << emuOn << " hw=" << hwOn;
+  for (const CumulativeRate& curve : curves) config << ' ' << curve.nBins() << ':' << curve.lo() << ':' << curve.hi();
+  BatchHistogram tp = bookTPCounts();
+  config << " tp=" << tp.nBins() << ':' << tp.lo() << ':' << tp.hi();
+  config << " mask=" << (goodLumiMask ? goodLumiMask->checksum() : 0);
+  return config.str();
+}
+
+// same as processInput, but file by file: files with an entry in the cache
+// are not read again, the others are processed and stored in it
+RateAccumulators* processCachedInput(const std::string& inputFile, const std::vector<CumulativeRate>& curves,
+				     int nThreads, bool emuOn, bool hwOn, const std::string& cacheDirectory)
+{
+  ResultCache cache(cacheDirectory, cacheConfig(curves, emuOn, hwOn));
+  RateAccumulators* total = new RateAccumulators(curves);
+  std::vector<std::string> files = expandInputFiles(inputFile);
+  unsigned nCached = 0;
+  for (const std::string& file : files) {
+    TFile* entry = cache.open(file);
+    if (entry) {
+      RateAccumulators cached(curves);
+      bool complete = cached.addCache(entry);
+      entry->Close();
+      delete entry;
+      if (complete) {
+	total->add(cached);
+	nCached++;
+	continue;
+      }
+    }
+
+    std::cout << "Processing " << file << std::endl;
+    RateAccumulators* acc = processInput(file, curves, nThreads, emuOn, hwOn, false, 0);
+    entry = cache.create(file);
+    if (entry) {
+      acc->writeCache(entry);
+      cache.commit(entry, file);
+    }
+    else std::cout << "Cannot write cache entry for " << file << std::endl;
+    total->add(*acc);
+    delete acc;
+  }
+  std::cout << "Used cached results for " << nCached << " of " << files.size() << " files" << std::endl;
+  return total;
+}
+
+// fill the accumulators from a skim instead of the ntuples; the good
+// lumi selection is applied again, so -l can narrow it down further
+RateAccumulators* processSkim(const SkimReader& skim, const std::vector<CumulativeRate>& curves,
+			      bool emuOn, bool hwOn, bool perLumi)
+{
+  RateAccumulators* acc = new RateAccumulators(curves, perLumi);
+  int runColumn = skim.column("run");
+  int lumiColumn = skim.column("lumi");
+  int eventColumn = skim.column("event");
+  BootstrapWeights weights(nReplicas);
+  std::vector<int> emuColumns, hwColumns;
+  for (int r=0; r<kNRateTypes; r++) {
+    emuColumns.push_back(skim.column(std::string("emu_") + rateNames[r]));
+    hwColumns.push_back(skim.column(std::string("hw_") + rateNames[r]));
+  }
+
+  std::vector<uint64_t> run, lumi, event;
+  std::vector<std::vector<double> > et_emu(kNRateTypes), et_hw(kNRateTypes);
+  StageClock loopClock;
+  StageTimer timer(acc->times);
+  int decodeStage = acc->times.stage("decode skim");
+  int fillStage = acc->times.stage("fill");
+  for (size_t b=0; b<skim.nBlocks(); b++) {
+    timer.start(decodeStage);
+    skim.integers(b, runColumn, run);
+    skim.integers(b, lumiColumn, lumi);
+    if (nReplicas > 0) skim.integers(b, eventColumn, event);
+    for (int r=0; r<kNRateTypes; r++) {
+      if (emuOn) skim.values(b, emuColumns[r], et_emu[r]);
+      if (hwOn) skim.values(b, hwColumns[r], et_hw[r]);
+    }
+
+    timer.start(fillStage);
+    acc->entryCount += skim.blockRows(b);
+    for (size_t i=0; i<skim.blockRows(b); i++) {
+      if (!isGoodLumiSection(run[i], lumi[i])) continue;
+      acc->goodLumiEventCount++;
+      if (nReplicas > 0) {
+	weights.generate(EventIndex::key(run[i], lumi[i], event[i]));
+	acc->bootEvents.fill(0, weights.data());
+      }
+      if (binByPileUp) {
+	int bin = acc->pileup_emu.pileupBin(pileupTable->pileup(run[i], lumi[i]));
+	acc->pileup_emu.addEvent(bin);
+	acc->pileup_hw.addEvent(bin);
+      }
+      if (perLumi) {
+	acc->lumiRates_emu.addEvent(run[i], lumi[i]);
+	acc->lumiRates_hw.addEvent(run[i], lumi[i]);
+      }
+      for (int r=0; r<kNRateTypes; r++) {
+	if (emuOn) {
+	  acc->rates_emu[r].fill(et_emu[r][i]);
+	  if (exactRates) acc->exact_emu[r].fill(et_emu[r][i]);
+	  if (nReplicas > 0) acc->boot_emu[r].fill(acc->rates_emu[r].thresholdBin(et_emu[r][i]), weights.data());
+	  if (binByPileUp) acc->pileup_emu.fill(r, acc->rates_emu[r].thresholdBin(et_emu[r][i]));
+	  if (perLumi) acc->lumiRates_emu.fill(r, acc->rates_emu[r].thresholdBin(et_emu[r][i]));
+	}
+	if (hwOn) {
+	  acc->rates_hw[r].fill(et_hw[r][i]);
+	  if (exactRates) acc->exact_hw[r].fill(et_hw[r][i]);
+	  if (nReplicas > 0) acc->boot_hw[r].fill(acc->rates_hw[r].thresholdBin(et_hw[r][i]), weights.data());
+	  if (binByPileUp) acc->pileup_hw.fill(r, acc->rates_hw[r].thresholdBin(et_hw[r][i]));
+	  if (perLumi) acc->lumiRates_hw.fill(r, acc->rates_hw[r].thresholdBin(et_hw[r][i]));
+	}
+      }
+    }
+  }
+
+  timer.stop();
+  acc->loopSeconds = loopClock.lap();
+
+  // the TP spectra are stored for all events, as there is no way to split them
+  if (emuOn) {
+    skim.addSpectrum("hcalTP_emu", acc->hcalTP_emu);
+    skim.addSpectrum("ecalTP_emu", acc->ecalTP_emu);
+  }
+  if (hwOn) {
+    skim.addSpectrum("hcalTP_hw", acc->hcalTP_hw);
+    skim.addSpectrum("ecalTP_hw", acc->ecalTP_hw);
+  }
+  return acc;
+}
+
+void rates(bool newConditions, const std::string& inputFileDirectory, int nThreads, bool perLumi,
+	   const std::string& cacheDirectory, const std::string& skimFile){
+
+  StageClock jobClock;
+  bool hwOn = true;   //are we using data from hardware? (upgrade trigger had to be running!!!)
+  bool emuOn = true;  //are we using data from emulator?
+
+  if (hwOn==false && emuOn==false){
+    std::cout << "exiting as neither hardware or emulator selected" << std::endl;
+    return;
+  }
+
+  // the input is either a directory of ntuples or a skim written with -s
+  SkimReader* skimInput = 0;
+  if (SkimReader::isSkim(inputFileDirectory)) {
+    skimInput = new SkimReader(inputFileDirectory);
+    if (!skimInput->good()) {
+      std::cout << "Cannot read skim " << inputFileDirectory << std::endl;
+      return;
+    }
+    emuOn = emuOn && skimInput->column("emu_singleJet") >= 0;
+    hwOn = hwOn && skimInput->column("hw_singleJet") >= 0;
+  }
+
+  std::string inputFile(skimInput ? inputFileDirectory : ntupleFiles(inputFileDirectory));
+  std::string outputDirectory = "emu";  //***runNumber, triggerType, version, hw/emu/both***MAKE SURE IT EXISTS
+  std::string outputFilename = "rates_def.root";
+  if(newConditions) outputFilename = "rates_new_cond.root";
+  // with -w, only the counts are written, into partialOutput
+  if (!partialOutput.empty()) outputFilename = partialOutput;
+  TFile* kk = partialOutput.empty() ? TFile::Open( outputFilename.c_str() , "recreate") : 0;
+  // if (kk!=0){
+  //   cout << "TERMINATE: not going to overwrite file " << outputFilename << endl;
+  //   return;
+  // }
+
+  std::string outputTxtFilename = "output_rates/" + outputDirectory + "/extraInfo.txt";
+  std::ofstream myfile; // save info about the run, including rates for a given lumi section, and number of events we used.
+  myfile.open(outputTxtFilename.c_str());
+  std::vector<CumulativeRate> curves = bookRateCurves();
+  RateAccumulators* acc;
+  unsigned runNumber = 0;
+  if (skimInput) {
+    std::vector<uint64_t> run;
+    if (skimInput->nBlocks() > 0) skimInput->integers(0, skimInput->column("run"), run);
+    runNumber = run.empty() ? 0 : run[0];
+    myfile << "run number = " << runNumber << std::endl;
+    acc = processSkim(*skimInput, curves, emuOn, hwOn, perLumi);
+    delete skimInput;
+  }
+  else {
+    runNumber = firstRunNumber(inputFile);
+    myfile << "run number = " << runNumber << std::endl;
+    std::cout << "Loading up the ntuples..." << std::endl;
+    if (nThreads > 1) ROOT::EnableThreadSafety();
+    SkimWriter* skimWriter = 0;
+    if (!skimFile.empty()) {
+      skimWriter = new SkimWriter(skimFile, rateSkimColumns(emuOn, hwOn));
+      if (!skimWriter->good()) {
+	std::cout << "Cannot write skim " << skimFile << std::endl;
+	return;
+      }
+    }
+    if (cacheDirectory.empty()) acc = processInput(inputFile, curves, nThreads, emuOn, hwOn, perLumi, skimWriter);
+    else acc = processCachedInput(inputFile, curves, nThreads, emuOn, hwOn, cacheDirectory);
+    if (skimWriter) {
+      skimWriter->close();
+      std::cout << "Wrote " << skimWriter->nEvents() << " events to " << skimFile;
+      if (skimWriter->nRounded() > 0) std::cout << " (" << skimWriter->nRounded() << " values rounded to 0.5 GeV)";
+      std::cout << std::endl;
+      delete skimWriter;
+    }
+  }
+
+
+  //  TFile g( outputFilename.c_str() , "new");
+  StageClock writeClock;
+  if (kk) {
+    writeRates(kk, *acc, emuOn, hwOn);
+    if (seedMenu) {
+      if (emuOn) writeMenuRates(kk, acc->menu_emu, "emu", rateNorm(acc->goodLumiEventCount));
+      if (hwOn) writeMenuRates(kk, acc->menu_hw, "hw", rateNorm(acc->goodLumiEventCount));
+    }
+    if (perLumi) {
+      if (emuOn) writeLumiRates(kk, acc->lumiRates_emu, "emu", true);
+      if (hwOn) writeLumiRates(kk, acc->lumiRates_hw, "hw", !emuOn);
+    }
+    if (binByPileUp) {
+      if (emuOn) writePileupRates(kk, acc->pileup_emu, curves, "emu", true);
+      if (hwOn) writePileupRates(kk, acc->pileup_hw, curves, "hw", !emuOn);
+    }
+    kk->Close();
+  }
+  else writePartial(partialOutput, *acc, runNumber);
+  acc->times.add(acc->times.stage("write"), writeClock.lap());
+
+  writeExtraInfo(myfile, inputFile, acc->goodLumiEventCount);
+  if (seedMenu) {
+    if (emuOn) writeMenuTable(myfile, acc->menu_emu, "emu", rateNorm(acc->goodLumiEventCount));
+    if (hwOn) writeMenuTable(myfile, acc->menu_hw, "hw", rateNorm(acc->goodLumiEventCount));
+  }
+  if (emuOn) writeThresholdTable(myfile, acc->exact_emu, "emu", rateNorm(acc->goodLumiEventCount));
+  if (hwOn) writeThresholdTable(myfile, acc->exact_hw, "hw", rateNorm(acc->goodLumiEventCount));
+  if (binByPileUp) {
+    myfile << "rates binned in " << (pileupTable ? "pileup" : "the number of vertices") << std::endl;
+    myfile << "expected pileup = " << pileupAtLumi(expectedLum) << std::endl;
+  }
+  myfile.close();
+
+  if (!writeRunReport(reportFileName(outputFilename), "rates", inputFile, skimInput ? 1 : nThreads, acc->entryCount,
+		      acc->goodLumiEventCount, acc->loopSeconds, jobClock.lap(), acc->times)) {
+    std::cout << "Cannot write " << reportFileName(outputFilename) << std::endl;
+  }
 }//closes the function 'rates'
+
+// add up the partial outputs of jobs run with -w, e.g. the work units of
+// scripts/run_local.py, into the rates of the whole input or, with -w,
+// into another partial output (one step of a tree reduction)
+void mergeRates(bool newConditions, const std::vector<std::string>& partialFiles)
+{
+  StageClock jobClock;
+  std::vector<CumulativeRate> curves = bookRateCurves();
+  RateAccumulators acc(curves);
+  unsigned runNumber = 0;
+  for (const std::string& partialFile : partialFiles) {
+    TFile* file = TFile::Open(partialFile.c_str());
+    TParameter<Long64_t>* run = file ? dynamic_cast<TParameter<Long64_t>*>(file->Get("runNumber")) : 0;
+    if (!run || !acc.addCache(file)) {
+      std::cout << "Cannot read partial output " << partialFile << std::endl;
+      exit(1);
+    }
+    if (runNumber == 0) runNumber = run->GetVal();
+    file->Close();
+    delete file;
+  }
+  acc.times.add(acc.times.stage("read partial outputs"), jobClock.lap());
+
+  std::string inputFiles;
+  for (const std::string& partialFile : partialFiles) inputFiles += (inputFiles.empty() ? "" : " ") + partialFile;
+  std::string outputFilename = newConditions ? "rates_new_cond.root" : "rates_def.root";
+  StageClock writeClock;
+  if (partialOutput.empty()) {
+    TFile* kk = TFile::Open(outputFilename.c_str(), "recreate");
+    writeRates(kk, acc, true, true);
+    kk->Close();
+
+    std::string outputDirectory = "emu";
+    std::string outputTxtFilename = "output_rates/" + outputDirectory + "/extraInfo.txt";
+    std::ofstream myfile;
+    myfile.open(outputTxtFilename.c_str());
+    myfile << "run number = " << runNumber << std::endl;
+    writeExtraInfo(myfile, inputFiles, acc.goodLumiEventCount);
+    myfile.close();
+  }
+  else {
+    outputFilename = partialOutput;
+    writePartial(partialOutput, acc, runNumber);
+  }
+  acc.times.add(acc.times.stage("write"), writeClock.lap());
+
+  if (!writeRunReport(reportFileName(outputFilename), "rates merge", inputFiles, 1, 0,
+		      acc.goodLumiEventCount, 0., jobClock.lap(), acc.times)) {
+    std::cout << "Cannot write " << reportFileName(outputFilename) << std::endl;
+  }
+}
+
+// default and new conditions in a single pass over the events they share
+void pairedRates(const std::string& defFileDirectory, const std::string& newFileDirectory, int nThreads){
+
+  StageClock jobClock;
+  bool hwOn = true;   //are we using data from hardware? (upgrade trigger had to be running!!!)
+
+  std::string defInputFile(ntupleFiles(defFileDirectory));
+  std::string newInputFile(ntupleFiles(newFileDirectory));
+  std::string outputDirectory = "emu";  //***runNumber, triggerType, version, hw/emu/both***MAKE SURE IT EXISTS
+
+  std::cout << "Loading up the ntuples..." << std::endl;
+  StageClock openClock;
+  NtupleIndex defNtuples(rateTreeNames(true, hwOn));
+  defNtuples.build(defInputFile, ntupleIndexPath);
+  NtupleIndex newNtuples(rateTreeNames(true, false));
+  newNtuples.build(newInputFile, ntupleIndexPath);
+  double openSeconds = openClock.lap();
+
+  std::cout << "Indexing the new conditions events..." << std::endl;
+  EventIndex newIndex = buildEventIndex(newNtuples);
+  double indexSeconds = openClock.lap();
+
+  if (nThreads > 1) ROOT::EnableThreadSafety();
+  std::vector<RateReader*> defReaders;
+  std::vector<RateReader*> newReaders;
+  for (int t=0; t<nThreads; t++) {
+    defReaders.push_back(new RateReader(defNtuples));
+    newReaders.push_back(new RateReader(newNtuples));
+  }
+  Long64_t nentries = defNtuples.entries();
+
+  std::string outputTxtFilename = "output_rates/" + outputDirectory + "/extraInfo.txt";
+  std::ofstream myfile;
+  myfile.open(outputTxtFilename.c_str());
+  myfile << "run number = " << firstRunNumber(defInputFile) << std::endl;
+
+  std::vector<CumulativeRate> curves = bookRateCurves();
+  std::vector<RateAccumulators*> defAccs;
+  std::vector<RateAccumulators*> newAccs;
+  std::vector<PairedAccumulators*> pairAccs;
+  for (int t=0; t<nThreads; t++) {
+    defAccs.push_back(new RateAccumulators(curves));
+    newAccs.push_back(new RateAccumulators(curves));
+    pairAccs.push_back(new PairedAccumulators(curves));
+  }
+  defAccs[0]->times.add(defAccs[0]->times.stage("index files"), openSeconds);
+  defAccs[0]->times.add(defAccs[0]->times.stage("index new events"), indexSeconds);
+
+  EventProgress progress(nentries);
+  runChunks(defReaders[0]->ntuples, defReaders[0]->treeL1emu, 0, nentries, nThreads, [&](int t, Long64_t first, Long64_t last) {
+      processPairedEntries(*defReaders[t], *newReaders[t], newIndex, *defAccs[t], *newAccs[t], *pairAccs[t],
+			   first, last, hwOn, progress);
+    });
+  defAccs[0]->entryCount = progress.nDone();
+  defAccs[0]->loopSeconds = progress.seconds();
+
+  for (int t=1; t<nThreads; t++) {
+    defAccs[0]->add(*defAccs[t]);
+    newAccs[0]->add(*newAccs[t]);
+    pairAccs[0]->add(*pairAccs[t]);
+  }
+  const RateAccumulators& defAcc = *defAccs[0];
+  const RateAccumulators& newAcc = *newAccs[0];
+  const PairedAccumulators& pairAcc = *pairAccs[0];
+
+  // the usual outputs of "def" and "new", restricted to the common events
+  StageClock writeClock;
+  TFile* defFile = TFile::Open("rates_def.root", "recreate");
+  writeRates(defFile, defAcc, true, hwOn);
+  defFile->Close();
+  TFile* newFile = TFile::Open("rates_new_cond.root", "recreate");
+  writeRates(newFile, newAcc, true, hwOn);
+  newFile->Close();
+
+  // event-by-event comparison
+  TFile* pairFile = TFile::Open("rates_paired.root", "recreate");
+  pairFile->cd();
+  double norm = rateNorm(defAcc.goodLumiEventCount);
+  std::string axR = ";Threshold E_{T} (GeV);rate (Hz)";
+  std::string axRatio = ";Threshold E_{T} (GeV);New/Current";
+  std::string axS = ";E_{T}^{new} - E_{T}^{def} (GeV);events/bin";
+  for (int r=0; r<kNRateTypes; r++) {
+    TH1F* ratio = bookRateHist(curves[r], r, "RateRatio_emu", axRatio);
+    pairAcc.flips_emu[r].fillRatio(ratio, defAcc.rates_emu[r]);
+    TH1F* gained = bookRateHist(curves[r], r, "Gained_emu", axR);
+    TH1F* lost = bookRateHist(curves[r], r, "Lost_emu", axR);
+    pairAcc.flips_emu[r].fillFlips(gained, lost);
+    gained->Scale(norm);
+    lost->Scale(norm);
+
+    ratio->Write();
+    gained->Write();
+    lost->Write();
+    std::string shiftName(rateNames[r]);
+    shiftName += "Shift_emu";
+    TH1F* shift = ShiftHist::book(shiftName.c_str(), axS.c_str());
+    pairAcc.shifts_emu[r].fillHist(shift);
+    shift->Write();
+  }
+  pairFile->Close();
+  defAccs[0]->times.add(defAccs[0]->times.stage("write"), writeClock.lap());
+
+  writeExtraInfo(myfile, defInputFile + " and " + newInputFile, defAcc.goodLumiEventCount);
+  myfile << "number of good events without a match = " << pairAcc.unmatchedEventCount << std::endl;
+  myfile << "number of duplicated new events = " << newIndex.nDuplicates() << std::endl;
+  writeThresholdTable(myfile, defAcc.exact_emu, "def emu", norm);
+  writeThresholdTable(myfile, newAcc.exact_emu, "new emu", norm);
+  if (hwOn) writeThresholdTable(myfile, defAcc.exact_hw, "hw", norm);
+  myfile.close();
+
+  if (!writeRunReport("rates_paired.json", "rates pair", defInputFile + " and " + newInputFile, nThreads, defAcc.entryCount,
+		      defAcc.goodLumiEventCount, defAcc.loopSeconds, jobClock.lap(), defAcc.times)) {
+    std::cout << "Cannot write rates_paired.json" << std::endl;
+  }
+
+  for (int t=0; t<nThreads; t++) {
+    delete defAccs[t];
+    delete newAccs[t];
+    delete pairAccs[t];
+    delete defReaders[t];
+    delete newReaders[t];
+  }
+}//closes the function 'pairedRates'
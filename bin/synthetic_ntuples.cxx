@@ -0,0 +1,486 @@
+// Script for writing synthetic L1Ntuples, to time and regression-test the
+// tools without real data
+#include "TMath.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TRandom3.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisEventDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisL1UpgradeDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoVertexDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisCaloTPDataFormat.h"
+
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoJetDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoMetDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoMetFilterDataFormat.h"
+
+/* writes outputDir/L1Ntuple_<n>.root with the trees and branches rates.exe,
+l1jetanalysis.exe and l1validation.exe read, filled with ZeroBias-like events:
+- the number of interactions is Poisson around the pileup (-p), the number of
+  vertices follows it
+- offline jets, pileup jets, EGs and taus have multiplicities growing with
+  pileup and power-law energy spectra; L1 jets are the smeared offline jets
+  plus the pileup jets
+- the hardware has objects and sums in bx -2..2, the emulator only in bx 0
+- HCAL and ECAL TPs are pileup noise plus the deposits of the jets, the L1
+  sums are built from the TPs and jets
+The events depend only on the seed (-s), the file and the event number. -r
+scales the emulated HCAL response (jets, taus, sums, HCAL TPs) without
+changing the events, so two runs differing only in -r give "def" and "new"
+ntuples of the same events, for the paired mode too.
+*/
+
+// configurable parameters
+double pileup = 40.;       // mean number of interactions (-p)
+int eventsPerFile = 10000; // (-n)
+int nFiles = 4;            // (-f)
+unsigned seed = 1;         // (-s)
+double emuResponse = 1.;   // emulated HCAL energy scale (-r)
+unsigned runNumber = 1;
+int eventsPerLumi = 1000;
+
+void writeNtuples(const std::string& outputDirectory);
+
+int main(int argc, char *argv[])
+{
+  bool badOption = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:n:f:s:r:")) != -1) {
+    if (opt == 'p') pileup = std::atof(optarg);
+    else if (opt == 'n') eventsPerFile = std::atoi(optarg);
+    else if (opt == 'f') nFiles = std::atoi(optarg);
+    else if (opt == 's') seed = std::strtoul(optarg, 0, 10);
+    else if (opt == 'r') emuResponse = std::atof(optarg);
+    else badOption = true;
+  }
+
+  if (argc-optind != 1 || badOption || pileup < 0. || eventsPerFile < 1 || nFiles < 1 || seed < 1 || emuResponse <= 0.) {
+    std::cout << "Usage: synthetic_ntuples.exe [-p pileup] [-n events] [-f files] [-s seed] [-r response] [output directory]\n"
+	      << "-p sets the mean number of interactions (default " << pileup << ")\n"
+	      << "-n sets the events per file (default " << eventsPerFile << "), -f the number of files (default " << nFiles << ")\n"
+	      << "-s sets the seed (default " << seed << ", must be positive); the same seed gives the same events\n"
+	      << "-r scales the emulated HCAL response (default 1), e.g. for new conditions of the same events" << std::endl;
+    exit(1);
+  }
+
+  writeNtuples(argv[optind]);
+
+  return 0;
+}
+
+// object of the generator; energies before any L1 quantisation or scaling
+struct SyntheticObject {
+  float et, eta, phi;
+  bool iso;
+};
+
+struct SyntheticTP {
+  short ieta, iphi;
+  float et;
+};
+
+// bx -2..2 of the hardware, kInTime is bx 0
+const int kNBx = 5;
+const int kInTime = 2;
+
+// everything drawn for one event; the ntuple contents follow from it and
+// the emulator response without further random numbers
+struct SyntheticEvent {
+  int nInteractions;
+  unsigned nVtx;
+  unsigned bx;
+  std::vector<SyntheticObject> recoJets;
+  std::vector<SyntheticObject> l1Jets[kNBx], l1EGs[kNBx], l1Taus[kNBx];
+  std::vector<SyntheticTP> hcalTPs, ecalTPs;
+  float caloMetNoise;
+  bool metFilters[3];
+};
+
+// spectrum falling like et^-index above lo
+double powerLaw(TRandom3& rng, double lo, double index)
+{
+  return lo*std::pow(rng.Rndm(), -1./(index-1.));
+}
+
+SyntheticObject randomObject(TRandom3& rng, double lo, double index, double maxEta, double isoFraction)
+{
+  SyntheticObject object;
+  object.et = powerLaw(rng, lo, index);
+  object.eta = rng.Uniform(-maxEta, maxEta);
+  object.phi = rng.Uniform(-TMath::Pi(), TMath::Pi());
+  object.iso = rng.Rndm() < isoFraction;
+  return object;
+}
+
+// L1 energies are multiples of 0.5 GeV
+float l1Et(double et)
+{
+  return std::min(std::floor(2.*et)/2., 1023.5);
+}
+
+short towerIeta(double eta, int maxIeta)
+{
+  int ieta = std::min(static_cast<int>(std::fabs(eta)/0.087)+1, maxIeta);
+  if (ieta == 29) ieta = 30;  // no TPs in the HE/HF overlap tower
+  return eta < 0 ? -ieta : ieta;
+}
+
+short towerIphi(double phi)
+{
+  double p = phi < 0 ? phi + 2*TMath::Pi() : phi;
+  return std::min(static_cast<int>(p/(2*TMath::Pi()/72))+1, 72);
+}
+
+double towerPhi(short iphi)
+{
+  return (iphi-0.5)*2*TMath::Pi()/72;
+}
+
+// pileup TPs in distinct towers, at most one per tower
+void noiseTPs(TRandom3& rng, int n, int maxIeta, double meanEt, std::vector<SyntheticTP>& tps)
+{
+  std::vector<char> used(2*maxIeta*72, 0);
+  n = std::min(n, 2*maxIeta*72/2);
+  while (n > 0) {
+    int tower = rng.Integer(2*maxIeta*72);
+    short ieta = tower/72 - maxIeta;
+    ieta = ieta >= 0 ? ieta+1 : ieta;
+    if (std::abs(ieta) == 29 || used[tower]) continue;
+    used[tower] = 1;
+    SyntheticTP tp = {ieta, static_cast<short>(tower%72+1), static_cast<float>(rng.Exp(meanEt))};
+    tps.push_back(tp);
+    n--;
+  }
+}
+
+void generateEvent(TRandom3& rng, SyntheticEvent& ev)
+{
+  ev.nInteractions = rng.Poisson(pileup);
+  ev.nVtx = rng.Binomial(ev.nInteractions, 0.7) + 1;
+  ev.bx = rng.Integer(3564) + 1;
+
+  // offline jets of the hard scatter and their L1 counterparts, with a 15% resolution
+  ev.recoJets.clear();
+  for (int bx=0; bx<kNBx; bx++) {
+    ev.l1Jets[bx].clear();
+    ev.l1EGs[bx].clear();
+    ev.l1Taus[bx].clear();
+  }
+  int nJets = rng.Poisson(0.3 + 0.05*ev.nInteractions);
+  for (int j=0; j<nJets; j++) {
+    ev.recoJets.push_back(randomObject(rng, 10., 5., 4.7, 0.));
+    SyntheticObject l1Jet = ev.recoJets.back();
+    l1Jet.et *= std::max(rng.Gaus(1., 0.15), 0.);
+    ev.l1Jets[kInTime].push_back(l1Jet);
+  }
+  // pileup jets only seen at L1
+  int nPuJets = rng.Poisson(0.05*ev.nInteractions);
+  for (int j=0; j<nPuJets; j++) ev.l1Jets[kInTime].push_back(randomObject(rng, 8., 6., 4.7, 0.));
+  int nEGs = rng.Poisson(0.3 + 0.05*ev.nInteractions);
+  for (int e=0; e<nEGs; e++) ev.l1EGs[kInTime].push_back(randomObject(rng, 3., 4.5, 2.5, 0.3));
+  int nTaus = rng.Poisson(0.5 + 0.06*ev.nInteractions);
+  for (int t=0; t<nTaus; t++) ev.l1Taus[kInTime].push_back(randomObject(rng, 5., 4.5, 2.1, 0.2));
+
+  // out-of-time objects of the hardware
+  for (int bx=0; bx<kNBx; bx++) {
+    if (bx == kInTime) continue;
+    int n = rng.Poisson(0.5);
+    for (int j=0; j<n; j++) ev.l1Jets[bx].push_back(randomObject(rng, 15., 5., 4.7, 0.));
+    n = rng.Poisson(0.3);
+    for (int e=0; e<n; e++) ev.l1EGs[bx].push_back(randomObject(rng, 3., 4.5, 2.5, 0.3));
+    n = rng.Poisson(0.3);
+    for (int t=0; t<n; t++) ev.l1Taus[bx].push_back(randomObject(rng, 5., 4.5, 2.1, 0.2));
+  }
+
+  // TPs: pileup noise, plus 60% (HCAL) and 40% (ECAL) of every offline jet in its tower
+  ev.hcalTPs.clear();
+  ev.ecalTPs.clear();
+  noiseTPs(rng, rng.Poisson(20 + 6*ev.nInteractions), 41, 0.6, ev.hcalTPs);
+  noiseTPs(rng, rng.Poisson(30 + 8*ev.nInteractions), 28, 0.5, ev.ecalTPs);
+  for (const SyntheticObject& jet : ev.recoJets) {
+    SyntheticTP hcal = {towerIeta(jet.eta, 41), towerIphi(jet.phi), 0.6f*jet.et};
+    ev.hcalTPs.push_back(hcal);
+    if (std::fabs(jet.eta) < 3.) {
+      SyntheticTP ecal = {towerIeta(jet.eta, 28), towerIphi(jet.phi), 0.4f*jet.et};
+      ev.ecalTPs.push_back(ecal);
+    }
+  }
+
+  ev.caloMetNoise = rng.Gaus(0., 5. + 0.2*ev.nInteractions);
+  for (int f=0; f<3; f++) ev.metFilters[f] = rng.Rndm() > 0.01;
+}
+
+bool higherEt(const SyntheticObject& a, const SyntheticObject& b)
+{
+  return a.et > b.et;
+}
+
+// the jets, EGs and taus of one bx, in bx 0 with the HCAL response applied
+void fillObjects(const SyntheticEvent& ev, int bx, double response, L1Analysis::L1AnalysisL1UpgradeDataFormat& l1)
+{
+  std::vector<SyntheticObject> jets(ev.l1Jets[bx]);
+  for (SyntheticObject& jet : jets) jet.et = l1Et(jet.et*response);
+  std::sort(jets.begin(), jets.end(), higherEt);
+  for (const SyntheticObject& jet : jets) {
+    if (jet.et < 4.) continue;  // seed threshold
+    l1.jetEt.push_back(jet.et);
+    l1.jetEta.push_back(jet.eta);
+    l1.jetPhi.push_back(jet.phi);
+    l1.jetIEt.push_back(2*jet.et);
+    l1.jetIEta.push_back(towerIeta(jet.eta, 41));
+    l1.jetIPhi.push_back(towerIphi(jet.phi));
+    l1.jetBx.push_back(bx-kInTime);
+  }
+  l1.nJets = l1.jetEt.size();
+
+  // EGs and taus come unsorted
+  for (const SyntheticObject& eg : ev.l1EGs[bx]) {
+    l1.egEt.push_back(l1Et(eg.et));
+    l1.egEta.push_back(eg.eta);
+    l1.egPhi.push_back(eg.phi);
+    l1.egIEt.push_back(2*l1.egEt.back());
+    l1.egIEta.push_back(towerIeta(eg.eta, 28));
+    l1.egIPhi.push_back(towerIphi(eg.phi));
+    l1.egIso.push_back(eg.iso);
+    l1.egBx.push_back(bx-kInTime);
+  }
+  l1.nEGs = l1.egEt.size();
+  for (const SyntheticObject& tau : ev.l1Taus[bx]) {
+    l1.tauEt.push_back(l1Et(tau.et*response));
+    l1.tauEta.push_back(tau.eta);
+    l1.tauPhi.push_back(tau.phi);
+    l1.tauIEt.push_back(2*l1.tauEt.back());
+    l1.tauIEta.push_back(towerIeta(tau.eta, 28));
+    l1.tauIPhi.push_back(towerIphi(tau.phi));
+    l1.tauIso.push_back(tau.iso);
+    l1.tauBx.push_back(bx-kInTime);
+  }
+  l1.nTaus = l1.tauEt.size();
+}
+
+void addSum(L1Analysis::L1AnalysisL1UpgradeDataFormat& l1, short type, double et, double phi, int bx)
+{
+  l1.sumType.push_back(type);
+  l1.sumEt.push_back(std::floor(2.*et)/2.);
+  l1.sumPhi.push_back(phi);
+  l1.sumIEt.push_back(2*l1.sumEt.back());
+  l1.sumIPhi.push_back(towerIphi(phi));
+  l1.sumBx.push_back(bx-kInTime);
+}
+
+// HT and MHT of the jets of a bx above 30 GeV within |eta| < 2.4
+void jetSums(const L1Analysis::L1AnalysisL1UpgradeDataFormat& l1, int bx, double& ht, double& mhtX, double& mhtY)
+{
+  ht = mhtX = mhtY = 0.;
+  for (unsigned j=0; j<l1.nJets; j++) {
+    if (l1.jetBx[j] != bx-kInTime || l1.jetEt[j] < 30. || std::fabs(l1.jetEta[j]) > 2.4) continue;
+    ht += l1.jetEt[j];
+    mhtX -= l1.jetEt[j]*std::cos(l1.jetPhi[j]);
+    mhtY -= l1.jetEt[j]*std::sin(l1.jetPhi[j]);
+  }
+}
+
+// the L1 objects and sums; the emulator has bx 0 only
+void fillUpgrade(const SyntheticEvent& ev, double response, bool hardware, L1Analysis::L1AnalysisL1UpgradeDataFormat& l1)
+{
+  l1.Reset();
+  for (int bx=0; bx<kNBx; bx++) {
+    if (bx != kInTime && !hardware) continue;
+    fillObjects(ev, bx, bx == kInTime ? response : 1., l1);
+  }
+
+  for (int bx=0; bx<kNBx; bx++) {
+    if (bx != kInTime && !hardware) continue;
+    double ht, mhtX, mhtY;
+    jetSums(l1, bx, ht, mhtX, mhtY);
+    double ett = ht, metX = mhtX, metY = mhtY, metHFX = mhtX, metHFY = mhtY;
+    if (bx == kInTime) {
+      // ET and MET from the TPs, MET without and with HF
+      ett = metX = metY = metHFX = metHFY = 0.;
+      for (const SyntheticTP& tp : ev.hcalTPs) {
+	double et = l1Et(tp.et*response);
+	double phi = towerPhi(tp.iphi);
+	if (std::abs(tp.ieta) <= 28) {
+	  ett += et;
+	  metX -= et*std::cos(phi);
+	  metY -= et*std::sin(phi);
+	}
+	metHFX -= et*std::cos(phi);
+	metHFY -= et*std::sin(phi);
+      }
+      for (const SyntheticTP& tp : ev.ecalTPs) {
+	double et = l1Et(tp.et);
+	double phi = towerPhi(tp.iphi);
+	ett += et;
+	metX -= et*std::cos(phi);
+	metY -= et*std::sin(phi);
+	metHFX -= et*std::cos(phi);
+	metHFY -= et*std::sin(phi);
+      }
+    }
+    addSum(l1, L1Analysis::kTotalEt, ett, 0., bx);
+    addSum(l1, L1Analysis::kTotalHt, ht, 0., bx);
+    addSum(l1, L1Analysis::kMissingEt, std::hypot(metX, metY), std::atan2(metY, metX), bx);
+    addSum(l1, L1Analysis::kMissingHt, std::hypot(mhtX, mhtY), std::atan2(mhtY, mhtX), bx);
+    addSum(l1, L1Analysis::kMissingEtHF, std::hypot(metHFX, metHFY), std::atan2(metHFY, metHFX), bx);
+  }
+  l1.nSums = l1.sumType.size();
+}
+
+void fillTPs(const std::vector<SyntheticTP>& tps, double response, short& nTP, std::vector<short>& ieta,
+	     std::vector<short>& iphi, std::vector<short>& caliphi, std::vector<float>& et,
+	     std::vector<short>& compEt, std::vector<short>& fineGrain)
+{
+  for (const SyntheticTP& tp : tps) {
+    float tpEt = l1Et(tp.et*response);
+    if (tpEt <= 0.) continue;
+    ieta.push_back(tp.ieta);
+    iphi.push_back(tp.iphi);
+    caliphi.push_back(tp.iphi);
+    et.push_back(tpEt);
+    compEt.push_back(std::min(static_cast<int>(2*tpEt), 255));
+    fineGrain.push_back(0);
+  }
+  nTP = et.size();
+}
+
+void fillCaloTP(const SyntheticEvent& ev, double response, L1Analysis::L1AnalysisCaloTPDataFormat& tp)
+{
+  tp.Reset();
+  fillTPs(ev.hcalTPs, response, tp.nHCALTP, tp.hcalTPieta, tp.hcalTPiphi, tp.hcalTPCaliphi, tp.hcalTPet,
+	  tp.hcalTPcompEt, tp.hcalTPfineGrain);
+  fillTPs(ev.ecalTPs, 1., tp.nECALTP, tp.ecalTPieta, tp.ecalTPiphi, tp.ecalTPCaliphi, tp.ecalTPet,
+	  tp.ecalTPcompEt, tp.ecalTPfineGrain);
+}
+
+void fillReco(const SyntheticEvent& ev, L1Analysis::L1AnalysisRecoJetDataFormat& jet,
+	      L1Analysis::L1AnalysisRecoMetDataFormat& met, L1Analysis::L1AnalysisRecoMetFilterDataFormat& metfilter)
+{
+  jet.Reset();
+  std::vector<SyntheticObject> jets(ev.recoJets);
+  std::sort(jets.begin(), jets.end(), higherEt);
+  double sumEt = 0., metX = 0., metY = 0.;
+  for (const SyntheticObject& j : jets) {
+    double corrFactor = 1.15;
+    jet.etCorr.push_back(j.et);
+    jet.corrFactor.push_back(corrFactor);
+    jet.et.push_back(j.et/corrFactor);
+    jet.e.push_back(j.et/corrFactor*std::cosh(j.eta));
+    jet.eta.push_back(j.eta);
+    jet.phi.push_back(j.phi);
+    sumEt += j.et;
+    metX -= j.et*std::cos(j.phi);
+    metY -= j.et*std::sin(j.phi);
+  }
+  jet.nJets = jets.size();
+
+  met.Reset();
+  met.met = std::fabs(std::hypot(metX, metY) + ev.caloMetNoise);
+  met.metPhi = std::atan2(metY, metX);
+  met.sumEt = sumEt;
+  met.caloMet = met.met;
+  met.caloMetPhi = met.metPhi;
+  met.caloSumEt = sumEt;
+
+  metfilter.Reset();
+  metfilter.hbheNoiseFilter = metfilter.hbheNoiseIsoFilter = metfilter.cscTightHalo2015Filter = true;
+  metfilter.ecalDeadCellTPFilter = metfilter.goodVerticesFilter = metfilter.eeBadScFilter = true;
+  metfilter.chHadTrackResFilter = true;
+  metfilter.muonBadTrackFilter = ev.metFilters[0];
+  metfilter.badPFMuonFilter = ev.metFilters[1];
+  metfilter.badChCandFilter = ev.metFilters[2];
+}
+
+// tree dir/name in file, with the branches added by the caller
+TTree* makeTree(TFile* file, const char* dir, const char* name)
+{
+  file->mkdir(dir)->cd();
+  return new TTree(name, name);
+}
+
+void writeNtuples(const std::string& outputDirectory)
+{
+  L1Analysis::L1AnalysisEventDataFormat* event_ = new L1Analysis::L1AnalysisEventDataFormat();
+  L1Analysis::L1AnalysisRecoVertexDataFormat* vtx_ = new L1Analysis::L1AnalysisRecoVertexDataFormat();
+  L1Analysis::L1AnalysisL1UpgradeDataFormat* l1emu_ = new L1Analysis::L1AnalysisL1UpgradeDataFormat();
+  L1Analysis::L1AnalysisL1UpgradeDataFormat* l1hw_ = new L1Analysis::L1AnalysisL1UpgradeDataFormat();
+  L1Analysis::L1AnalysisCaloTPDataFormat* l1TPemu_ = new L1Analysis::L1AnalysisCaloTPDataFormat();
+  L1Analysis::L1AnalysisCaloTPDataFormat* l1TPhw_ = new L1Analysis::L1AnalysisCaloTPDataFormat();
+  L1Analysis::L1AnalysisRecoJetDataFormat* jet_ = new L1Analysis::L1AnalysisRecoJetDataFormat();
+  L1Analysis::L1AnalysisRecoMetDataFormat* met_ = new L1Analysis::L1AnalysisRecoMetDataFormat();
+  L1Analysis::L1AnalysisRecoMetFilterDataFormat* metfilter_ = new L1Analysis::L1AnalysisRecoMetFilterDataFormat();
+  SyntheticEvent ev;
+
+  for (int f=0; f<nFiles; f++) {
+    std::ostringstream fileName;
+    fileName << outputDirectory << "/L1Ntuple_" << f+1 << ".root";
+    TFile* file = TFile::Open(fileName.str().c_str(), "recreate");
+    if (!file || file->IsZombie()) {
+      std::cout << "Cannot write " << fileName.str() << std::endl;
+      exit(1);
+    }
+
+    TTree* eventTree = makeTree(file, "l1EventTree", "L1EventTree");
+    eventTree->Branch("Event", "L1Analysis::L1AnalysisEventDataFormat", &event_, 32000, 3);
+    TTree* vtxTree = makeTree(file, "l1RecoTree", "RecoTree");
+    vtxTree->Branch("Vertex", "L1Analysis::L1AnalysisRecoVertexDataFormat", &vtx_, 32000, 3);
+    TTree* treeL1emu = makeTree(file, "l1UpgradeEmuTree", "L1UpgradeTree");
+    treeL1emu->Branch("L1Upgrade", "L1Analysis::L1AnalysisL1UpgradeDataFormat", &l1emu_, 32000, 3);
+    TTree* treeL1hw = makeTree(file, "l1UpgradeTree", "L1UpgradeTree");
+    treeL1hw->Branch("L1Upgrade", "L1Analysis::L1AnalysisL1UpgradeDataFormat", &l1hw_, 32000, 3);
+    TTree* treeL1TPemu = makeTree(file, "l1CaloTowerEmuTree", "L1CaloTowerTree");
+    treeL1TPemu->Branch("CaloTP", "L1Analysis::L1AnalysisCaloTPDataFormat", &l1TPemu_, 32000, 3);
+    TTree* treeL1TPhw = makeTree(file, "l1CaloTowerTree", "L1CaloTowerTree");
+    treeL1TPhw->Branch("CaloTP", "L1Analysis::L1AnalysisCaloTPDataFormat", &l1TPhw_, 32000, 3);
+    TTree* recoTree = makeTree(file, "l1JetRecoTree", "JetRecoTree");
+    recoTree->Branch("Jet", "L1Analysis::L1AnalysisRecoJetDataFormat", &jet_, 32000, 3);
+    recoTree->Branch("Sums", "L1Analysis::L1AnalysisRecoMetDataFormat", &met_, 32000, 3);
+    TTree* metfilterTree = makeTree(file, "l1MetFilterRecoTree", "MetFilterRecoTree");
+    metfilterTree->Branch("MetFilters", "L1Analysis::L1AnalysisRecoMetFilterDataFormat", &metfilter_, 32000, 3);
+
+    // one generator per file, so files can be made in any order
+    TRandom3 rng(seed*100000 + f + 1);
+    for (int i=0; i<eventsPerFile; i++) {
+      Long64_t n = static_cast<Long64_t>(f)*eventsPerFile + i;
+      generateEvent(rng, ev);
+
+      event_->run = runNumber;
+      event_->lumi = n/eventsPerLumi + 1;
+      event_->event = n + 1;
+      event_->bx = ev.bx;
+      event_->orbit = n;
+      event_->time = 0;
+      event_->nPV = ev.nVtx;
+      event_->nPV_True = ev.nInteractions;
+      vtx_->nVtx = ev.nVtx;
+
+      fillUpgrade(ev, emuResponse, false, *l1emu_);
+      fillUpgrade(ev, 1., true, *l1hw_);
+      fillCaloTP(ev, emuResponse, *l1TPemu_);
+      fillCaloTP(ev, 1., *l1TPhw_);
+      fillReco(ev, *jet_, *met_, *metfilter_);
+
+      eventTree->Fill();
+      vtxTree->Fill();
+      treeL1emu->Fill();
+      treeL1hw->Fill();
+      treeL1TPemu->Fill();
+      treeL1TPhw->Fill();
+      recoTree->Fill();
+      metfilterTree->Fill();
+    }
+
+    file->Write();
+    file->Close();
+    delete file;
+    std::cout << "Wrote " << eventsPerFile << " events to " << fileName.str() << std::endl;
+  }
+}
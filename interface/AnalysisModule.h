@@ -0,0 +1,169 @@
+#ifndef HcalTrigger_Validation_AnalysisModule_h
+#define HcalTrigger_Validation_AnalysisModule_h
+
+#include "TTree.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisEventDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoJetDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoMetDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoMetFilterDataFormat.h"
+
+#include "HcalTrigger/Validation/interface/CaloTPColumns.h"
+#include "HcalTrigger/Validation/interface/GoodLumiMask.h"
+#include "HcalTrigger/Validation/interface/L1UpgradeColumns.h"
+#include "HcalTrigger/Validation/interface/NtupleReader.h"
+#include "HcalTrigger/Validation/interface/RunReport.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// ntuple trees an analysis module reads, besides the event tree
+enum NtupleTree { kEmuTree = 1, kHwTree = 2, kEmuTPTree = 4, kHwTPTree = 8, kRecoTree = 16 };
+
+// One good entry of the ntuples, decoded once and shared by every module.
+// Only the trees some module asked for are read; the others stay empty.
+struct ValidationEvent {
+  const L1Analysis::L1AnalysisEventDataFormat* event;
+  const L1UpgradeColumns *l1emu, *l1hw;
+  const CaloTPColumns *tpEmu, *tpHw;
+  const L1Analysis::L1AnalysisRecoJetDataFormat* jet;
+  const L1Analysis::L1AnalysisRecoMetDataFormat* met;
+  const L1Analysis::L1AnalysisRecoMetFilterDataFormat* metfilter;
+};
+
+// An analysis subscribed to an EventStream: it names the trees it needs,
+// is handed every good event and writes its results once the stream ends.
+class AnalysisModule {
+public:
+  virtual ~AnalysisModule() {}
+  virtual unsigned trees() const = 0;  // NtupleTree flags
+  virtual void analyze(const ValidationEvent& event) = 0;
+  virtual void write(Long64_t goodLumiEventCount) = 0;
+};
+
+// Reads the ntuples of inputFile (a file or a pattern) once for all modules:
+// the trees are the union of what the modules need, read together one file
+// at a time through an NtupleIndex, so a file in which their entries do not
+// line up is left out instead of shifting one tree against the others. Each
+// entry is read from each tree at most once, and entries outside the good
+// lumi sections (of mask; none: all) are not read beyond the event tree.
+class EventStream {
+public:
+  EventStream(const std::string& inputFile, const std::string& indexFile, const std::vector<AnalysisModule*>& modules)
+    : modules_(modules), trees_(treeFlags(modules)), index_(treeNames(trees_)) {
+    index_.build(inputFile, indexFile);
+    reader_ = new NtupleReader(index_);
+
+    event_ = new L1Analysis::L1AnalysisEventDataFormat();
+    reader_->bind(index_.tree("l1EventTree/L1EventTree"), [this](TTree* tree) {
+	tree->SetBranchAddress("Event", &event_);
+	// read first for every entry, so only what the lumi check needs
+	tree->SetBranchStatus("*", 0);
+	tree->SetBranchStatus("run", 1);
+	tree->SetBranchStatus("lumi", 1);
+	tree->SetBranchStatus("event", 1);
+	tree->SetBranchStatus("bx", 1);
+      });
+
+    // only the L1 leaves used by the modules are read; the L1 jet
+    // positions only where emulated jets are matched to offline jets
+    l1emu_ = new L1UpgradeColumns(0, false, trees_ & kRecoTree);
+    l1hw_ = new L1UpgradeColumns(0);
+    l1TPemu_ = new CaloTPColumns(0);
+    l1TPhw_ = new CaloTPColumns(0);
+    if (trees_ & kEmuTree) reader_->bind(index_.tree("l1UpgradeEmuTree/L1UpgradeTree"), *l1emu_);
+    if (trees_ & kHwTree) reader_->bind(index_.tree("l1UpgradeTree/L1UpgradeTree"), *l1hw_);
+    if (trees_ & kEmuTPTree) reader_->bind(index_.tree("l1CaloTowerEmuTree/L1CaloTowerTree"), *l1TPemu_);
+    if (trees_ & kHwTPTree) reader_->bind(index_.tree("l1CaloTowerTree/L1CaloTowerTree"), *l1TPhw_);
+    jet_ = new L1Analysis::L1AnalysisRecoJetDataFormat();
+    met_ = new L1Analysis::L1AnalysisRecoMetDataFormat();
+    metfilter_ = new L1Analysis::L1AnalysisRecoMetFilterDataFormat();
+    if (trees_ & kRecoTree) {
+      reader_->bind(index_.tree("l1JetRecoTree/JetRecoTree"), [this](TTree* tree) {
+	  tree->SetBranchAddress("Jet", &jet_);
+	  tree->SetBranchAddress("Sums", &met_);
+	});
+      reader_->bind(index_.tree("l1MetFilterRecoTree/MetFilterRecoTree"), [this](TTree* tree) {
+	  tree->SetBranchAddress("MetFilters", &metfilter_);
+	});
+    }
+  }
+
+  ~EventStream() {
+    // the files are closed before the objects their trees point to go
+    delete reader_;
+    delete event_;
+    delete l1emu_;
+    delete l1hw_;
+    delete l1TPemu_;
+    delete l1TPhw_;
+    delete jet_;
+    delete met_;
+    delete metfilter_;
+  }
+
+  const NtupleIndex& index() const { return index_; }
+  Long64_t entries() const { return index_.entries(); }
+
+  // hand every good entry to the modules; returns the number of good events.
+  // The entries read go to progress, the time of each stage to times.
+  Long64_t run(const GoodLumiMask* mask, EventProgress& progress, StageTimes& times) {
+    ValidationEvent event = {event_, l1emu_, l1hw_, l1TPemu_, l1TPhw_, jet_, met_, metfilter_};
+    StageTimer timer(times);
+    int openStage = times.stage("open files");
+    int analyzeStage = times.stage("analyze");
+    // tree 0 is the event tree
+    std::vector<int> readStages;
+    for (const std::string& name : index_.treeNames()) readStages.push_back(times.stage("GetEntry " + name.substr(0, name.find('/'))));
+
+    Long64_t goodLumiEventCount = 0;
+    for (Long64_t jentry=0; jentry<entries(); jentry++){
+      progress.count();
+      timer.start(openStage);
+      Long64_t entry = reader_->load(jentry);
+      if (entry >= 0) timer.read(reader_->tree(0), entry, readStages[0]);
+      timer.stop();
+      if (entry < 0 || (mask && !mask->contains(event_->run, event_->lumi))) continue;
+      goodLumiEventCount++;
+
+      for (size_t t=1; t<readStages.size(); t++) timer.read(reader_->tree(t), entry, readStages[t]);
+      timer.start(analyzeStage);
+      for (AnalysisModule* module : modules_) module->analyze(event);
+      timer.stop();
+    }
+    return goodLumiEventCount;
+  }
+
+private:
+  static unsigned treeFlags(const std::vector<AnalysisModule*>& modules) {
+    unsigned trees = 0;
+    for (const AnalysisModule* module : modules) trees |= module->trees();
+    return trees;
+  }
+  // the event tree first, then those of the flags
+  static std::vector<std::string> treeNames(unsigned trees) {
+    std::vector<std::string> names(1, "l1EventTree/L1EventTree");
+    if (trees & kEmuTree) names.push_back("l1UpgradeEmuTree/L1UpgradeTree");
+    if (trees & kHwTree) names.push_back("l1UpgradeTree/L1UpgradeTree");
+    if (trees & kEmuTPTree) names.push_back("l1CaloTowerEmuTree/L1CaloTowerTree");
+    if (trees & kHwTPTree) names.push_back("l1CaloTowerTree/L1CaloTowerTree");
+    if (trees & kRecoTree) {
+      names.push_back("l1JetRecoTree/JetRecoTree");
+      names.push_back("l1MetFilterRecoTree/MetFilterRecoTree");
+    }
+    return names;
+  }
+
+  std::vector<AnalysisModule*> modules_;
+  unsigned trees_;
+  NtupleIndex index_;
+  NtupleReader* reader_;  // made once index_ is built
+  L1Analysis::L1AnalysisEventDataFormat* event_;
+  L1UpgradeColumns *l1emu_, *l1hw_;
+  CaloTPColumns *l1TPemu_, *l1TPhw_;
+  L1Analysis::L1AnalysisRecoJetDataFormat* jet_;
+  L1Analysis::L1AnalysisRecoMetDataFormat* met_;
+  L1Analysis::L1AnalysisRecoMetFilterDataFormat* metfilter_;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef HcalTrigger_Validation_BootstrapRate_h
+#define HcalTrigger_Validation_BootstrapRate_h
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Poisson(1) weights of one event for nReplicas bootstrap replicas. The
+// weights are a pure function of the event id: a counter-based generator
+// (the splitmix64 finaliser of id + counter) gives four 16-bit uniforms
+// per call, each turned into a weight by counting the Poisson CDF steps it
+// passes. The same event therefore gets the same weights in every job,
+// thread and condition, so separate def and new runs share their replicas.
+class BootstrapWeights {
+public:
+  explicit BootstrapWeights(int nReplicas)
+    : nReplicas_(nReplicas), weights_(padded(nReplicas), 0) {
+    double p = std::exp(-1.);
+    double cdf = 0.;
+    for (int n=0; n<kMaxWeight; n++) {
+      cdf += p;
+      p /= n+1;
+      cdf_[n] = static_cast<uint32_t>(std::lround(cdf*65536.));
+    }
+  }
+
+  int nReplicas() const { return nReplicas_; }
+
+  void generate(uint64_t id) {
+    for (int i=0; i<nReplicas_; i+=4) {
+      uint64_t x = id + (i/4+1)*0x9e3779b97f4a7c15ULL;
+      x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+      x ^= x >> 31;
+      for (int j=0; j<4; j++) {
+        uint32_t u = (x >> (16*j)) & 0xffff;
+        uint8_t w = 0;
+        for (int n=0; n<kMaxWeight; n++) w += u >= cdf_[n];
+        weights_[i+j] = i+j < nReplicas_ ? w : 0;
+      }
+    }
+  }
+
+  // nReplicas weights, zero-padded to a multiple of kPad
+  const uint8_t* data() const { return weights_.data(); }
+
+  static const int kPad = 16;
+  static size_t padded(int nReplicas) { return (nReplicas+kPad-1)/kPad*kPad; }
+
+private:
+  // P(weight > 7) is below 1e-5, less than the 16-bit resolution
+  static const int kMaxWeight = 8;
+
+  int nReplicas_;
+  uint32_t cdf_[kMaxWeight];
+  std::vector<uint8_t> weights_;
+};
+
+// Bootstrap replicas of a CumulativeRate: every event adds its replica
+// weights to the row of its highest passed threshold bin. Rows are
+// replica-contiguous and padded, so the per-event update is one
+// uint8 -> uint32 add loop the compiler vectorises. Counts are 32 bit,
+// enough for any realistic number of events per job.
+class BootstrapRate {
+public:
+  BootstrapRate(int nBins, int nReplicas)
+    : nBins_(nBins), nReplicas_(nReplicas), stride_(BootstrapWeights::padded(nReplicas)),
+      counts_(nBins*stride_, 0) {}
+
+  int nBins() const { return nBins_; }
+  int nReplicas() const { return nReplicas_; }
+
+  // bin as given by CumulativeRate::thresholdBin, -1 for none
+  void fill(int bin, const uint8_t* weights) {
+    if (bin < 0) return;
+    uint32_t* row = &counts_[bin*stride_];
+    for (size_t k=0; k<stride_; k+=BootstrapWeights::kPad) {
+      for (int j=0; j<BootstrapWeights::kPad; j++) row[k+j] += weights[k+j];
+    }
+  }
+
+  void add(const BootstrapRate& other) {
+    for (size_t i=0; i<counts_.size(); i++) counts_[i] += other.counts_[i];
+  }
+
+  // weighted count of replica in bin (differential, as filled)
+  unsigned long long counts(int bin, int replica) const { return counts_[bin*stride_ + replica]; }
+
+  // weighted events passing the threshold of every bin, bin-major with
+  // nReplicas values per bin
+  std::vector<unsigned long long> passing() const {
+    std::vector<unsigned long long> result(nBins_*nReplicas_);
+    std::vector<unsigned long long> sum(nReplicas_, 0);
+    for (int bin=nBins_-1; bin>=0; bin--) {
+      for (int k=0; k<nReplicas_; k++) {
+        sum[k] += counts_[bin*stride_ + k];
+        result[bin*nReplicas_ + k] = sum[k];
+      }
+    }
+    return result;
+  }
+
+private:
+  int nBins_;
+  int nReplicas_;
+  size_t stride_;
+  std::vector<uint32_t> counts_;
+};
+
+#endif
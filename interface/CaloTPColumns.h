@@ -0,0 +1,26 @@
+#ifndef HcalTrigger_Validation_CaloTPColumns_h
+#define HcalTrigger_Validation_CaloTPColumns_h
+
+#include "HcalTrigger/Validation/interface/TreeColumns.h"
+
+#include <vector>
+
+// TP transverse energies from L1AnalysisCaloTPDataFormat; the tower
+// coordinates and compressed/fine-grain words are not read.
+class CaloTPColumns : public TreeColumns {
+public:
+  explicit CaloTPColumns(TTree* tree)
+    : TreeColumns(tree), nHCALTP(0), nECALTP(0) {
+    connect("nHCALTP", nHCALTP);
+    connect("hcalTPet", hcalTPet);
+    connect("nECALTP", nECALTP);
+    connect("ecalTPet", ecalTPet);
+  }
+
+  short nHCALTP;
+  std::vector<float> hcalTPet;
+  short nECALTP;
+  std::vector<float> ecalTPet;
+};
+
+#endif
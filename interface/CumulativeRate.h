@@ -0,0 +1,97 @@
+#ifndef HcalTrigger_Validation_CumulativeRate_h
+#define HcalTrigger_Validation_CumulativeRate_h
+
+#include "TH1.h"
+
+#include <vector>
+
+// "Rate above threshold" curve built from a differential count array.
+// Every event is recorded once, in the bin of the highest threshold it
+// passes, and the cumulative curve is produced at write time as a reverse
+// running sum. Thresholds are the low bin edges, lo + bin*width, evaluated
+// in float exactly like the per-bin loops this replaces, so the resulting
+// histogram is identical bin for bin.
+class CumulativeRate {
+public:
+  CumulativeRate(int nBins, float lo, float hi)
+    : nBins_(nBins), lo_(lo), hi_(hi), width_((hi-lo)/nBins), counts_(nBins, 0) {}
+
+  // take the binning from an (empty) rate histogram
+  explicit CumulativeRate(const TH1* hist)
+    : CumulativeRate(hist->GetNbinsX(), hist->GetXaxis()->GetXmin(), hist->GetXaxis()->GetXmax()) {}
+
+  int nBins() const { return nBins_; }
+  float lo() const { return lo_; }
+  float hi() const { return hi_; }
+  float threshold(int bin) const { return lo_ + (bin*width_); }
+
+  // index of the highest threshold passed by value, -1 if none
+  int thresholdBin(double value) const {
+    if (!(value >= threshold(0))) return -1;
+    double x = (value-lo_)/width_;
+    int bin = x < nBins_ ? static_cast<int>(x) : nBins_-1;
+    // the division can be off by one ulp w.r.t. the float thresholds
+    while (bin+1 < nBins_ && value >= threshold(bin+1)) ++bin;
+    while (bin > 0 && value < threshold(bin)) --bin;
+    return bin;
+  }
+
+  void fill(double value) {
+    int bin = thresholdBin(value);
+    if (bin >= 0) ++counts_[bin];
+  }
+
+  void add(const CumulativeRate& other) {
+    for (int bin=0; bin<nBins_; bin++) counts_[bin] += other.counts_[bin];
+  }
+
+  // store the differential counts in hist (same binning) and read them back
+  void fillCounts(TH1* hist) const {
+    for (int bin=0; bin<nBins_; bin++) hist->SetBinContent(bin+1, counts_[bin]);
+  }
+
+  void addCounts(const TH1* hist) {
+    for (int bin=0; bin<nBins_; bin++) counts_[bin] += static_cast<unsigned long long>(hist->GetBinContent(bin+1));
+  }
+
+  // number of events whose highest passed threshold is bin
+  unsigned long long counts(int bin) const { return counts_[bin]; }
+
+  // number of events passing the threshold of bin
+  unsigned long long passing(int bin) const {
+    unsigned long long sum = 0;
+    for (int b=nBins_-1; b>=bin; b--) sum += counts_[b];
+    return sum;
+  }
+
+  // write the (unnormalised) cumulative curve into hist, which must have
+  // the same binning this curve was booked with
+  void fillHist(TH1* hist) const {
+    unsigned long long sum = 0;
+    double entries = 0.;
+    // sumw, sumw2, sumwx, sumwx2 of one Fill(threshold) per passed threshold
+    double stats[4] = {0., 0., 0., 0.};
+    for (int bin=nBins_-1; bin>=0; bin--) {
+      sum += counts_[bin];
+      hist->SetBinContent(bin+1, sum);
+      entries += double(counts_[bin])*(bin+1);
+      double x = threshold(bin);
+      stats[0] += sum;
+      stats[2] += sum*x;
+      stats[3] += sum*x*x;
+    }
+    stats[1] = stats[0];
+    // same entries and (up to rounding) mean and RMS the per-threshold Fill() calls would give
+    hist->PutStats(stats);
+    hist->SetEntries(entries);
+  }
+
+private:
+  int nBins_;
+  float lo_;
+  float hi_;
+  float width_;
+  std::vector<unsigned long long> counts_;
+};
+
+#endif
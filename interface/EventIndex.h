@@ -0,0 +1,68 @@
+#ifndef HcalTrigger_Validation_EventIndex_h
+#define HcalTrigger_Validation_EventIndex_h
+
+#include <cstdint>
+#include <vector>
+
+// Open-addressing hash index from (run, lumi, event) to a tree entry.
+// A slot only holds a 64-bit fingerprint of the key and the entry number
+// (16 bytes), so a hit has to be confirmed by reading the event back.
+class EventIndex {
+public:
+  explicit EventIndex(long long nEvents) : nDuplicates_(0) {
+    // keep the load factor below 1/2
+    size_t size = 16;
+    while (size < 2*static_cast<size_t>(nEvents)) size *= 2;
+    mask_ = size-1;
+    slots_.resize(size);
+  }
+
+  static uint64_t key(unsigned run, unsigned lumi, unsigned long long event) {
+    return mix(mix(event) ^ ((static_cast<uint64_t>(run) << 32) | lumi));
+  }
+
+  // first occurrence of a key wins; later ones are only counted
+  void insert(uint64_t key, long long entry) {
+    for (size_t i = key & mask_; ; i = (i+1) & mask_) {
+      if (slots_[i].entry < 0) {
+        slots_[i].key = key;
+        slots_[i].entry = entry;
+        return;
+      }
+      if (slots_[i].key == key) {
+        ++nDuplicates_;
+        return;
+      }
+    }
+  }
+
+  // entry stored for key, -1 if there is none
+  long long find(uint64_t key) const {
+    for (size_t i = key & mask_; slots_[i].entry >= 0; i = (i+1) & mask_) {
+      if (slots_[i].key == key) return slots_[i].entry;
+    }
+    return -1;
+  }
+
+  long long nDuplicates() const { return nDuplicates_; }
+
+private:
+  // splitmix64 finaliser
+  static uint64_t mix(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  struct Slot {
+    Slot() : key(0), entry(-1) {}
+    uint64_t key;
+    long long entry;
+  };
+
+  size_t mask_;
+  std::vector<Slot> slots_;
+  long long nDuplicates_;
+};
+
+#endif
@@ -0,0 +1,397 @@
+#ifndef HcalTrigger_Validation_EventSkim_h
+#define HcalTrigger_Validation_EventSkim_h
+
+#include "HcalTrigger/Validation/interface/BatchHistogram.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Columnar per-event skim: one row per good event with a few derived
+// scalars, written once from the ntuples and memory-mapped afterwards, so
+// histograms with any binning or thresholds can be rebuilt in seconds.
+//
+// Layout (native byte order, everything 8-byte aligned):
+//   header    magic, version, nColumns, nEvents, nBlocks, spectraOffset,
+//             nSpectra, then per column a 32-char name and its type
+//   blocks    uint64 nRows, then per column nRows values, padded to 8 bytes
+//   spectra   32-char name, int32 nBins, float lo, float hi, float pad,
+//             nBins+2 uint64 counts (under/overflow included)
+//
+// L1 energies are multiples of 0.5 GeV, so kEt columns hold them exactly
+// as uint16 multiples of kEtLsb; other values are rounded to the nearest
+// multiple and counted in nRounded(). Absent values (no such object) are
+// stored as kEtAbsent or NaN and read back as NaN.
+enum SkimColumnType { kSkimEt, kSkimFloat, kSkimUInt32, kSkimUInt64 };
+
+struct SkimColumn {
+  std::string name;
+  SkimColumnType type;
+};
+
+namespace skim {
+  const char kMagic[8] = {'L', '1', 'S', 'K', 'I', 'M', '\0', '\0'};
+  const uint32_t kVersion = 1;
+  const int kNameSize = 32;
+  const double kEtLsb = 0.5;
+  const uint16_t kEtAbsent = 0xffff;
+  const size_t kBlockRows = 65536;
+
+  inline size_t typeSize(SkimColumnType type) {
+    return type == kSkimEt ? 2 : (type == kSkimUInt64 ? 8 : 4);
+  }
+
+  inline size_t padded(size_t bytes) { return (bytes+7) & ~size_t(7); }
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t nColumns;
+    uint64_t nEvents;
+    uint64_t nBlocks;
+    uint64_t spectraOffset;
+    uint32_t nSpectra;
+    uint32_t pad;
+  };
+
+  struct ColumnEntry {
+    char name[kNameSize];
+    uint32_t type;
+    uint32_t pad;
+  };
+
+  struct SpectrumEntry {
+    char name[kNameSize];
+    int32_t nBins;
+    float lo;
+    float hi;
+    float pad;
+  };
+}
+
+// Rows being collected for a SkimWriter, one set per thread. Values are
+// encoded on set, so a full set is appended with a few memcpy's.
+class SkimRows {
+public:
+  explicit SkimRows(const std::vector<SkimColumn>& columns)
+    : columns_(columns), data_(columns.size()), nRows_(0), nRounded_(0) {
+    for (size_t c=0; c<columns_.size(); c++) data_[c].resize(skim::kBlockRows*skim::typeSize(columns_[c].type));
+  }
+
+  // value of an energy or float column for the current row (NaN: absent)
+  void setValue(int column, double value) {
+    if (columns_[column].type == kSkimFloat) {
+      float v = value;
+      std::memcpy(&data_[column][nRows_*4], &v, 4);
+      return;
+    }
+    uint16_t q = skim::kEtAbsent;
+    if (!std::isnan(value)) {
+      double units = std::rint(value/skim::kEtLsb);
+      if (units*skim::kEtLsb != value) nRounded_++;
+      q = units < 0. ? 0 : (units >= skim::kEtAbsent ? skim::kEtAbsent-1 : static_cast<uint16_t>(units));
+    }
+    std::memcpy(&data_[column][nRows_*2], &q, 2);
+  }
+
+  void setInteger(int column, uint64_t value) {
+    if (columns_[column].type == kSkimUInt64) std::memcpy(&data_[column][nRows_*8], &value, 8);
+    else {
+      uint32_t v = value;
+      std::memcpy(&data_[column][nRows_*4], &v, 4);
+    }
+  }
+
+  // finish the current row; false once the set is full and must be appended
+  bool next() { return ++nRows_ < skim::kBlockRows; }
+
+  size_t size() const { return nRows_; }
+  size_t nRounded() const { return nRounded_; }
+  void clear() { nRows_ = 0; }
+
+private:
+  friend class SkimWriter;
+
+  std::vector<SkimColumn> columns_;
+  std::vector<std::vector<unsigned char> > data_;
+  size_t nRows_;
+  size_t nRounded_;
+};
+
+// Writes a skim. append() can be called from several threads; every call
+// becomes one block, so rows of one set stay together in the file.
+class SkimWriter {
+public:
+  SkimWriter(const std::string& fileName, const std::vector<SkimColumn>& columns)
+    : columns_(columns), file_(std::fopen(fileName.c_str(), "wb")), nEvents_(0), nBlocks_(0), nRounded_(0) {
+    if (!file_) return;
+    skim::Header header = makeHeader();
+    std::fwrite(&header, sizeof(header), 1, file_);
+    for (const SkimColumn& column : columns_) {
+      skim::ColumnEntry entry;
+      std::memset(&entry, 0, sizeof(entry));
+      std::strncpy(entry.name, column.name.c_str(), skim::kNameSize-1);
+      entry.type = column.type;
+      std::fwrite(&entry, sizeof(entry), 1, file_);
+    }
+  }
+
+  ~SkimWriter() { close(); }
+
+  bool good() const { return file_ != 0; }
+  const std::vector<SkimColumn>& columns() const { return columns_; }
+  uint64_t nEvents() const { return nEvents_; }
+  size_t nRounded() const { return nRounded_; }
+
+  // write the rows collected so far and clear them
+  void append(SkimRows& rows) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t nRows = rows.size();
+    nRounded_ += rows.nRounded_;
+    rows.nRounded_ = 0;
+    if (nRows == 0 || !file_) {
+      rows.clear();
+      return;
+    }
+    std::fwrite(&nRows, sizeof(nRows), 1, file_);
+    static const unsigned char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    for (size_t c=0; c<columns_.size(); c++) {
+      size_t bytes = nRows*skim::typeSize(columns_[c].type);
+      std::fwrite(rows.data_[c].data(), 1, bytes, file_);
+      std::fwrite(zeros, 1, skim::padded(bytes)-bytes, file_);
+    }
+    nEvents_ += nRows;
+    nBlocks_++;
+    rows.clear();
+  }
+
+  // spectra (TP energies) are stored as histograms; with a bin width of
+  // kEtLsb they can be rebinned exactly by SkimReader::addSpectrum()
+  void addSpectrum(const std::string& name, const BatchHistogram& spectrum) {
+    skim::SpectrumEntry entry;
+    std::memset(&entry, 0, sizeof(entry));
+    std::strncpy(entry.name, name.c_str(), skim::kNameSize-1);
+    entry.nBins = spectrum.nBins();
+    entry.lo = spectrum.lo();
+    entry.hi = spectrum.hi();
+    std::vector<uint64_t> counts;
+    for (int bin=0; bin<=spectrum.nBins()+1; bin++) counts.push_back(spectrum.counts(bin));
+    spectra_.push_back(std::make_pair(entry, counts));
+  }
+
+  // write the spectra and the final header
+  void close() {
+    if (!file_) return;
+    skim::Header header = makeHeader();
+    header.spectraOffset = std::ftell(file_);
+    header.nSpectra = spectra_.size();
+    for (const auto& spectrum : spectra_) {
+      std::fwrite(&spectrum.first, sizeof(spectrum.first), 1, file_);
+      std::fwrite(spectrum.second.data(), sizeof(uint64_t), spectrum.second.size(), file_);
+    }
+    std::fseek(file_, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, file_);
+    std::fclose(file_);
+    file_ = 0;
+  }
+
+private:
+  skim::Header makeHeader() const {
+    skim::Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, skim::kMagic, sizeof(header.magic));
+    header.version = skim::kVersion;
+    header.nColumns = columns_.size();
+    header.nEvents = nEvents_;
+    header.nBlocks = nBlocks_;
+    return header;
+  }
+
+  std::vector<SkimColumn> columns_;
+  FILE* file_;
+  uint64_t nEvents_;
+  uint64_t nBlocks_;
+  size_t nRounded_;
+  std::vector<std::pair<skim::SpectrumEntry, std::vector<uint64_t> > > spectra_;
+  std::mutex mutex_;
+};
+
+// Read-only view of a skim file through mmap. Columns are found by name
+// and read a block at a time.
+class SkimReader {
+public:
+  explicit SkimReader(const std::string& fileName) : base_(0), size_(0) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(skim::Header))) {
+      void* base = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (base != MAP_FAILED) {
+        base_ = static_cast<const unsigned char*>(base);
+        size_ = st.st_size;
+      }
+    }
+    ::close(fd);
+    if (base_ && !index()) {
+      munmap(const_cast<unsigned char*>(base_), size_);
+      base_ = 0;
+    }
+  }
+
+  ~SkimReader() {
+    if (base_) munmap(const_cast<unsigned char*>(base_), size_);
+  }
+
+  SkimReader(const SkimReader&) = delete;
+  SkimReader& operator=(const SkimReader&) = delete;
+
+  // true if fileName starts like a skim (so it is not read as an ntuple)
+  static bool isSkim(const std::string& fileName) {
+    char magic[8];
+    FILE* file = std::fopen(fileName.c_str(), "rb");
+    if (!file) return false;
+    bool ok = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+      && std::memcmp(magic, skim::kMagic, sizeof(magic)) == 0;
+    std::fclose(file);
+    return ok;
+  }
+
+  bool good() const { return base_ != 0; }
+  uint64_t nEvents() const { return header()->nEvents; }
+  size_t nBlocks() const { return blocks_.size(); }
+  size_t blockRows(size_t block) const { return blocks_[block].nRows; }
+
+  // index of the named column, -1 if the skim does not have it
+  int column(const std::string& name) const {
+    for (size_t c=0; c<columns_.size(); c++) {
+      if (name == columns_[c].name) return c;
+    }
+    return -1;
+  }
+
+  // decoded values of a column for one block (NaN: absent)
+  void values(size_t block, int column, std::vector<double>& out) const {
+    size_t n = blocks_[block].nRows;
+    out.resize(n);
+    const unsigned char* data = blocks_[block].columns[column];
+    if (columns_[column].type == kSkimEt) {
+      const uint16_t* q = reinterpret_cast<const uint16_t*>(data);
+      for (size_t i=0; i<n; i++) {
+        out[i] = q[i] == skim::kEtAbsent ? std::numeric_limits<double>::quiet_NaN() : q[i]*skim::kEtLsb;
+      }
+    }
+    else if (columns_[column].type == kSkimFloat) {
+      const float* f = reinterpret_cast<const float*>(data);
+      for (size_t i=0; i<n; i++) out[i] = f[i];
+    }
+    else {
+      std::vector<uint64_t> v;
+      integers(block, column, v);
+      for (size_t i=0; i<n; i++) out[i] = v[i];
+    }
+  }
+
+  void integers(size_t block, int column, std::vector<uint64_t>& out) const {
+    size_t n = blocks_[block].nRows;
+    out.resize(n);
+    const unsigned char* data = blocks_[block].columns[column];
+    if (columns_[column].type == kSkimUInt64) {
+      const uint64_t* v = reinterpret_cast<const uint64_t*>(data);
+      for (size_t i=0; i<n; i++) out[i] = v[i];
+    }
+    else {
+      const uint32_t* v = reinterpret_cast<const uint32_t*>(data);
+      for (size_t i=0; i<n; i++) out[i] = v[i];
+    }
+  }
+
+  // Add a stored spectrum into target, whose binning may differ. Each
+  // stored bin is added at its low edge, which is exact for values on
+  // the stored bin grid. False if the skim has no such spectrum.
+  bool addSpectrum(const std::string& name, BatchHistogram& target) const {
+    for (const Spectrum& spectrum : spectra_) {
+      if (name != spectrum.entry->name) continue;
+      const skim::SpectrumEntry& entry = *spectrum.entry;
+      double width = (double(entry.hi)-entry.lo)/entry.nBins;
+      target.fill(-std::numeric_limits<double>::infinity(), spectrum.counts[0]);
+      for (int bin=1; bin<=entry.nBins; bin++) target.fill(entry.lo + (bin-1)*width, spectrum.counts[bin]);
+      target.fill(std::numeric_limits<double>::infinity(), spectrum.counts[entry.nBins+1]);
+      return true;
+    }
+    return false;
+  }
+
+private:
+  struct Block {
+    size_t nRows;
+    std::vector<const unsigned char*> columns;
+  };
+
+  struct Spectrum {
+    const skim::SpectrumEntry* entry;
+    const uint64_t* counts;
+  };
+
+  const skim::Header* header() const { return reinterpret_cast<const skim::Header*>(base_); }
+
+  // locate the columns, blocks and spectra; false if the file is not a complete skim
+  bool index() {
+    const skim::Header* h = header();
+    if (std::memcmp(h->magic, skim::kMagic, sizeof(h->magic)) != 0 || h->version != skim::kVersion) return false;
+    size_t pos = sizeof(skim::Header);
+    if (pos + h->nColumns*sizeof(skim::ColumnEntry) > size_) return false;
+    const skim::ColumnEntry* entries = reinterpret_cast<const skim::ColumnEntry*>(base_+pos);
+    for (uint32_t c=0; c<h->nColumns; c++) {
+      SkimColumn column;
+      column.name = std::string(entries[c].name, strnlen(entries[c].name, skim::kNameSize));
+      column.type = static_cast<SkimColumnType>(entries[c].type);
+      columns_.push_back(column);
+    }
+    pos += h->nColumns*sizeof(skim::ColumnEntry);
+
+    uint64_t nEvents = 0;
+    for (uint64_t b=0; b<h->nBlocks; b++) {
+      if (pos + 8 > size_) return false;
+      Block block;
+      block.nRows = *reinterpret_cast<const uint64_t*>(base_+pos);
+      pos += 8;
+      for (const SkimColumn& column : columns_) {
+        block.columns.push_back(base_+pos);
+        pos += skim::padded(block.nRows*skim::typeSize(column.type));
+      }
+      if (pos > size_) return false;
+      nEvents += block.nRows;
+      blocks_.push_back(block);
+    }
+    if (nEvents != h->nEvents || pos != h->spectraOffset) return false;
+
+    for (uint32_t s=0; s<h->nSpectra; s++) {
+      if (pos + sizeof(skim::SpectrumEntry) > size_) return false;
+      Spectrum spectrum;
+      spectrum.entry = reinterpret_cast<const skim::SpectrumEntry*>(base_+pos);
+      pos += sizeof(skim::SpectrumEntry);
+      spectrum.counts = reinterpret_cast<const uint64_t*>(base_+pos);
+      pos += (spectrum.entry->nBins+2)*sizeof(uint64_t);
+      if (pos > size_) return false;
+      spectra_.push_back(spectrum);
+    }
+    return true;
+  }
+
+  const unsigned char* base_;
+  size_t size_;
+  std::vector<SkimColumn> columns_;
+  std::vector<Block> blocks_;
+  std::vector<Spectrum> spectra_;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef HcalTrigger_Validation_ExactRate_h
+#define HcalTrigger_Validation_ExactRate_h
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+class ExactRateCurve;
+
+// Sorted, run-length compressed values of one quantity, answering rate
+// queries at any threshold without binning. L1 energies are multiples of
+// 0.5 GeV, so they are counted in a dense array indexed by value/0.5;
+// anything else (including negative values) goes into an ordered map, so
+// the result is exact for every input.
+class ExactRate {
+public:
+  void fill(double value) {
+    double units = value/kLsb;
+    if (units >= 0. && units < kMaxUnits && units == std::floor(units)) {
+      size_t q = units;
+      if (q >= grid_.size()) grid_.resize(q+1, 0);
+      ++grid_[q];
+    }
+    else if (!std::isnan(value)) ++offGrid_[value];
+  }
+
+  void add(const ExactRate& other) {
+    if (other.grid_.size() > grid_.size()) grid_.resize(other.grid_.size(), 0);
+    for (size_t q=0; q<other.grid_.size(); q++) grid_[q] += other.grid_[q];
+    for (const auto& value : other.offGrid_) offGrid_[value.first] += value.second;
+  }
+
+  inline ExactRateCurve curve() const;
+
+private:
+  static constexpr double kLsb = 0.5;
+  static constexpr double kMaxUnits = 1 << 20;
+
+  std::vector<long long> grid_;
+  std::map<double, long long> offGrid_;
+};
+
+// The distinct values in ascending order with the number of events at or
+// above each, so passing(threshold) is a binary search.
+class ExactRateCurve {
+public:
+  size_t size() const { return values_.size(); }
+  double value(size_t i) const { return values_[i]; }
+  // events with a value >= value(i)
+  long long passing(size_t i) const { return passing_[i]; }
+  long long nEvents() const { return passing_.empty() ? 0 : passing_[0]; }
+
+  // events with a value >= threshold
+  long long passing(double threshold) const {
+    size_t i = std::lower_bound(values_.begin(), values_.end(), threshold) - values_.begin();
+    return i < values_.size() ? passing_[i] : 0;
+  }
+
+  // Lowest observed value t with passing(t) <= maxPassing. Every threshold
+  // in (previous value, t] gives the same count. NaN if every threshold
+  // passes at most maxPassing events.
+  double threshold(long long maxPassing) const {
+    size_t i = std::lower_bound(passing_.begin(), passing_.end(), maxPassing, std::greater<long long>()) - passing_.begin();
+    if (i == 0) return std::nan("");
+    return i < values_.size() ? values_[i] : std::nextafter(values_.back(), HUGE_VAL);
+  }
+
+private:
+  friend class ExactRate;
+
+  std::vector<double> values_;
+  std::vector<long long> passing_;
+};
+
+ExactRateCurve ExactRate::curve() const
+{
+  std::vector<std::pair<double, long long> > counts(offGrid_.begin(), offGrid_.end());
+  for (size_t q=0; q<grid_.size(); q++) {
+    if (grid_[q] > 0) counts.push_back(std::make_pair(q*kLsb, grid_[q]));
+  }
+  std::sort(counts.begin(), counts.end());
+
+  ExactRateCurve result;
+  result.values_.resize(counts.size());
+  result.passing_.resize(counts.size());
+  long long sum = 0;
+  for (size_t i=counts.size(); i-- > 0;) {
+    sum += counts[i].second;
+    result.values_[i] = counts[i].first;
+    result.passing_[i] = sum;
+  }
+  return result;
+}
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef HcalTrigger_Validation_FixedHist_h
+#define HcalTrigger_Validation_FixedHist_h
+
+#include "TH1F.h"
+#include "TH2F.h"
+
+#include <algorithm>
+#include <vector>
+
+// NBins equal bins from Lo/Den to Hi/Den, known at compile time so the bin
+// of a value is a few inline instructions; Den gives edges that are not
+// integers, e.g. FixedBinning<100, -1, 199, 2> for -0.5 to 99.5. bin() is
+// TAxis::FindBin for fixed bins: 0 below lo(), NBins+1 at or above hi() and
+// for NaN.
+template <int NBins, int Lo, int Hi, int Den = 1>
+struct FixedBinning {
+  static_assert(Den > 0 && Lo < Hi, "FixedBinning needs Lo < Hi and Den > 0");
+  static const int nBins = NBins;
+  static constexpr double lo() { return double(Lo)/Den; }
+  static constexpr double hi() { return double(Hi)/Den; }
+
+  static int bin(double x) {
+    if (x < lo()) return 0;
+    if (!(x < hi())) return NBins+1;
+    return 1 + static_cast<int>(NBins*(x-lo())/(hi()-lo()));
+  }
+  static bool inRange(int bin) { return bin >= 1 && bin <= NBins; }
+};
+
+// 1D histogram with 64-bit integer counts for the per-event fills of the
+// event loop, converted to a TH1F only when written. Under/overflow and the
+// stored statistics follow TH1::Fill, so fillHist() gives the histogram
+// TH1F::Fill would have, except that the counts cannot saturate at 2^24.
+// Constructed with a name, it also books that histogram in the current
+// directory.
+template <class Binning>
+class FixedHist {
+public:
+  FixedHist() : counts_(Binning::nBins+2, 0), sumx_(0.), sumx2_(0.), hist_(0) {}
+  FixedHist(const char* name, const char* title) : FixedHist() { hist_ = book(name, title); }
+
+  // an empty TH1F with this binning, in the current directory
+  static TH1F* book(const char* name, const char* title) {
+    return new TH1F(name, title, Binning::nBins, Binning::lo(), Binning::hi());
+  }
+
+  TH1F* hist() const { return hist_; }
+
+  void fill(double x) {
+    int bin = Binning::bin(x);
+    ++counts_[bin];
+    if (Binning::inRange(bin)) {
+      sumx_ += x;
+      sumx2_ += x*x;
+    }
+  }
+
+  void add(const FixedHist& other) {
+    for (size_t bin=0; bin<counts_.size(); bin++) counts_[bin] += other.counts_[bin];
+    sumx_ += other.sumx_;
+    sumx2_ += other.sumx2_;
+  }
+
+  // add the contents of a histogram written by fillHist()
+  void add(const TH1* hist) {
+    for (int bin=0; bin<=Binning::nBins+1; bin++) counts_[bin] += static_cast<unsigned long long>(hist->GetBinContent(bin));
+    double stats[4] = {0., 0., 0., 0.};
+    hist->GetStats(stats);
+    sumx_ += stats[2];
+    sumx2_ += stats[3];
+  }
+
+  void reset() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    sumx_ = sumx2_ = 0.;
+  }
+
+  // counts in bin (0: underflow, nBins+1: overflow)
+  unsigned long long counts(int bin) const { return counts_[bin]; }
+
+  // write the counts into hist, which must have the same binning
+  void fillHist(TH1* hist) const {
+    double entries = 0.;
+    double inRange = 0.;
+    for (int bin=0; bin<=Binning::nBins+1; bin++) {
+      double n = counts_[bin];
+      hist->SetBinContent(bin, n);
+      entries += n;
+      if (Binning::inRange(bin)) inRange += n;
+    }
+    double stats[4] = {inRange, inRange, sumx_, sumx2_};
+    hist->PutStats(stats);
+    hist->SetEntries(entries);
+  }
+  void fillHist() const { fillHist(hist_); }
+
+private:
+  std::vector<unsigned long long> counts_;
+  double sumx_;
+  double sumx2_;
+  TH1F* hist_;
+};
+
+// The same for a 2D histogram and TH2::Fill, converted to a TH2F. Counts
+// are stored in the global bin order of TH2.
+template <class XBinning, class YBinning>
+class FixedHist2D {
+public:
+  FixedHist2D() : counts_((XBinning::nBins+2)*(YBinning::nBins+2), 0), hist_(0) { std::fill(sums_, sums_+5, 0.); }
+  FixedHist2D(const char* name, const char* title) : FixedHist2D() { hist_ = book(name, title); }
+
+  static TH2F* book(const char* name, const char* title) {
+    return new TH2F(name, title, XBinning::nBins, XBinning::lo(), XBinning::hi(),
+		    YBinning::nBins, YBinning::lo(), YBinning::hi());
+  }
+
+  TH2F* hist() const { return hist_; }
+
+  void fill(double x, double y) {
+    int binx = XBinning::bin(x);
+    int biny = YBinning::bin(y);
+    ++counts_[globalBin(binx, biny)];
+    if (XBinning::inRange(binx) && YBinning::inRange(biny)) {
+      sums_[0] += x;
+      sums_[1] += x*x;
+      sums_[2] += y;
+      sums_[3] += y*y;
+      sums_[4] += x*y;
+    }
+  }
+
+  void add(const FixedHist2D& other) {
+    for (size_t bin=0; bin<counts_.size(); bin++) counts_[bin] += other.counts_[bin];
+    for (int s=0; s<5; s++) sums_[s] += other.sums_[s];
+  }
+
+  void add(const TH2* hist) {
+    for (size_t bin=0; bin<counts_.size(); bin++) counts_[bin] += static_cast<unsigned long long>(hist->GetBinContent(bin));
+    double stats[7] = {0., 0., 0., 0., 0., 0., 0.};
+    hist->GetStats(stats);
+    for (int s=0; s<5; s++) sums_[s] += stats[s+2];
+  }
+
+  void reset() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    std::fill(sums_, sums_+5, 0.);
+  }
+
+  unsigned long long counts(int binx, int biny) const { return counts_[globalBin(binx, biny)]; }
+
+  void fillHist(TH2* hist) const {
+    double entries = 0.;
+    double inRange = 0.;
+    for (int biny=0; biny<=YBinning::nBins+1; biny++) {
+      for (int binx=0; binx<=XBinning::nBins+1; binx++) {
+	double n = counts_[globalBin(binx, biny)];
+	hist->SetBinContent(globalBin(binx, biny), n);
+	entries += n;
+	if (XBinning::inRange(binx) && YBinning::inRange(biny)) inRange += n;
+      }
+    }
+    double stats[7] = {inRange, inRange, sums_[0], sums_[1], sums_[2], sums_[3], sums_[4]};
+    hist->PutStats(stats);
+    hist->SetEntries(entries);
+  }
+  void fillHist() const { fillHist(hist_); }
+
+private:
+  static int globalBin(int binx, int biny) { return binx + (XBinning::nBins+2)*biny; }
+
+  std::vector<unsigned long long> counts_;
+  double sums_[5];  // x, x^2, y, y^2, xy of the in-range fills
+  TH2F* hist_;
+};
+
+#endif
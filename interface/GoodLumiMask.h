@@ -0,0 +1,91 @@
+#ifndef HcalTrigger_Validation_GoodLumiMask_h
+#define HcalTrigger_Validation_GoodLumiMask_h
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Certified lumi sections from a CMS good-run JSON,
+//   {"302472": [[1, 50], [60, 100]], ...}
+// compiled into one bitmap per run, so a lookup is a hash of the run and
+// a bit test. Lookups do not modify the mask and can be done from any thread.
+class GoodLumiMask {
+public:
+  bool empty() const { return runs_.empty(); }
+
+  // false if the file cannot be read or is not a run -> LS ranges object
+  bool load(const std::string& fileName) {
+    std::ifstream in(fileName.c_str());
+    if (!in) return false;
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string json = buffer.str();
+
+    size_t pos = 0;
+    while ((pos = json.find('"', pos)) != std::string::npos) {
+      size_t end = json.find('"', pos+1);
+      if (end == std::string::npos) return false;
+      unsigned run = std::strtoul(json.substr(pos+1, end-pos-1).c_str(), 0, 10);
+
+      // all numbers up to the bracket closing this run's list are range bounds
+      size_t i = json.find('[', end);
+      if (i == std::string::npos) return false;
+      int depth = 0;
+      std::vector<unsigned> bounds;
+      for (; i<json.size(); i++) {
+        if (json[i] == '[') depth++;
+        else if (json[i] == ']') {
+          if (--depth == 0) break;
+        }
+        else if (std::isdigit(static_cast<unsigned char>(json[i]))) {
+          char* next;
+          bounds.push_back(std::strtoul(json.c_str()+i, &next, 10));
+          i = next-json.c_str()-1;
+        }
+      }
+      if (depth != 0 || bounds.size()%2 != 0) return false;
+      for (size_t b=0; b<bounds.size(); b+=2) addRange(run, bounds[b], bounds[b+1]);
+      pos = i+1;
+    }
+    return true;
+  }
+
+  void addRange(unsigned run, unsigned first, unsigned last) {
+    std::vector<uint64_t>& bits = runs_[run];
+    if (bits.size() <= last/64) bits.resize(last/64+1, 0);
+    for (unsigned lumi=first; lumi<=last; lumi++) bits[lumi/64] |= uint64_t(1) << (lumi%64);
+  }
+
+  bool contains(unsigned run, unsigned lumi) const {
+    std::unordered_map<unsigned, std::vector<uint64_t> >::const_iterator it = runs_.find(run);
+    if (it == runs_.end() || lumi/64 >= it->second.size()) return false;
+    return (it->second[lumi/64] >> (lumi%64)) & 1;
+  }
+
+  // FNV-1a over the runs in order and their bitmaps; equal for equal masks
+  uint64_t checksum() const {
+    std::vector<unsigned> runs;
+    for (const auto& run : runs_) runs.push_back(run.first);
+    std::sort(runs.begin(), runs.end());
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned run : runs) {
+      const std::vector<uint64_t>& bits = runs_.at(run);
+      size_t used = bits.size();
+      while (used > 0 && bits[used-1] == 0) --used;
+      hash = (hash ^ run) * 1099511628211ULL;
+      for (size_t w=0; w<used; w++) hash = (hash ^ bits[w]) * 1099511628211ULL;
+    }
+    return hash;
+  }
+
+private:
+  std::unordered_map<unsigned, std::vector<uint64_t> > runs_;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef HcalTrigger_Validation_JetMatcher_h
+#define HcalTrigger_Validation_JetMatcher_h
+
+#include "TMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// phi1 - phi2 wrapped into [-pi, pi]
+inline double deltaPhi(double phi1, double phi2) {
+  double result = phi1 - phi2;
+  if(fabs(result) > 9999) return result;
+  return result - TMath::TwoPi()*std::rint(result/TMath::TwoPi());
+}
+
+inline double deltaR(double eta1, double phi1, double eta2, double phi2) {
+  double deta = eta1 - eta2;
+  double dphi = deltaPhi(phi1, phi2);
+  return sqrt(deta*deta + dphi*dphi);
+}
+
+// Matches offline jets to L1 jets within maxDR of each other. The L1 jets
+// are sorted into an eta-phi grid of cells at least maxDR wide, so each
+// offline jet is only compared with the L1 jets of the 3x3 cells around
+// its own. The candidate pairs are then assigned closest first, each jet
+// used at most once, ties going to the lower offline and then L1 index,
+// so the result does not depend on the order the jets are stored in. The
+// buffers are kept from event to event.
+class JetMatcher {
+public:
+  explicit JetMatcher(double maxDR = 0.5)
+    : maxDR_(maxDR), nEta_(std::max(1, int(2*kEtaMax/maxDR))), nPhi_(std::max(1, int(TMath::TwoPi()/maxDR))) {}
+
+  // for each of the offline jets refJets the index of its L1 jet, -1 if none
+  const std::vector<int>& match(const std::vector<float>& refEta, const std::vector<float>& refPhi,
+				const std::vector<int>& refJets,
+				const std::vector<float>& l1Eta, const std::vector<float>& l1Phi, unsigned nL1) {
+    fillGrid(l1Eta, l1Phi, nL1);
+
+    pairs_.clear();
+    for (unsigned r=0; r<refJets.size(); r++) {
+      double eta = refEta[refJets[r]];
+      double phi = refPhi[refJets[r]];
+      int etaCell = this->etaCell(eta);
+      int phiCell = this->phiCell(phi);
+      for (int e=std::max(0, etaCell-1); e<=std::min(nEta_-1, etaCell+1); e++) {
+	for (int dp=-1; dp<=1; dp++) {
+	  // with fewer than three phi cells, each is visited once
+	  if (nPhi_ < 3 && dp != 0 && (nPhi_ == 1 || dp == 1)) continue;
+	  int cell = e*nPhi_ + (phiCell+dp+nPhi_) % nPhi_;
+	  for (int i=cellStart_[cell]; i<cellStart_[cell+1]; i++) {
+	    int l = order_[i];
+	    double dR = deltaR(eta, phi, l1Eta[l], l1Phi[l]);
+	    if (dR < maxDR_) pairs_.push_back(Pair(dR, r, l));
+	  }
+	}
+      }
+    }
+    std::sort(pairs_.begin(), pairs_.end());
+
+    matched_.assign(refJets.size(), -1);
+    l1Used_.assign(nL1, false);
+    for (const Pair& pair : pairs_) {
+      if (matched_[pair.ref] >= 0 || l1Used_[pair.l1]) continue;
+      matched_[pair.ref] = pair.l1;
+      l1Used_[pair.l1] = true;
+    }
+    return matched_;
+  }
+
+private:
+  static constexpr double kEtaMax = 5.5;
+
+  struct Pair {
+    Pair(double dR_, int ref_, int l1_) : dR(dR_), ref(ref_), l1(l1_) {}
+    bool operator<(const Pair& other) const {
+      if (dR != other.dR) return dR < other.dR;
+      if (ref != other.ref) return ref < other.ref;
+      return l1 < other.l1;
+    }
+    double dR;
+    int ref, l1;
+  };
+
+  // jets beyond |eta| = kEtaMax go to the outermost cells
+  int etaCell(double eta) const {
+    int cell = int((eta + kEtaMax)*nEta_/(2*kEtaMax));
+    return std::min(std::max(cell, 0), nEta_-1);
+  }
+  int phiCell(double phi) const {
+    double wrapped = phi - TMath::TwoPi()*std::floor(phi/TMath::TwoPi());
+    return std::min(int(wrapped*nPhi_/TMath::TwoPi()), nPhi_-1);
+  }
+
+  // counting sort of the L1 jets by cell
+  void fillGrid(const std::vector<float>& l1Eta, const std::vector<float>& l1Phi, unsigned nL1) {
+    cellStart_.assign(nEta_*nPhi_+1, 0);
+    cells_.resize(nL1);
+    for (unsigned l=0; l<nL1; l++) {
+      cells_[l] = etaCell(l1Eta[l])*nPhi_ + phiCell(l1Phi[l]);
+      cellStart_[cells_[l]+1]++;
+    }
+    for (size_t c=1; c<cellStart_.size(); c++) cellStart_[c] += cellStart_[c-1];
+    order_.resize(nL1);
+    next_.assign(cellStart_.begin(), cellStart_.end()-1);
+    for (unsigned l=0; l<nL1; l++) order_[next_[cells_[l]]++] = l;
+  }
+
+  double maxDR_;
+  int nEta_, nPhi_;
+  std::vector<int> cellStart_, cells_, order_, next_;
+  std::vector<Pair> pairs_;
+  std::vector<int> matched_;
+  std::vector<bool> l1Used_;
+};
+
+#endif
@@ -0,0 +1,406 @@
+#ifndef HcalTrigger_Validation_JetQuantities_h
+#define HcalTrigger_Validation_JetQuantities_h
+
+#include "TMath.h"
+#include "TH1F.h"
+#include "TH2F.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisL1UpgradeDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoJetDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoMetDataFormat.h"
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisRecoMetFilterDataFormat.h"
+
+#include "HcalTrigger/Validation/interface/FixedHist.h"
+#include "HcalTrigger/Validation/interface/JetMatcher.h"
+#include "HcalTrigger/Validation/interface/L1UpgradeColumns.h"
+#include "HcalTrigger/Validation/interface/QuantileSketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// The per-event quantities and histograms of the jet and MET efficiency
+// and resolution analysis, shared by l1jetanalysis.exe and the analysis
+// module of l1validation.exe.
+
+// an offline jet above 10 GeV and the L1 jet matched to it (NaN: none)
+struct JetPair {
+  float refEt, refEta;
+  float l1Et, l1Eta;
+};
+
+// what the histograms are filled from, per good event; NaN where there is
+// no such object (and for the reco quantities without hasReco)
+struct JetEventQuantities {
+  JetEventQuantities();
+
+  float jetEt[4];
+  double etSum, metSum, metHFSum, htSum, mhtSum;
+  bool hasReco;
+  bool metFilters;  // recommended MET filters passed
+  float caloMet;
+  std::vector<JetPair> jetPairs;  // every offline jet above 10 GeV, leading first
+};
+
+inline JetEventQuantities::JetEventQuantities()
+  : etSum(0.), metSum(0.), metHFSum(0.), htSum(0.), mhtSum(0.), hasReco(false), metFilters(false)
+{
+  float nan = std::nanf("");
+  std::fill(jetEt, jetEt+4, nan);
+  caloMet = nan;
+}
+
+// get jetEt*, htSum, mhtSum, etSum, metSum
+// ALL EMU OBJECTS HAVE BX=0...
+inline void l1Quantities(const L1UpgradeColumns* l1emu_, JetEventQuantities& q)
+{
+  for (unsigned c=0; c<4 && c<l1emu_->nJets; c++) q.jetEt[c] = l1emu_->jetEt[c];
+
+  for (unsigned int c=0; c<l1emu_->nSums; c++){
+      if( l1emu_->sumBx[c] != 0 ) continue;
+      if( l1emu_->sumType[c] == L1Analysis::kTotalEt ) q.etSum = l1emu_->sumEt[c];
+      if( l1emu_->sumType[c] == L1Analysis::kTotalHt ) q.htSum = l1emu_->sumEt[c];
+      if( l1emu_->sumType[c] == L1Analysis::kMissingEt ) q.metSum = l1emu_->sumEt[c];
+      if( l1emu_->sumType[c] == L1Analysis::kMissingEtHF ) q.metHFSum = l1emu_->sumEt[c];
+      if( l1emu_->sumType[c] == L1Analysis::kMissingHt ) q.mhtSum = l1emu_->sumEt[c];
+  }
+}
+
+// MET filters, calo MET, and the offline jets with their matched L1 jets
+inline void recoQuantities(const L1UpgradeColumns* l1emu_, const L1Analysis::L1AnalysisRecoJetDataFormat* jet_,
+			   const L1Analysis::L1AnalysisRecoMetDataFormat* met_,
+			   const L1Analysis::L1AnalysisRecoMetFilterDataFormat* metfilter_, JetMatcher& matcher,
+			   JetEventQuantities& q)
+{
+  q.hasReco = true;
+  // apply recommended MET filters
+  q.metFilters = metfilter_->muonBadTrackFilter && metfilter_->badPFMuonFilter && metfilter_->badChCandFilter;
+  q.caloMet = met_->caloMet;
+
+  // offline jets above 10 GeV, highest ET first (the lower index on ties)
+  std::vector<int> refJets;
+  for (unsigned int i = 0; i < jet_->nJets; ++i) {
+    if (jet_->etCorr[i] > 10.) refJets.push_back(i);
+  }
+  std::stable_sort(refJets.begin(), refJets.end(),
+		   [jet_](int a, int b) { return jet_->etCorr[a] > jet_->etCorr[b]; });
+  if (refJets.empty()) return;
+
+  // matched L1 jets
+  const std::vector<int>& l1Jets = matcher.match(jet_->eta, jet_->phi, refJets,
+						 l1emu_->jetEta, l1emu_->jetPhi, l1emu_->nJets);
+  float nan = std::nanf("");
+  q.jetPairs.resize(refJets.size());
+  for (size_t p=0; p<refJets.size(); p++) {
+    JetPair& pair = q.jetPairs[p];
+    pair.refEt = jet_->etCorr[refJets[p]];
+    pair.refEta = jet_->eta[refJets[p]];
+    pair.l1Et = l1Jets[p] < 0 ? nan : float(l1emu_->jetEt[l1Jets[p]]);
+    pair.l1Eta = l1Jets[p] < 0 ? nan : float(l1emu_->jetEta[l1Jets[p]]);
+  }
+}
+
+// jet ET, MET and MHT bins (GeV)
+typedef FixedBinning<500, 0, 500> JetEtBinning;
+typedef FixedBinning<500, 0, 500> MetSumBinning;
+typedef FixedBinning<500, 0, 500> MhtSumBinning;
+typedef FixedBinning<800, 0, 800> HtSumBinning;
+typedef FixedBinning<1000, 0, 1000> EtSumBinning;
+// (L1-offline)/offline
+typedef FixedBinning<100, -5, 5> ResBinning;
+// offline jet ET and MET of the response stores, in the bins the plots use
+typedef FixedBinning<250, 0, 500> RespJetEtBinning;
+typedef FixedBinning<100, 0, 500> RespMetBinning;
+// L1 ET and MET are multiples of 0.5 GeV, so each of these bins holds a
+// single value and "L1 > threshold" is exact for thresholds on that grid
+typedef FixedBinning<1000, 0, 500> L1EtBinning;
+
+// L1 response stores: offline vs L1 ET of the leading offline jet, per
+// |eta| region of the offline jet, and offline vs L1 MET. Unmatched jets
+// are in the L1 underflow. The turn-on for any threshold is the sum over
+// the L1 bins above it, see draw_l1analysis. Only the leading jet is
+// stored, like the jetET* efficiencies these turn-ons replace; the other
+// matched jets are in the *AllJet* histograms.
+enum JetRegion { kJetHB, kJetHE, kJetHF, kNJetRegions };
+
+inline JetRegion jetRegion(double eta)
+{
+  if (fabs(eta)<=1.305) return kJetHB;
+  if (fabs(eta)<=3.0) return kJetHE;
+  return kJetHF;
+}
+
+// The L1 distributions, efficiency numerators/denominators and resolution
+// histograms, booked in the current directory. The event loop only counts;
+// fillHists() copies the counts into the histograms.
+class JetHistograms {
+public:
+  explicit JetHistograms(const SketchBinning& sketchBinning = SketchBinning());
+  void fill(const JetEventQuantities& q);
+  void fillHists();
+  void reset();
+  // add the contents of the histograms to the counts, e.g. totals read from a cache
+  void addHists();
+  // in the current directory, in the order l1jetanalysis always wrote them
+  void write();
+
+  // efficiencies and L1 jets
+  FixedHist<JetEtBinning> refJetET, refmJetET;
+  FixedHist<JetEtBinning> jetET50, jetET64, jetET76, jetET92, jetET112, jetET180;
+  FixedHist<JetEtBinning> l1jetET1, l1jetET2, l1jetET3, l1jetET4;
+  FixedHist<MetSumBinning> refMET, MET_100U, MET_70U, MET_40U, MET_30U, MET_50U;
+  // L1 sums
+  FixedHist<EtSumBinning> l1ET;
+  FixedHist<MetSumBinning> l1MET, l1METHF;
+  FixedHist<HtSumBinning> l1HT;
+  FixedHist<MhtSumBinning> l1MHT;
+  // resolutions
+  FixedHist2D<JetEtBinning, ResBinning> hresJet;
+  FixedHist2D<MetSumBinning, ResBinning> hresMET;
+  FixedHist2D<JetEtBinning, ResBinning> hresJet_hb, hresJet_he, hresJet_hf;
+  FixedHist<ResBinning> h_resMET1, h_resMET2, h_resMET3, h_resMET4, h_resMET5,
+    h_resMET6, h_resMET7, h_resMET8, h_resMET9, h_resMET10;
+  FixedHist<ResBinning> h_resJet1, h_resJet2, h_resJet3, h_resJet4, h_resJet5,
+    h_resJet6, h_resJet7, h_resJet8, h_resJet9, h_resJet10;
+  // efficiencies and resolution of every matched offline jet, not only the leading one
+  FixedHist<JetEtBinning> refAllJetET, refmAllJetET;
+  FixedHist<JetEtBinning> allJetET50, allJetET64, allJetET76, allJetET92, allJetET112, allJetET180;
+  FixedHist2D<JetEtBinning, ResBinning> hresAllJet, hresAllJet_hb, hresAllJet_he, hresAllJet_hf;
+  // responses of the leading jet and of MET, for turn-ons at any threshold
+  FixedHist2D<RespJetEtBinning, L1EtBinning> respLeadJet[kNJetRegions];
+  FixedHist2D<RespMetBinning, L1EtBinning> respMET;
+  // L1/offline ratio of the leading jet per |eta| region, and of MET
+  ResolutionSketch sketchLeadJet[kNJetRegions];
+  ResolutionSketch sketchMET;
+
+private:
+  // f(h) for every histogram, in the order they are written
+  template <class F> void forEach(F f);
+};
+
+// booked in the order of the members, which is the order l1jetanalysis
+// always booked them in
+inline JetHistograms::JetHistograms(const SketchBinning& sketchBinning)
+  : refJetET("RefJet", "all Jet1 E_{T} (GeV)"),
+    refmJetET("RefmJet", "all matched Jet1 E_{T} (GeV)"),
+    jetET50("JetEt50", ";E_{T} (GeV);events/bin"),
+    jetET64("JetEt64", ";E_{T} (GeV);events/bin"),
+    jetET76("JetEt76", ";E_{T} (GeV);events/bin"),
+    jetET92("JetEt92", ";E_{T} (GeV);events/bin"),
+    jetET112("JetEt112", ";E_{T} (GeV);events/bin"),
+    jetET180("JetEt180", ";E_{T} (GeV);events/bin"),
+    l1jetET1("singleJet", ";E_{T} (GeV);events/bin"),
+    l1jetET2("doubleJet", ";E_{T} (GeV);events/bin"),
+    l1jetET3("tripleJet", ";E_{T} (GeV);events/bin"),
+    l1jetET4("quadJet", ";E_{T} (GeV);events/bin"),
+    refMET("RefMET", ";MET (GeV);events/bin"),
+    MET_100U("MET100", ";MET (GeV);events/bin"),
+    MET_70U("MET70", ";MET (GeV);events/bin"),
+    MET_40U("MET40", ";MET (GeV);events/bin"),
+    MET_30U("MET30", ";MET (GeV);events/bin"),
+    MET_50U("MET50", ";MET (GeV);events/bin"),
+    l1ET("etSum", "L1 sumET (GeV)"),
+    l1MET("metSum", "L1 MET (GeV)"),
+    l1METHF("metHFSum", "L1 METHF (GeV)"),
+    l1HT("htSum", "L1 HT (GeV)"),
+    l1MHT("mhtSum", "L1 MHT (GeV)"),
+    hresJet("hresJet", ""),
+    hresMET("hResMET", ""),
+    hresJet_hb("hresJet_hb", ""),
+    hresJet_he("hresJet_he", ""),
+    hresJet_hf("hresJet_hf", ""),
+    h_resMET1("hresMET1", ""), h_resMET2("hresMET2", ""), h_resMET3("hresMET3", ""),
+    h_resMET4("hresMET4", ""), h_resMET5("hresMET5", ""), h_resMET6("hresMET6", ""),
+    h_resMET7("hresMET7", ""), h_resMET8("hresMET8", ""), h_resMET9("hresMET9", ""),
+    h_resMET10("hresMET10", ""),
+    h_resJet1("hresJet1", ""), h_resJet2("hresJet2", ""), h_resJet3("hresJet3", ""),
+    h_resJet4("hresJet4", ""), h_resJet5("hresJet5", ""), h_resJet6("hresJet6", ""),
+    h_resJet7("hresJet7", ""), h_resJet8("hresJet8", ""), h_resJet9("hresJet9", ""),
+    h_resJet10("hresJet10", ""),
+    refAllJetET("RefAllJet", "all offline jets E_{T} (GeV)"),
+    refmAllJetET("RefmAllJet", "all matched offline jets E_{T} (GeV)"),
+    allJetET50("AllJetEt50", ";E_{T} (GeV);jets/bin"),
+    allJetET64("AllJetEt64", ";E_{T} (GeV);jets/bin"),
+    allJetET76("AllJetEt76", ";E_{T} (GeV);jets/bin"),
+    allJetET92("AllJetEt92", ";E_{T} (GeV);jets/bin"),
+    allJetET112("AllJetEt112", ";E_{T} (GeV);jets/bin"),
+    allJetET180("AllJetEt180", ";E_{T} (GeV);jets/bin"),
+    hresAllJet("hresAllJet", ""),
+    hresAllJet_hb("hresAllJet_hb", ""),
+    hresAllJet_he("hresAllJet_he", ""),
+    hresAllJet_hf("hresAllJet_hf", ""),
+    respLeadJet{{"respLeadJet_hb", ";offline leading jet E_{T} (GeV);L1 jet E_{T} (GeV)"},
+		{"respLeadJet_he", ";offline leading jet E_{T} (GeV);L1 jet E_{T} (GeV)"},
+		{"respLeadJet_hf", ";offline leading jet E_{T} (GeV);L1 jet E_{T} (GeV)"}},
+    respMET("respMET", ";offline MET (GeV);L1 MET (GeV)"),
+    sketchLeadJet{{"sketchLeadJet_hb", ";offline leading jet E_{T} (GeV);L1/offline bucket", sketchBinning},
+		  {"sketchLeadJet_he", ";offline leading jet E_{T} (GeV);L1/offline bucket", sketchBinning},
+		  {"sketchLeadJet_hf", ";offline leading jet E_{T} (GeV);L1/offline bucket", sketchBinning}},
+    sketchMET("sketchMET", ";offline MET (GeV);L1/offline bucket", sketchBinning)
+{
+}
+
+// everything is filled from the per-event quantities, so the same code
+// serves the ntuples and a skim
+inline void JetHistograms::fill(const JetEventQuantities& q)
+{
+  if (!std::isnan(q.jetEt[0])) l1jetET1.fill(q.jetEt[0]);
+  if (!std::isnan(q.jetEt[1])) l1jetET2.fill(q.jetEt[1]);
+  if (!std::isnan(q.jetEt[2])) l1jetET3.fill(q.jetEt[2]);
+  if (!std::isnan(q.jetEt[3])) l1jetET4.fill(q.jetEt[3]);
+
+  l1ET.fill(q.etSum);
+  l1MET.fill(q.metSum);
+  l1METHF.fill(q.metHFSum);
+  l1HT.fill(q.htSum);
+  l1MHT.fill(q.mhtSum);
+
+  // stuff for efficiencies and resolution
+  if (!q.hasReco || !q.metFilters) return;
+
+  // met
+  float rMET = q.caloMet;
+  double metSum = q.metSum;
+  refMET.fill( rMET );
+  respMET.fill(rMET, metSum);
+  if( metSum >30. ) { MET_30U.fill(rMET);}
+  if( metSum >40. ) { MET_40U.fill(rMET);}
+  if( metSum >50. ) { MET_50U.fill(rMET);}
+  if( metSum >70. ) { MET_70U.fill(rMET);}
+  if( metSum >100. ) { MET_100U.fill(rMET);}
+
+  // met resolution
+  float resMET = (metSum-rMET)/rMET;
+  hresMET.fill(rMET, resMET);
+  // the ratio is undefined without offline MET
+  if (rMET > 0.) sketchMET.fill(rMET, metSum/rMET);
+
+  if (rMET<20.) h_resMET1.fill(resMET);
+  if (rMET>=20. && rMET<40.) h_resMET2.fill(resMET);
+  if (rMET>=40. && rMET<60.) h_resMET3.fill(resMET);
+  if (rMET>=60. && rMET<80.) h_resMET4.fill(resMET);
+  if (rMET>=80. && rMET<100.) h_resMET5.fill(resMET);
+  if (rMET>=100. && rMET<120.) h_resMET6.fill(resMET);
+  if (rMET>=120. && rMET<140.) h_resMET7.fill(resMET);
+  if (rMET>=140. && rMET<180.) h_resMET8.fill(resMET);
+  if (rMET>=180. && rMET<250.) h_resMET9.fill(resMET);
+  if (rMET>=250. && rMET<500.) h_resMET10.fill(resMET);
+
+  for (size_t p=0; p<q.jetPairs.size(); p++) {
+    float refJetEt = q.jetPairs[p].refEt;
+    float l1JetEt = q.jetPairs[p].l1Et;
+    refAllJetET.fill(refJetEt);
+    if (std::isnan(l1JetEt)) continue;
+    refmAllJetET.fill(refJetEt);
+    if (l1JetEt>50.) allJetET50.fill(refJetEt);
+    if (l1JetEt>64.) allJetET64.fill(refJetEt);
+    if (l1JetEt>76.) allJetET76.fill(refJetEt);
+    if (l1JetEt>92.) allJetET92.fill(refJetEt);
+    if (l1JetEt>112.) allJetET112.fill(refJetEt);
+    if (l1JetEt>180.) allJetET180.fill(refJetEt);
+
+    float resJet=(l1JetEt-refJetEt)/refJetEt;
+    hresAllJet.fill(refJetEt,resJet);
+    if (fabs(q.jetPairs[p].l1Eta)<=1.305) {
+      hresAllJet_hb.fill(refJetEt,resJet);
+    } else if (fabs(q.jetPairs[p].l1Eta)<=3.0) {
+      hresAllJet_he.fill(refJetEt,resJet);
+    } else {
+      hresAllJet_hf.fill(refJetEt,resJet);
+    }
+  }
+
+  // the leading offline jet
+  if (q.jetPairs.empty()) return; // no offline jet >10. geV
+  float refJetEt = q.jetPairs[0].refEt;
+  refJetET.fill(refJetEt);
+
+  float l1JetEt = q.jetPairs[0].l1Et;
+  respLeadJet[jetRegion(q.jetPairs[0].refEta)].fill(refJetEt, std::isnan(l1JetEt) ? -1. : l1JetEt);
+  if (std::isnan(l1JetEt)) return; // no matched l1jet
+  refmJetET.fill(refJetEt);
+  if (l1JetEt>50.) jetET50.fill(refJetEt);
+  if (l1JetEt>64.) jetET64.fill(refJetEt);
+  if (l1JetEt>76.) jetET76.fill(refJetEt);
+  if (l1JetEt>92.) jetET92.fill(refJetEt);
+  if (l1JetEt>112.) jetET112.fill(refJetEt);
+  if (l1JetEt>180.) jetET180.fill(refJetEt);
+
+  float resJet=(l1JetEt-refJetEt)/refJetEt;
+  hresJet.fill(refJetEt,resJet);
+  sketchLeadJet[jetRegion(q.jetPairs[0].refEta)].fill(refJetEt, l1JetEt/refJetEt);
+
+  if (fabs(q.jetPairs[0].l1Eta)<=1.305) {
+    hresJet_hb.fill(refJetEt,resJet);
+  } else if (fabs(q.jetPairs[0].l1Eta)<=3.0) {
+    hresJet_he.fill(refJetEt,resJet);
+  } else {
+    hresJet_hf.fill(refJetEt,resJet);
+  }
+
+  if (refJetEt<50.) h_resJet1.fill(resJet);
+  if (refJetEt>=50. && refJetEt<100.) h_resJet2.fill(resJet);
+  if (refJetEt>=100. && refJetEt<150.) h_resJet3.fill(resJet);
+  if (refJetEt>=150. && refJetEt<200.) h_resJet4.fill(resJet);
+  if (refJetEt>=200. && refJetEt<250.) h_resJet5.fill(resJet);
+  if (refJetEt>=250. && refJetEt<300.) h_resJet6.fill(resJet);
+  if (refJetEt>=300. && refJetEt<350.) h_resJet7.fill(resJet);
+  if (refJetEt>=350. && refJetEt<400.) h_resJet8.fill(resJet);
+  if (refJetEt>=400. && refJetEt<450.) h_resJet9.fill(resJet);
+  if (refJetEt>=450. && refJetEt<500.) h_resJet10.fill(resJet);
+}
+
+template <class F>
+inline void JetHistograms::forEach(F f)
+{
+  // l1 quantities
+  f(l1jetET1); f(l1jetET2); f(l1jetET3); f(l1jetET4);
+  f(l1ET); f(l1MET); f(l1METHF); f(l1HT); f(l1MHT);
+  // efficiencies
+  f(refJetET); f(refmJetET);
+  f(jetET50); f(jetET64); f(jetET76); f(jetET92); f(jetET112); f(jetET180);
+  f(refMET);
+  f(MET_30U); f(MET_40U); f(MET_50U); f(MET_70U); f(MET_100U);
+  // resolutions
+  f(hresMET); f(hresJet);
+  f(hresJet_hb);
+  f(hresJet_he);
+  f(hresJet_hf);
+  f(h_resMET1); f(h_resMET2); f(h_resMET3); f(h_resMET4); f(h_resMET5);
+  f(h_resMET6); f(h_resMET7); f(h_resMET8); f(h_resMET9); f(h_resMET10);
+  f(h_resJet1); f(h_resJet2); f(h_resJet3); f(h_resJet4); f(h_resJet5);
+  f(h_resJet6); f(h_resJet7); f(h_resJet8); f(h_resJet9); f(h_resJet10);
+  // all offline jets
+  f(refAllJetET); f(refmAllJetET);
+  f(allJetET50); f(allJetET64); f(allJetET76); f(allJetET92); f(allJetET112); f(allJetET180);
+  f(hresAllJet); f(hresAllJet_hb); f(hresAllJet_he); f(hresAllJet_hf);
+  // responses
+  for (int r=0; r<kNJetRegions; r++) f(respLeadJet[r]);
+  f(respMET);
+  // resolution sketches
+  for (int r=0; r<kNJetRegions; r++) f(sketchLeadJet[r]);
+  f(sketchMET);
+}
+
+inline void JetHistograms::fillHists()
+{
+  forEach([](auto& h) { h.fillHist(); });
+}
+
+inline void JetHistograms::reset()
+{
+  forEach([](auto& h) { h.reset(); });
+}
+
+inline void JetHistograms::addHists()
+{
+  forEach([](auto& h) { h.add(h.hist()); });
+}
+
+inline void JetHistograms::write()
+{
+  fillHists();
+  forEach([](auto& h) { h.hist()->Write(); });
+}
+
+#endif
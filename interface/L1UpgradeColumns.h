@@ -0,0 +1,58 @@
+#ifndef HcalTrigger_Validation_L1UpgradeColumns_h
+#define HcalTrigger_Validation_L1UpgradeColumns_h
+
+#include "HcalTrigger/Validation/interface/TreeColumns.h"
+
+#include <vector>
+
+// The members of L1AnalysisL1UpgradeDataFormat used by the rate and jet
+// tools; muons, hardware indices and the remaining object fields are not
+// read. Jet, EG and tau eta are only read for the menu seeds (withEta),
+// jet eta and phi for matching the L1 jets to offline jets (withJetMatching).
+class L1UpgradeColumns : public TreeColumns {
+public:
+  explicit L1UpgradeColumns(TTree* tree, bool withEta = false, bool withJetMatching = false)
+    : TreeColumns(tree), nJets(0), nEGs(0), nTaus(0), nSums(0) {
+    connect("nJets", nJets);
+    connect("jetEt", jetEt);
+    if (withEta || withJetMatching) connect("jetEta", jetEta);
+    if (withJetMatching) connect("jetPhi", jetPhi);
+    connect("jetBx", jetBx);
+
+    connect("nEGs", nEGs);
+    connect("egEt", egEt);
+    connect("egIso", egIso);
+    connect("egBx", egBx);
+    if (withEta) connect("egEta", egEta);
+
+    connect("nTaus", nTaus);
+    connect("tauEt", tauEt);
+    connect("tauIso", tauIso);
+    connect("tauBx", tauBx);
+    if (withEta) connect("tauEta", tauEta);
+
+    connect("nSums", nSums);
+    connect("sumType", sumType);
+    connect("sumEt", sumEt);
+    connect("sumBx", sumBx);
+  }
+
+  unsigned short nJets;
+  std::vector<float> jetEt, jetEta, jetPhi;
+  std::vector<short> jetBx;
+
+  unsigned short nEGs;
+  std::vector<float> egEt, egEta;
+  std::vector<short> egIso, egBx;
+
+  unsigned short nTaus;
+  std::vector<float> tauEt, tauEta;
+  std::vector<short> tauIso, tauBx;
+
+  unsigned short nSums;
+  std::vector<short> sumType;
+  std::vector<float> sumEt;
+  std::vector<short> sumBx;
+};
+
+#endif
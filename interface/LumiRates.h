@@ -0,0 +1,72 @@
+#ifndef HcalTrigger_Validation_LumiRates_h
+#define HcalTrigger_Validation_LumiRates_h
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Rate curves per luminosity section, stored sparsely. For every (run, LS)
+// it keeps the number of events and, per rate type, the differential
+// counts of the threshold bins that actually occurred (the bin of the
+// highest threshold each event passes, as in CumulativeRate). A rate curve
+// for one LS is the reverse running sum of its counts divided by its events.
+class LumiRates {
+public:
+  static uint64_t lumiKey(unsigned run, unsigned lumi) { return (static_cast<uint64_t>(run) << 32) | lumi; }
+  static unsigned run(uint64_t key) { return key >> 32; }
+  static unsigned lumi(uint64_t key) { return key & 0xffffffff; }
+
+  // select the LS of the next fills and count one event in it
+  void addEvent(unsigned run, unsigned lumi) {
+    current_ = &lumis_[lumiKey(run, lumi)];
+    ++current_->nEvents;
+  }
+
+  // record bin (-1: no threshold passed) of rate type for the current event
+  void fill(int type, int bin) {
+    if (bin >= 0) ++current_->counts[(static_cast<uint32_t>(type) << 16) | bin];
+  }
+
+  void add(const LumiRates& other) {
+    for (const auto& ls : other.lumis_) {
+      Lumi& lumi = lumis_[ls.first];
+      lumi.nEvents += ls.second.nEvents;
+      for (const auto& count : ls.second.counts) lumi.counts[count.first] += count.second;
+    }
+  }
+
+  // LS keys in (run, lumi) order
+  std::vector<uint64_t> lumiKeys() const {
+    std::vector<uint64_t> keys;
+    for (const auto& ls : lumis_) keys.push_back(ls.first);
+    std::sort(keys.begin(), keys.end());
+    return keys;
+  }
+
+  long long nEvents(uint64_t key) const { return lumis_.at(key).nEvents; }
+
+  // non-empty (bin, events) of one rate type in one LS, in bin order
+  std::vector<std::pair<int, unsigned> > counts(uint64_t key, int type) const {
+    std::vector<std::pair<int, unsigned> > result;
+    for (const auto& count : lumis_.at(key).counts) {
+      if (static_cast<int>(count.first >> 16) == type) result.push_back(std::make_pair(count.first & 0xffff, count.second));
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+private:
+  struct Lumi {
+    Lumi() : nEvents(0) {}
+    long long nEvents;
+    // (type << 16 | bin) -> events
+    std::unordered_map<uint32_t, unsigned> counts;
+  };
+
+  std::unordered_map<uint64_t, Lumi> lumis_;
+  Lumi* current_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef HcalTrigger_Validation_NtupleReader_h
+#define HcalTrigger_Validation_NtupleReader_h
+
+#include "TFile.h"
+#include "TSystem.h"
+#include "TTree.h"
+
+#include "HcalTrigger/Validation/interface/ResultCache.h"
+#include "HcalTrigger/Validation/interface/TreeColumns.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// the default entry-count index: a file in the working directory, since the
+// ntuples may be remote or read-only. One index can hold any number of
+// ntuple directories, the files are listed by path.
+inline std::string ntupleIndexFile()
+{
+  return "ntuple_index.txt";
+}
+
+// Entry numbering of a set of ntuple files read as one input: the files in
+// order and the first entry of each, as a chain would number them. Only
+// files in which the trees line up are used. A file in which one of the
+// trees is missing, or has a different number of entries than the first
+// one, is left out with a warning, instead of shifting every later entry
+// of that tree against the others. Only the event tree has the event id,
+// so within a file the trees are matched by entry.
+//
+// The entries of every tree of every file are kept in a local index file
+// (see ntupleIndexFile()), one line per ntuple file with its fileStamp(), so
+// a later job only opens the files that are new or have changed since. The
+// index is rewritten under a temporary name and renamed, like the result
+// cache. Jobs sharing an index take a lock on it and merge their counts
+// into the latest version, so none of them drops the records of another;
+// if it cannot be written, the files are counted every time.
+class NtupleIndex {
+public:
+  explicit NtupleIndex(const std::vector<std::string>& treeNames) : treeNames_(treeNames), offsets_(1, 0) {}
+
+  // the files matching pattern and their entries, counted in the files that
+  // are not in the index file yet (none: no index file)
+  void build(const std::string& pattern, const std::string& indexFile) {
+    std::map<std::string, Record> records;
+    if (!indexFile.empty()) records = readRecords(indexFile);
+    std::map<std::string, Record> counted;
+    for (const std::string& file : expandInputFiles(pattern)) {
+      std::string stamp = fileStamp(file);
+      Record& record = records[file];
+      bool current = !stamp.empty() && record.stamp == stamp;
+      if (!current || !record.has(treeNames_)) {
+	// count the other trees of the index too, so it stays complete
+	std::vector<std::string> names(treeNames_);
+	for (const std::pair<const std::string, Long64_t>& tree : record.entries) {
+	  if (current && std::find(names.begin(), names.end(), tree.first) == names.end()) names.push_back(tree.first);
+	}
+	if (!countTrees(file, names, record.entries)) {
+	  std::cout << "Skipping " << file << ": cannot open" << std::endl;
+	  skipped_.push_back(file);
+	  records.erase(file);
+	  continue;
+	}
+	record.stamp = stamp;
+	counted[file] = record;
+      }
+      std::string error;
+      Long64_t entries = record.lineUp(treeNames_, error);
+      if (entries < 0) {
+	std::cout << "Skipping " << file << ": " << error << std::endl;
+	skipped_.push_back(file);
+      }
+      else addFile(file, entries);
+    }
+    if (!counted.empty() && !indexFile.empty() && !updateRecords(indexFile, counted)) {
+      std::cout << "Cannot write the ntuple index " << indexFile << std::endl;
+    }
+  }
+  void build(const std::string& pattern) { build(pattern, ntupleIndexFile()); }
+
+  void addFile(const std::string& file, Long64_t entries) {
+    if (entries <= 0) return;
+    files_.push_back(file);
+    offsets_.push_back(offsets_.back() + entries);
+  }
+
+  const std::vector<std::string>& treeNames() const { return treeNames_; }
+  // index of a tree in treeNames(), -1 if it is not read
+  int tree(const std::string& name) const {
+    std::vector<std::string>::const_iterator it = std::find(treeNames_.begin(), treeNames_.end(), name);
+    return it == treeNames_.end() ? -1 : it - treeNames_.begin();
+  }
+
+  size_t nFiles() const { return files_.size(); }
+  const std::string& file(size_t f) const { return files_[f]; }
+  // first entry of file f; offset(nFiles()) is the number of entries
+  Long64_t offset(size_t f) const { return offsets_[f]; }
+  Long64_t entries() const { return offsets_.back(); }
+  // file of an entry, nFiles() past the end
+  size_t fileOf(Long64_t entry) const {
+    if (entry < 0) return nFiles();
+    return std::upper_bound(offsets_.begin(), offsets_.end(), entry) - offsets_.begin() - 1;
+  }
+  const std::vector<std::string>& skippedFiles() const { return skipped_; }
+
+private:
+  // the entries of the trees of one file (-1: missing) and its fileStamp()
+  struct Record {
+    std::string stamp;
+    std::map<std::string, Long64_t> entries;
+
+    bool has(const std::vector<std::string>& names) const {
+      for (const std::string& name : names) if (!entries.count(name)) return false;
+      return true;
+    }
+    // the entries of the trees, -1 (and why in error) if they do not line up
+    Long64_t lineUp(const std::vector<std::string>& names, std::string& error) const {
+      Long64_t first = entries.find(names.front())->second;
+      for (const std::string& name : names) {
+	Long64_t n = entries.find(name)->second;
+	if (n < 0) {
+	  error = name + " is missing";
+	  return -1;
+	}
+	if (n != first) {
+	  std::ostringstream message;
+	  message << name << " has " << n << " entries, " << names.front() << " " << first;
+	  error = message.str();
+	  return -1;
+	}
+      }
+      return first;
+    }
+  };
+
+  // open file once and count the entries of the trees; false if it cannot be opened
+  static bool countTrees(const std::string& file, const std::vector<std::string>& names,
+			 std::map<std::string, Long64_t>& entries) {
+    TFile* f = TFile::Open(file.c_str());
+    if (!f || f->IsZombie()) {
+      delete f;
+      return false;
+    }
+    entries.clear();
+    for (const std::string& name : names) {
+      TTree* tree = dynamic_cast<TTree*>(f->Get(name.c_str()));
+      entries[name] = tree ? tree->GetEntries() : -1;
+    }
+    f->Close();
+    delete f;
+    return true;
+  }
+
+  // "file stamp tree entries tree entries ..." lines
+  static std::map<std::string, Record> readRecords(const std::string& indexFile) {
+    std::map<std::string, Record> records;
+    std::ifstream in(indexFile.c_str());
+    std::string line;
+    while (std::getline(in, line)) {
+      std::istringstream fields(line);
+      std::string file, tree;
+      Record record;
+      Long64_t n;
+      if (!(fields >> file >> record.stamp)) continue;
+      while (fields >> tree >> n) record.entries[tree] = n;
+      records[file] = record;
+    }
+    return records;
+  }
+
+  // add the records counted by this job to the index as another job may
+  // have left it since it was read, under an exclusive lock on indexFile.lock
+  static bool updateRecords(const std::string& indexFile, const std::map<std::string, Record>& counted) {
+    int lock = open((indexFile + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock < 0) return false;
+    bool written = false;
+    if (flock(lock, LOCK_EX) == 0) {
+      std::map<std::string, Record> records = readRecords(indexFile);
+      for (const std::pair<const std::string, Record>& record : counted) records[record.first] = record.second;
+      written = writeRecords(indexFile, records);
+    }
+    close(lock);
+    return written;
+  }
+
+  // files without a stamp are left out
+  static bool writeRecords(const std::string& indexFile, const std::map<std::string, Record>& records) {
+    std::ostringstream tmpFile;
+    tmpFile << indexFile << '.' << gSystem->HostName() << '.' << getpid() << ".tmp";
+    {
+      std::ofstream out(tmpFile.str().c_str());
+      for (const std::pair<const std::string, Record>& record : records) {
+	if (record.second.stamp.empty()) continue;
+	out << record.first << ' ' << record.second.stamp;
+	for (const std::pair<const std::string, Long64_t>& tree : record.second.entries) out << ' ' << tree.first << ' ' << tree.second;
+	out << '\n';
+      }
+      if (!out.good()) {
+	std::remove(tmpFile.str().c_str());
+	return false;
+      }
+    }
+    return std::rename(tmpFile.str().c_str(), indexFile.c_str()) == 0;
+  }
+
+  std::vector<std::string> treeNames_;
+  std::vector<std::string> files_;
+  std::vector<Long64_t> offsets_;
+  std::vector<std::string> skipped_;
+};
+
+// The trees of an NtupleIndex, read one file at a time. Each file is
+// opened once for all of the trees, which then read through the same file
+// handle, and closed when load() moves on to the next file. Branches are
+// bound with bind(), which is replayed on the trees of every file.
+class NtupleReader {
+public:
+  explicit NtupleReader(const NtupleIndex& index)
+    : index_(index), trees_(index.treeNames().size(), 0), bindings_(trees_.size()), file_(0),
+      current_(index.nFiles()) {}
+  ~NtupleReader() { close(); }
+  NtupleReader(const NtupleReader&) = delete;
+  NtupleReader& operator=(const NtupleReader&) = delete;
+
+  const NtupleIndex& index() const { return index_; }
+
+  void bind(int tree, const std::function<void(TTree*)>& binding) {
+    bindings_[tree].push_back(binding);
+    if (trees_[tree]) binding(trees_[tree]);
+  }
+  void bind(int tree, TreeColumns& columns) {
+    bind(tree, [&columns](TTree* t) { columns.attach(t); });
+  }
+
+  // the entry in its file of an entry of the whole input, opening the file
+  // if needed; -1 past the end or if the file cannot be opened
+  Long64_t load(Long64_t entry) {
+    size_t f = index_.fileOf(entry);
+    if (f >= index_.nFiles()) return -1;
+    if (f != current_) open(f);
+    return file_ ? entry - index_.offset(f) : -1;
+  }
+
+  // tree t of the current file
+  TTree* tree(int t) const { return trees_[t]; }
+
+  void close() {
+    if (file_) {
+      file_->Close();
+      delete file_;
+      file_ = 0;
+    }
+    std::fill(trees_.begin(), trees_.end(), static_cast<TTree*>(0));
+    current_ = index_.nFiles();
+  }
+
+private:
+  void open(size_t f) {
+    close();
+    current_ = f;
+    file_ = TFile::Open(index_.file(f).c_str());
+    if (!file_ || file_->IsZombie()) {
+      std::cout << "Cannot open " << index_.file(f) << std::endl;
+      delete file_;
+      file_ = 0;
+      return;
+    }
+    for (size_t t=0; t<trees_.size(); t++) {
+      trees_[t] = dynamic_cast<TTree*>(file_->Get(index_.treeNames()[t].c_str()));
+      if (!trees_[t]) {
+	std::cout << index_.treeNames()[t] << " is missing in " << index_.file(f) << std::endl;
+	close();
+	current_ = f;
+	return;
+      }
+      for (const std::function<void(TTree*)>& binding : bindings_[t]) binding(trees_[t]);
+    }
+  }
+
+  const NtupleIndex& index_;
+  std::vector<TTree*> trees_;
+  std::vector<std::vector<std::function<void(TTree*)> > > bindings_;
+  TFile* file_;
+  size_t current_;
+};
+
+#endif
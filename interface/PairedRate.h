@@ -0,0 +1,77 @@
+#ifndef HcalTrigger_Validation_PairedRate_h
+#define HcalTrigger_Validation_PairedRate_h
+
+#include "HcalTrigger/Validation/interface/CumulativeRate.h"
+
+#include "TH1.h"
+
+#include <cmath>
+#include <vector>
+
+// Threshold flips between two conditions evaluated on the same events.
+// For every threshold it counts the events that pass only with the new
+// conditions (gained) and only with the default ones (lost). An event
+// flips on a contiguous range of thresholds, so both are kept as
+// difference arrays and cost O(1) per event.
+class PairedRate {
+public:
+  explicit PairedRate(int nBins) : nBins_(nBins), gained_(nBins+1, 0), lost_(nBins+1, 0) {}
+
+  // highest thresholds passed with default and new conditions (-1: none)
+  void fill(int defBin, int newBin) {
+    if (newBin > defBin) {
+      ++gained_[defBin+1];
+      --gained_[newBin+1];
+    }
+    else if (defBin > newBin) {
+      ++lost_[newBin+1];
+      --lost_[defBin+1];
+    }
+  }
+
+  void add(const PairedRate& other) {
+    for (int bin=0; bin<=nBins_; bin++) {
+      gained_[bin] += other.gained_[bin];
+      lost_[bin] += other.lost_[bin];
+    }
+  }
+
+  // unnormalised counts of flipping events per threshold
+  void fillFlips(TH1* gained, TH1* lost) const {
+    long long nGained = 0;
+    long long nLost = 0;
+    for (int bin=0; bin<nBins_; bin++) {
+      nGained += gained_[bin];
+      nLost += lost_[bin];
+      gained->SetBinContent(bin+1, nGained);
+      lost->SetBinContent(bin+1, nLost);
+    }
+  }
+
+  // new/default rate ratio per threshold. Events passing with both
+  // conditions cancel in the ratio, so with B passing both, a gained and
+  // b lost (independent Poisson counts), R = (B+a)/(B+b) and
+  //   var(R) = [B (b-a)^2 + a (B+b)^2 + b (B+a)^2] / (B+b)^4
+  void fillRatio(TH1* ratio, const CumulativeRate& defRate) const {
+    long long nGained = 0;
+    long long nLost = 0;
+    for (int bin=0; bin<nBins_; bin++) {
+      nGained += gained_[bin];
+      nLost += lost_[bin];
+      double d = defRate.passing(bin);
+      if (d <= 0.) continue;
+      double a = nGained;
+      double b = nLost;
+      double both = d-b;
+      ratio->SetBinContent(bin+1, (both+a)/d);
+      ratio->SetBinError(bin+1, std::sqrt(both*(b-a)*(b-a) + a*d*d + b*(both+a)*(both+a))/(d*d));
+    }
+  }
+
+private:
+  int nBins_;
+  std::vector<long long> gained_;
+  std::vector<long long> lost_;
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef HcalTrigger_Validation_PileupRates_h
+#define HcalTrigger_Validation_PileupRates_h
+
+#include "HcalTrigger/Validation/interface/CumulativeRate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Average pileup per lumi section from a brilcalc CSV (--byls), e.g.
+//   #run:fill,ls,time,beamstatus,E(GeV),delivered(/ub),recorded(/ub),avgpu,source
+//   302472:6255,1:1,10/01/17 00:00:00,STABLE BEAMS,6500,1234.5,1200.1,35.2,HFOC
+// The avgpu column is found from the header line if there is one.
+class PileupTable {
+public:
+  // false if the file cannot be read or has no usable line
+  bool load(const std::string& fileName) {
+    std::ifstream in(fileName.c_str());
+    if (!in) return false;
+    size_t puColumn = 7;
+    std::string line;
+    while (std::getline(in, line)) {
+      std::vector<std::string> fields = split(line);
+      if (line.compare(0, 4, "#run") == 0) {
+        for (size_t f=0; f<fields.size(); f++) {
+          if (fields[f] == "avgpu") puColumn = f;
+        }
+      }
+      if (line.empty() || line[0] == '#' || fields.size() <= puColumn) continue;
+      unsigned run = std::strtoul(fields[0].c_str(), 0, 10);
+      unsigned lumi = std::strtoul(fields[1].c_str(), 0, 10);
+      pileup_[(static_cast<uint64_t>(run) << 32) | lumi] = std::atof(fields[puColumn].c_str());
+    }
+    return !pileup_.empty();
+  }
+
+  // NaN if the LS is not in the table
+  double pileup(unsigned run, unsigned lumi) const {
+    std::unordered_map<uint64_t, double>::const_iterator it = pileup_.find((static_cast<uint64_t>(run) << 32) | lumi);
+    return it == pileup_.end() ? std::nan("") : it->second;
+  }
+
+private:
+  static std::vector<std::string> split(const std::string& line) {
+    std::vector<std::string> fields;
+    std::istringstream in(line);
+    std::string field;
+    while (std::getline(in, field, ',')) fields.push_back(field);
+    return fields;
+  }
+
+  std::unordered_map<uint64_t, double> pileup_;
+};
+
+// Rate curves in bins of pileup (or of a proxy such as the number of
+// vertices): events per pileup bin and, per rate type, the differential
+// threshold counts of CumulativeRate. fit() models the fraction of events
+// passing each threshold as a + b*pileup, from which the rate at any
+// luminosity follows without processing the events again.
+class PileupRates {
+public:
+  PileupRates(const std::vector<CumulativeRate>& curves, int nBins, double lo, double hi)
+    : nBins_(nBins), lo_(lo), hi_(hi), current_(-1), nEvents_(nBins, 0) {
+    size_t offset = 0;
+    for (const CumulativeRate& curve : curves) {
+      offsets_.push_back(offset);
+      nThresholds_.push_back(curve.nBins());
+      offset += curve.nBins();
+    }
+    stride_ = offset;
+    counts_.resize(nBins*stride_, 0);
+  }
+
+  int nBins() const { return nBins_; }
+  double lo() const { return lo_; }
+  double hi() const { return hi_; }
+  double center(int bin) const { return lo_ + (bin+0.5)*(hi_-lo_)/nBins_; }
+
+  // -1 outside the range (and for NaN)
+  int pileupBin(double pileup) const {
+    if (!(pileup >= lo_ && pileup < hi_)) return -1;
+    int bin = nBins_*(pileup-lo_)/(hi_-lo_);
+    return bin < nBins_ ? bin : nBins_-1;
+  }
+
+  // select the pileup bin (-1: none) of the next fills and count one event in it
+  void addEvent(int bin) {
+    current_ = bin;
+    if (bin >= 0) ++nEvents_[bin];
+  }
+
+  // record threshold bin (-1: none passed) of rate type for the current event
+  void fill(int type, int threshold) {
+    if (current_ >= 0 && threshold >= 0) ++counts_[current_*stride_ + offsets_[type] + threshold];
+  }
+
+  void add(const PileupRates& other) {
+    for (int bin=0; bin<nBins_; bin++) nEvents_[bin] += other.nEvents_[bin];
+    for (size_t i=0; i<counts_.size(); i++) counts_[i] += other.counts_[i];
+  }
+
+  long long nEvents(int bin) const { return nEvents_[bin]; }
+
+  // events of a pileup bin passing every threshold of rate type
+  std::vector<unsigned long long> passing(int bin, int type) const {
+    std::vector<unsigned long long> result(nThresholds_[type]);
+    const unsigned long long* counts = &counts_[bin*stride_ + offsets_[type]];
+    unsigned long long sum = 0;
+    for (int t=nThresholds_[type]-1; t>=0; t--) {
+      sum += counts[t];
+      result[t] = sum;
+    }
+    return result;
+  }
+
+  // Weighted least-squares line through the passing fractions of every
+  // threshold against the pileup bin centres, with binomial-like weights
+  // N^2/max(n, kMinCountVariance). offset/slope get one value per
+  // threshold; both are 0 if fewer than two pileup bins have events, and
+  // bins without events are left out.
+  void fit(int type, std::vector<double>& offset, std::vector<double>& slope) const {
+    int nThresholds = nThresholds_[type];
+    std::vector<double> sw(nThresholds, 0.), swx(nThresholds, 0.), swy(nThresholds, 0.),
+      swxx(nThresholds, 0.), swxy(nThresholds, 0.);
+    int nUsed = 0;
+    for (int bin=0; bin<nBins_; bin++) {
+      if (nEvents_[bin] == 0) continue;
+      nUsed++;
+      std::vector<unsigned long long> n = passing(bin, type);
+      double events = nEvents_[bin];
+      double x = center(bin);
+      for (int t=0; t<nThresholds; t++) {
+        double y = n[t]/events;
+        double w = events*events/std::max(double(n[t]), kMinCountVariance);
+        sw[t] += w;
+        swx[t] += w*x;
+        swy[t] += w*y;
+        swxx[t] += w*x*x;
+        swxy[t] += w*x*y;
+      }
+    }
+    offset.assign(nThresholds, 0.);
+    slope.assign(nThresholds, 0.);
+    if (nUsed < 2) return;
+    for (int t=0; t<nThresholds; t++) {
+      double det = sw[t]*swxx[t] - swx[t]*swx[t];
+      if (det <= 0.) continue;
+      slope[t] = (sw[t]*swxy[t] - swx[t]*swy[t])/det;
+      offset[t] = (swy[t] - slope[t]*swx[t])/sw[t];
+    }
+  }
+
+  // Variance floor of a passing count. n is no estimate of the variance of
+  // a small count, and none at all for n = 0, which would otherwise weigh
+  // like a measurement without error. Below about 3 counts the variance is
+  // that of the 68% Poisson upper limit for zero observed, 1.84 counts.
+  static constexpr double kMinCountVariance = 1.84*1.84;
+
+private:
+  int nBins_;
+  double lo_;
+  double hi_;
+  int current_;
+  std::vector<long long> nEvents_;
+  std::vector<size_t> offsets_;
+  std::vector<int> nThresholds_;
+  size_t stride_;
+  std::vector<unsigned long long> counts_;  // pileup-bin-major
+};
+
+#endif
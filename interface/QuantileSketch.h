@@ -0,0 +1,148 @@
+#ifndef HcalTrigger_Validation_QuantileSketch_h
+#define HcalTrigger_Validation_QuantileSketch_h
+
+#include "TH2D.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// offline ET bins of the resolution sketches, set at run time
+struct SketchBinning {
+  SketchBinning(int nBins_ = 10, double lo_ = 0., double hi_ = 500.) : nBins(nBins_), lo(lo_), hi(hi_) {}
+  int nBins;
+  double lo, hi;
+};
+
+// Quantile sketches of the L1/offline ratio in bins of offline ET. The
+// ratios are counted in logarithmic buckets (as in DDSketch): bucket i
+// holds (kMinRatio*gamma^(i-1), kMinRatio*gamma^i] with gamma =
+// (1+kAlpha)/(1-kAlpha), so every quantile read back is within kAlpha of
+// the true one, relative, whatever the distribution. Ratios up to
+// kMinRatio share bucket 0, those above kMaxRatio the last one. The bucket
+// of a ratio and the ET bin are a few instructions each, and the memory is
+// fixed: nBins+2 by nBuckets() counts.
+//
+// The counts are written as a TH2D of ET bin vs bucket, which adds up
+// exactly with TH1::Add and hadd, so the sketches of parallel jobs merge
+// to the sketch of the whole input. Read back with the TH2 constructor.
+class ResolutionSketch {
+public:
+  static constexpr double kAlpha = 0.01;
+  static constexpr double kMinRatio = 0.01;
+  static constexpr double kMaxRatio = 100.;
+
+  ResolutionSketch(const char* name, const char* title, const SketchBinning& binning)
+    : binning_(binning), counts_((binning.nBins+2)*nBuckets(), 0) {
+    hist_ = new TH2D(name, title, binning.nBins, binning.lo, binning.hi, nBuckets(), 0., nBuckets());
+  }
+  // the sketch written in hist
+  explicit ResolutionSketch(const TH2* hist)
+    : binning_(hist->GetXaxis()->GetNbins(), hist->GetXaxis()->GetXmin(), hist->GetXaxis()->GetXmax()),
+      counts_((binning_.nBins+2)*nBuckets(), 0), hist_(0) {
+    add(hist);
+  }
+
+  static double gamma() { return (1.+kAlpha)/(1.-kAlpha); }
+  static int nBuckets() {
+    static const int n = 2 + static_cast<int>(std::ceil(std::log(kMaxRatio/kMinRatio)/std::log(gamma())));
+    return n;
+  }
+  static int bucket(double ratio) {
+    if (!(ratio > kMinRatio)) return 0;
+    if (!(ratio <= kMaxRatio)) return nBuckets()-1;
+    static const double logGamma = std::log(gamma());
+    int i = static_cast<int>(std::ceil(std::log(ratio/kMinRatio)/logGamma));
+    return std::min(std::max(i, 1), nBuckets()-2);
+  }
+  // the value quantiles in bucket i are read as, within kAlpha of any ratio in it
+  static double bucketValue(int i) {
+    if (i <= 0) return 0.;
+    if (i >= nBuckets()-1) return kMaxRatio;
+    return kMinRatio*2.*std::pow(gamma(), i)/(gamma()+1.);
+  }
+
+  const SketchBinning& binning() const { return binning_; }
+  TH2D* hist() const { return hist_; }
+
+  // ET bin of et, as TAxis::FindBin: 0 below lo, nBins+1 at or above hi
+  int etBin(double et) const {
+    if (et < binning_.lo) return 0;
+    if (!(et < binning_.hi)) return binning_.nBins+1;
+    return 1 + static_cast<int>(binning_.nBins*(et-binning_.lo)/(binning_.hi-binning_.lo));
+  }
+
+  void fill(double et, double ratio) { ++counts_[etBin(et)*nBuckets() + bucket(ratio)]; }
+
+  void add(const ResolutionSketch& other) {
+    for (size_t c=0; c<counts_.size(); c++) counts_[c] += other.counts_[c];
+  }
+  // add the counts of a histogram written by fillHist()
+  void add(const TH1* hist) {
+    for (int e=0; e<=binning_.nBins+1; e++) {
+      for (int b=0; b<nBuckets(); b++) {
+	counts_[e*nBuckets() + b] += static_cast<unsigned long long>(hist->GetBinContent(hist->GetBin(e, b+1)));
+      }
+    }
+  }
+
+  void reset() { std::fill(counts_.begin(), counts_.end(), 0); }
+
+  void fillHist(TH1* hist) const {
+    double entries = 0.;
+    for (int e=0; e<=binning_.nBins+1; e++) {
+      for (int b=0; b<nBuckets(); b++) {
+	double n = counts_[e*nBuckets() + b];
+	hist->SetBinContent(hist->GetBin(e, b+1), n);
+	entries += n;
+      }
+    }
+    hist->SetEntries(entries);
+  }
+  void fillHist() const { fillHist(hist_); }
+
+  unsigned long long entries(int etBin) const {
+    unsigned long long n = 0;
+    for (int b=0; b<nBuckets(); b++) n += counts_[etBin*nBuckets() + b];
+    return n;
+  }
+
+  // q-quantile of the ratios in an ET bin, NaN if it is empty
+  double quantile(int etBin, double q) const {
+    unsigned long long n = entries(etBin);
+    if (n == 0) return std::nan("");
+    unsigned long long rank = static_cast<unsigned long long>(q*(n-1));
+    unsigned long long seen = 0;
+    for (int b=0; b<nBuckets(); b++) {
+      seen += counts_[etBin*nBuckets() + b];
+      if (seen > rank) return bucketValue(b);
+    }
+    return bucketValue(nBuckets()-1);
+  }
+  double median(int etBin) const { return quantile(etBin, 0.5); }
+  double interquartileWidth(int etBin) const { return quantile(etBin, 0.75) - quantile(etBin, 0.25); }
+
+  // fraction of the ratios in an ET bin below (above) ratio, to the bucket
+  // ratio falls in; NaN if the bin is empty
+  double fractionBelow(int etBin, double ratio) const {
+    unsigned long long n = entries(etBin);
+    if (n == 0) return std::nan("");
+    unsigned long long below = 0;
+    for (int b=0; b<bucket(ratio); b++) below += counts_[etBin*nBuckets() + b];
+    return double(below)/n;
+  }
+  double fractionAbove(int etBin, double ratio) const {
+    unsigned long long n = entries(etBin);
+    if (n == 0) return std::nan("");
+    unsigned long long above = 0;
+    for (int b=bucket(ratio)+1; b<nBuckets(); b++) above += counts_[etBin*nBuckets() + b];
+    return double(above)/n;
+  }
+
+private:
+  SketchBinning binning_;
+  std::vector<unsigned long long> counts_;
+  TH2D* hist_;
+};
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef HcalTrigger_Validation_RateQuantities_h
+#define HcalTrigger_Validation_RateQuantities_h
+
+#include "L1Trigger/L1TNtuples/interface/L1AnalysisL1UpgradeDataFormat.h"
+
+#include "HcalTrigger/Validation/interface/BatchHistogram.h"
+#include "HcalTrigger/Validation/interface/CaloTPColumns.h"
+#include "HcalTrigger/Validation/interface/CumulativeRate.h"
+#include "HcalTrigger/Validation/interface/L1UpgradeColumns.h"
+#include "HcalTrigger/Validation/interface/TopN.h"
+
+#include <algorithm>
+#include <vector>
+
+// The per-event quantities of the rate curves and their binning, shared by
+// rates.exe and the rates module of l1validation.exe.
+
+// leading-object quantities with a rate curve, in the order of the *Rates_emu/hw histograms
+enum RateType { kSingleJet, kDoubleJet, kTripleJet, kQuadJet,
+		kSingleEg, kDoubleEg, kSingleTau, kDoubleTau,
+		kSingleISOEg, kDoubleISOEg, kSingleISOTau, kDoubleISOTau,
+		kHtSum, kMhtSum, kEtSum, kMetSum, kMetHFSum, kNRateTypes };
+const char* const rateNames[kNRateTypes] = {"singleJet", "doubleJet", "tripleJet", "quadJet",
+				      "singleEg", "doubleEg", "singleTau", "doubleTau",
+				      "singleISOEg", "doubleISOEg", "singleISOTau", "doubleISOTau",
+				      "htSum", "mhtSum", "etSum", "metSum", "metHFSum"};
+
+// leading energies of the sums in bx 0
+inline void sumQuantities(const L1UpgradeColumns* l1_, double& htSum, double& mhtSum, double& etSum,
+			  double& metSum, double& metHFSum)
+{
+  htSum = mhtSum = etSum = metSum = metHFSum = 0.;
+  // HW includes -2,-1,0,1,2 bx info (hence the different numbers, could cause a seg fault if this changes)
+  for (unsigned int c=0; c<l1_->nSums; c++){
+      if( l1_->sumBx[c] != 0 ) continue;
+      if( l1_->sumType[c] == L1Analysis::kTotalEt ) etSum = l1_->sumEt[c];
+      if( l1_->sumType[c] == L1Analysis::kTotalHt ) htSum = l1_->sumEt[c];
+      if( l1_->sumType[c] == L1Analysis::kMissingEt ) metSum = l1_->sumEt[c];
+      if( l1_->sumType[c] == L1Analysis::kMissingEtHF ) metHFSum = l1_->sumEt[c];
+      if( l1_->sumType[c] == L1Analysis::kMissingHt ) mhtSum = l1_->sumEt[c];
+  }
+}
+
+// get jetEt*, egEt*, tauEt, htSum, mhtSum, etSum, metSum of the emulator
+// ALL EMU OBJECTS HAVE BX=0...
+inline void emuQuantities(const L1UpgradeColumns* l1emu_, double et[kNRateTypes])
+{
+  // emulator jets come sorted in Et
+  double jetEt[4] = {0., 0., 0., 0.};
+  for (unsigned c=0; c<4 && c<l1emu_->nJets; c++) jetEt[c] = l1emu_->jetEt[c];
+
+  //EG and tau pt's are not given in descending order
+  auto all = [](unsigned) { return true; };
+  TopN<2> egEt, egISOEt;
+  rankObjects(l1emu_->nEGs, l1emu_->egEt, all, [&](unsigned c) { return l1emu_->egIso[c]==1; }, egEt, egISOEt);
+  TopN<2> tauEt, tauISOEt;
+  rankObjects(l1emu_->nTaus, l1emu_->tauEt, all, [&](unsigned c) { return l1emu_->tauIso[c]>0; }, tauEt, tauISOEt);
+
+  double htSum, mhtSum, etSum, metSum, metHFSum;
+  sumQuantities(l1emu_, htSum, mhtSum, etSum, metSum, metHFSum);
+
+  double quantities[kNRateTypes] = {jetEt[0], jetEt[1], jetEt[2], jetEt[3],
+				    egEt[0], egEt[1], tauEt[0], tauEt[1],
+				    egISOEt[0], egISOEt[1], tauISOEt[0], tauISOEt[1],
+				    htSum, mhtSum, etSum, metSum, metHFSum};
+  std::copy(quantities, quantities+kNRateTypes, et);
+}
+
+// get jetEt*, egEt*, tauEt, htSum, mhtSum, etSum, metSum of the hardware
+// ***INCLUDES NON_ZERO bx*** can't just read values off
+inline void hwQuantities(const L1UpgradeColumns* l1hw_, double et[kNRateTypes])
+{
+  TopN<4> jetEt;
+  rankObjects(l1hw_->nJets, l1hw_->jetEt, [&](unsigned c) { return l1hw_->jetBx[c]==0; }, jetEt);
+
+  TopN<2> egEt, egISOEt;
+  rankObjects(l1hw_->nEGs, l1hw_->egEt, [&](unsigned c) { return l1hw_->egBx[c]==0; },
+	      [&](unsigned c) { return l1hw_->egIso[c]==1; }, egEt, egISOEt);
+  TopN<2> tauEt, tauISOEt;
+  rankObjects(l1hw_->nTaus, l1hw_->tauEt, [&](unsigned c) { return l1hw_->tauBx[c]==0; },
+	      [&](unsigned c) { return l1hw_->tauIso[c]>0; }, tauEt, tauISOEt);
+
+  double htSum, mhtSum, etSum, metSum, metHFSum;
+  sumQuantities(l1hw_, htSum, mhtSum, etSum, metSum, metHFSum);
+
+  double quantities[kNRateTypes] = {jetEt[0], jetEt[1], jetEt[2], jetEt[3],
+				    egEt[0], egEt[1], tauEt[0], tauEt[1],
+				    egISOEt[0], egISOEt[1], tauISOEt[0], tauISOEt[1],
+				    htSum, mhtSum, etSum, metSum, metHFSum};
+  std::copy(quantities, quantities+kNRateTypes, et);
+}
+
+inline void fillTPs(const CaloTPColumns* l1TP_, BatchHistogram& hcalTP, BatchHistogram& ecalTP)
+{
+  hcalTP.fill(l1TP_->hcalTPet, l1TP_->nHCALTP);
+  ecalTP.fill(l1TP_->ecalTPet, l1TP_->nECALTP);
+}
+
+// empty TP spectrum, with the binning of the *TP_emu/hw histograms
+inline BatchHistogram bookTPCounts()
+{
+  // tp bins
+  int nTpBins = 100;
+  float tpLo = 0.;
+  float tpHi = 100.;
+
+  return BatchHistogram(nTpBins, tpLo, tpHi);
+}
+
+// empty rate curves, with the binning of the *Rates_emu/hw histograms
+inline std::vector<CumulativeRate> bookRateCurves()
+{
+  // set parameters for histograms
+  // jet bins
+  int nJetBins = 400;
+  float jetLo = 0.;
+  float jetHi = 400.;
+
+  // EG bins
+  int nEgBins = 300;
+  float egLo = 0.;
+  float egHi = 300.;
+
+  // tau bins
+  int nTauBins = 300;
+  float tauLo = 0.;
+  float tauHi = 300.;
+
+  // htSum bins
+  int nHtSumBins = 600;
+  float htSumLo = 0.;
+  float htSumHi = 600.;
+
+  // mhtSum bins
+  int nMhtSumBins = 300;
+  float mhtSumLo = 0.;
+  float mhtSumHi = 300.;
+
+  // etSum bins
+  int nEtSumBins = 600;
+  float etSumLo = 0.;
+  float etSumHi = 600.;
+
+  // metSum bins
+  int nMetSumBins = 300;
+  float metSumLo = 0.;
+  float metSumHi = 300.;
+
+  // metHFSum bins
+  int nMetHFSumBins = 300;
+  float metHFSumLo = 0.;
+  float metHFSumHi = 300.;
+
+  std::vector<CumulativeRate> curves;
+  for (int r=kSingleJet; r<=kQuadJet; r++) curves.push_back(CumulativeRate(nJetBins, jetLo, jetHi));
+  curves.push_back(CumulativeRate(nEgBins, egLo, egHi));         // singleEg
+  curves.push_back(CumulativeRate(nEgBins, egLo, egHi));         // doubleEg
+  curves.push_back(CumulativeRate(nTauBins, tauLo, tauHi));      // singleTau
+  curves.push_back(CumulativeRate(nTauBins, tauLo, tauHi));      // doubleTau
+  curves.push_back(CumulativeRate(nEgBins, egLo, egHi));         // singleISOEg
+  curves.push_back(CumulativeRate(nEgBins, egLo, egHi));         // doubleISOEg
+  curves.push_back(CumulativeRate(nTauBins, tauLo, tauHi));      // singleISOTau
+  curves.push_back(CumulativeRate(nTauBins, tauLo, tauHi));      // doubleISOTau
+  curves.push_back(CumulativeRate(nHtSumBins, htSumLo, htSumHi));
+  curves.push_back(CumulativeRate(nMhtSumBins, mhtSumLo, mhtSumHi));
+  curves.push_back(CumulativeRate(nEtSumBins, etSumLo, etSumHi));
+  curves.push_back(CumulativeRate(nMetSumBins, metSumLo, metSumHi));
+  curves.push_back(CumulativeRate(nMetHFSumBins, metHFSumLo, metHFSumHi));
+  return curves;
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef HcalTrigger_Validation_ResultCache_h
+#define HcalTrigger_Validation_ResultCache_h
+
+#include "TChain.h"
+#include "TFile.h"
+#include "TNamed.h"
+#include "TRegexp.h"
+#include "TString.h"
+#include "TSystem.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <climits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glob.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a URL such as root://eosuser.cern.ch//eos/..., read through the ROOT plugins
+inline bool isRemoteFile(const std::string& file)
+{
+  return file.find("://") != std::string::npos;
+}
+
+// files matching a glob pattern such as dir/L1Ntuple_*.root, in sorted order.
+// Remote directories are listed through TSystem, which only takes wildcards
+// in the file name; a remote pattern without them is taken as it is.
+inline std::vector<std::string> expandInputFiles(const std::string& pattern)
+{
+  std::vector<std::string> files;
+  if (!isRemoteFile(pattern)) {
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, 0, &matches) == 0) {
+      for (size_t i=0; i<matches.gl_pathc; i++) files.push_back(matches.gl_pathv[i]);
+    }
+    globfree(&matches);
+    return files;
+  }
+
+  size_t slash = pattern.rfind('/');
+  std::string name(pattern.substr(slash+1));
+  if (name.find_first_of("*?[") == std::string::npos) {
+    files.push_back(pattern);
+    return files;
+  }
+  std::string directory(pattern.substr(0, slash));
+  void* dir = gSystem->OpenDirectory(directory.c_str());
+  if (!dir) return files;
+  TRegexp wildcard(name.c_str(), kTRUE);
+  while (const char* entry = gSystem->GetDirEntry(dir)) {
+    if (TString(entry).Index(wildcard) != kNPOS) files.push_back(directory + "/" + entry);
+  }
+  gSystem->FreeDirectory(dir);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// the ntuples given on the command line: a directory of L1Ntuple_*.root
+// files, or a file (or pattern) ending in .root
+inline std::string ntupleFiles(const std::string& path)
+{
+  if (path.size() > 5 && path.compare(path.size()-5, 5, ".root") == 0) return path;
+  return path + "/L1Ntuple_*.root";
+}
+
+inline void addInputFiles(TChain* chain, const std::vector<std::string>& files)
+{
+  for (const std::string& file : files) chain->Add(file.c_str());
+}
+
+// "path:size:mtime" of a file, empty if it does not exist; local paths are
+// made absolute, remote files are asked through TSystem as well
+inline std::string fileStamp(const std::string& file)
+{
+  FileStat_t st;
+  if (gSystem->GetPathInfo(file.c_str(), st) != 0) return "";
+  char fullPath[PATH_MAX];
+  std::ostringstream stamp;
+  if (!isRemoteFile(file) && realpath(file.c_str(), fullPath)) stamp << fullPath;
+  else stamp << file;
+  stamp << ':' << st.fSize << ':' << st.fMtime;
+  return stamp.str();
+}
+
+// Per-input-file partial results of a tool. Each entry is a ROOT file in
+// the cache directory, named after a hash of the input file's path, size
+// and modification time plus a description of everything else the partial
+// results depend on (binning, selection, good-lumi mask). The full key is
+// stored in the entry and compared on lookup, so a changed input file or
+// configuration is never served from the cache. Entries are written under
+// a temporary name and renamed when complete, so an interrupted job does
+// not leave a truncated entry behind.
+class ResultCache {
+public:
+  ResultCache(const std::string& directory, const std::string& config)
+    : directory_(directory), config_(config) {
+    mkdir(directory_.c_str(), 0755);
+  }
+
+  // cached partial results for file, 0 if there are none (caller closes)
+  TFile* open(const std::string& file) const {
+    std::string key = this->key(file);
+    if (key.empty() || access(path(key).c_str(), R_OK) != 0) return 0;
+    TFile* entry = TFile::Open(path(key).c_str());
+    if (!entry || entry->IsZombie()) {
+      delete entry;
+      return 0;
+    }
+    TNamed* stored = dynamic_cast<TNamed*>(entry->Get("cacheKey"));
+    if (!stored || key != stored->GetTitle()) {
+      entry->Close();
+      delete entry;
+      return 0;
+    }
+    return entry;
+  }
+
+  // new entry for file, to be filled and then passed to commit()
+  TFile* create(const std::string& file) const {
+    std::string key = this->key(file);
+    if (key.empty()) return 0;
+    TFile* entry = TFile::Open((path(key) + ".tmp").c_str(), "recreate");
+    if (!entry || entry->IsZombie()) {
+      delete entry;
+      return 0;
+    }
+    TNamed stored("cacheKey", key.c_str());
+    stored.Write();
+    return entry;
+  }
+
+  void commit(TFile* entry, const std::string& file) const {
+    entry->Close();
+    delete entry;
+    std::string name = path(key(file));
+    std::rename((name + ".tmp").c_str(), name.c_str());
+  }
+
+private:
+  std::string key(const std::string& file) const {
+    std::string stamp = fileStamp(file);
+    return stamp.empty() ? stamp : stamp + '|' + config_;
+  }
+
+  // 64-bit FNV-1a of the key
+  std::string path(const std::string& key) const {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : key) {
+      hash ^= c;
+      hash *= 1099511628211ULL;
+    }
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return directory_ + "/" + name + ".root";
+  }
+
+  std::string directory_;
+  std::string config_;
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef HcalTrigger_Validation_RunReport_h
+#define HcalTrigger_Validation_RunReport_h
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Wall time, calls and bytes of the stages of a job (opening the chains,
+// GetEntry of each tree, ranking the objects, filling, writing). Stages are
+// registered by name and updated by index in the event loop; every thread
+// keeps its own and they are merged by name, so the times of a multi-threaded
+// loop add up to more than its wall time.
+class StageTimes {
+public:
+  int stage(const std::string& name) {
+    for (size_t s=0; s<stages_.size(); s++) {
+      if (stages_[s].name == name) return s;
+    }
+    stages_.push_back(Stage(name));
+    return stages_.size()-1;
+  }
+
+  void add(int stage, double seconds, Long64_t bytes = 0) {
+    stages_[stage].seconds += seconds;
+    stages_[stage].calls++;
+    stages_[stage].bytes += bytes;
+  }
+
+  void add(const StageTimes& other) {
+    for (const Stage& s : other.stages_) {
+      Stage& mine = stages_[stage(s.name)];
+      mine.seconds += s.seconds;
+      mine.calls += s.calls;
+      mine.bytes += s.bytes;
+    }
+  }
+
+  size_t size() const { return stages_.size(); }
+  const std::string& name(size_t s) const { return stages_[s].name; }
+  double seconds(size_t s) const { return stages_[s].seconds; }
+  Long64_t calls(size_t s) const { return stages_[s].calls; }
+  Long64_t bytes(size_t s) const { return stages_[s].bytes; }
+
+private:
+  struct Stage {
+    explicit Stage(const std::string& name_) : name(name_), seconds(0.), calls(0), bytes(0) {}
+    std::string name;
+    double seconds;
+    Long64_t calls;
+    Long64_t bytes;  // uncompressed, as returned by GetEntry
+  };
+  std::vector<Stage> stages_;
+};
+
+// seconds since construction or the previous lap
+class StageClock {
+public:
+  StageClock() : last_(std::chrono::steady_clock::now()) {}
+  double lap() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now-last_).count();
+    last_ = now;
+    return seconds;
+  }
+
+private:
+  std::chrono::steady_clock::time_point last_;
+};
+
+// Splits the wall time of an event loop into stages: start(stage) charges
+// the time since the previous start to the stage that was running, read()
+// times a GetEntry with the bytes it returns. Every charge counts as a call.
+class StageTimer {
+public:
+  explicit StageTimer(StageTimes& times) : times_(times), current_(-1) {}
+
+  void start(int stage) {
+    double seconds = clock_.lap();
+    if (current_ >= 0) times_.add(current_, seconds);
+    current_ = stage;
+  }
+  void stop() { start(-1); }
+
+  void read(TTree* tree, Long64_t entry, int stage) {
+    start(-1);
+    Int_t bytes = tree->GetEntry(entry);
+    times_.add(stage, clock_.lap(), bytes);
+  }
+
+private:
+  StageTimes& times_;
+  StageClock clock_;
+  int current_;
+};
+
+// The "Done N events of M" line every 10000 events, with the throughput so
+// far and the estimated time left; count() may be called from any thread.
+class EventProgress {
+public:
+  explicit EventProgress(Long64_t nentries)
+    : nentries_(nentries), nDone_(0), start_(std::chrono::steady_clock::now()) {}
+
+  void count() {
+    Long64_t done = nDone_++;
+    if((done%10000)==0) {
+      double rate = done/seconds();
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::cout << "Done " << done  << " events of " << nentries_;
+      if (done > 0) std::cout << " (" << Long64_t(rate) << " events/s, ETA " << Long64_t((nentries_-done)/rate) << " s)";
+      std::cout << std::endl;
+    }
+  }
+
+  Long64_t nDone() const { return nDone_; }
+  double seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start_).count();
+  }
+
+private:
+  Long64_t nentries_;
+  std::atomic<Long64_t> nDone_;
+  std::chrono::steady_clock::time_point start_;
+  std::mutex mutex_;
+};
+
+// peak resident set size of the process so far, in kB
+inline long peakRssKB()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// foo.root -> foo.json
+inline std::string reportFileName(const std::string& outputFilename)
+{
+  std::string name(outputFilename);
+  if (name.size() > 5 && name.compare(name.size()-5, 5, ".root") == 0) name.resize(name.size()-5);
+  return name + ".json";
+}
+
+inline std::string jsonString(const std::string& s)
+{
+  std::string quoted("\"");
+  for (char c : s) {
+    if (c == '"' || c == '\\') quoted += '\\';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+// Throughput report of a job as JSON: events read and per second of the
+// event loop, peak RSS, compressed bytes read from all files and the stages.
+// GetEntry stages include reading and decompressing the baskets; their
+// bytes are the uncompressed sizes GetEntry returns, labelled as such.
+inline bool writeRunReport(const std::string& fileName, const std::string& tool, const std::string& input,
+			   int nThreads, Long64_t nEvents, Long64_t goodEvents, double loopSeconds,
+			   double totalSeconds, const StageTimes& times)
+{
+  std::ofstream out(fileName.c_str());
+  if (!out) return false;
+  out << "{\n"
+      << "  \"tool\": " << jsonString(tool) << ",\n"
+      << "  \"input\": " << jsonString(input) << ",\n"
+      << "  \"threads\": " << nThreads << ",\n"
+      << "  \"events\": " << nEvents << ",\n"
+      << "  \"goodEvents\": " << goodEvents << ",\n"
+      << "  \"loopSeconds\": " << loopSeconds << ",\n"
+      << "  \"totalSeconds\": " << totalSeconds << ",\n"
+      << "  \"eventsPerSecond\": " << (loopSeconds > 0. ? nEvents/loopSeconds : 0.) << ",\n"
+      << "  \"peakRssKB\": " << peakRssKB() << ",\n"
+      << "  \"fileBytesRead\": " << TFile::GetFileBytesRead() << ",\n"
+      << "  \"stages\": [";
+  bool first = true;
+  for (size_t s=0; s<times.size(); s++) {
+    if (times.calls(s) == 0) continue;  // registered but not used by this job
+    out << (first ? "\n" : ",\n")
+	<< "    {\"name\": " << jsonString(times.name(s)) << ", \"seconds\": " << times.seconds(s)
+	<< ", \"calls\": " << times.calls(s) << ", \"uncompressedBytes\": " << times.bytes(s) << "}";
+    first = false;
+  }
+  out << "\n  ]\n}" << std::endl;
+  return true;
+}
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef HcalTrigger_Validation_SeedMenu_h
+#define HcalTrigger_Validation_SeedMenu_h
+
+#include "HcalTrigger/Validation/interface/TopN.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// L1 objects and sums of one event as the menu sees them (bx 0 only)
+enum MenuObjectType { kMenuJet, kMenuEg, kMenuTau, kNMenuObjectTypes };
+enum MenuSumType { kMenuHtSum, kMenuMhtSum, kMenuEtSum, kMenuMetSum, kMenuMetHFSum, kNMenuSumTypes };
+
+struct MenuObject {
+  float et;
+  float eta;
+  bool iso;
+};
+
+struct MenuEvent {
+  uint64_t id;  // well-mixed event id, used for the prescales
+  std::vector<MenuObject> objects[kNMenuObjectTypes];
+  double sums[kNMenuSumTypes];
+};
+
+// A menu of L1 seeds read from a text file, one seed per line:
+//   name prescale [condition ...]
+// A seed fires if all its conditions hold (no condition: every event).
+// Conditions are written without spaces,
+//   [n*]object>=threshold[@etaMax]   object: jet eg isoEg tau isoTau
+//   sum>=threshold                   sum: htSum mhtSum etSum metSum metHFSum
+// e.g. "L1_DoubleJet100er2p5 1 2*jet>=100@2.5" or
+// "L1_LooseIsoEG26er2p1_HTT200 1 isoEg>=26@2.1 htSum>=200". '#' starts a
+// comment. Each distinct object requirement (n-th leading object of a
+// type, isolation and eta range) becomes one feature, computed once per
+// event however many seeds use it.
+class SeedMenu {
+public:
+  // false (with a message in error) if the file cannot be read or parsed
+  bool load(const std::string& fileName, std::string& error) {
+    std::ifstream in(fileName.c_str());
+    if (!in) {
+      error = "cannot open " + fileName;
+      return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+      lineNumber++;
+      line = line.substr(0, line.find('#'));
+      std::istringstream tokens(line);
+      Seed seed;
+      if (!(tokens >> seed.name)) continue;
+      std::ostringstream where;
+      where << fileName << ":" << lineNumber << ": ";
+      if (!(tokens >> seed.prescale) || seed.prescale < 1) {
+        error = where.str() + "missing or invalid prescale";
+        return false;
+      }
+      std::string condition;
+      while (tokens >> condition) {
+        int c = addCondition(condition);
+        if (c < 0) {
+          error = where.str() + "cannot parse condition " + condition;
+          return false;
+        }
+        seed.conditions.push_back(c);
+      }
+      seeds_.push_back(seed);
+    }
+    if (seeds_.empty()) {
+      error = fileName + " has no seeds";
+      return false;
+    }
+    return true;
+  }
+
+  size_t nSeeds() const { return seeds_.size(); }
+  const std::string& name(size_t seed) const { return seeds_[seed].name; }
+  unsigned prescale(size_t seed) const { return seeds_[seed].prescale; }
+  size_t nFeatures() const { return features_.size(); }
+
+  // value of every feature for one event; -1 where there are too few objects
+  void features(const MenuEvent& event, float* values) const {
+    for (size_t f=0; f<features_.size(); f++) {
+      const Feature& feature = features_[f];
+      if (feature.sum >= 0) {
+        values[f] = event.sums[feature.sum];
+        continue;
+      }
+      TopN<4> et;
+      unsigned n = 0;
+      for (const MenuObject& object : event.objects[feature.object]) {
+        if (feature.iso && !object.iso) continue;
+        if (!(std::fabs(object.eta) <= feature.etaMax)) continue;
+        et.push(object.et);
+        n++;
+      }
+      values[f] = n >= feature.count ? et[feature.count-1] : -1.f;
+    }
+  }
+
+private:
+  friend class MenuRates;
+
+  struct Feature {
+    int sum;          // MenuSumType, or -1 for an object requirement
+    int object;       // MenuObjectType
+    bool iso;
+    unsigned count;   // n-th leading object, 1-4
+    float etaMax;
+    bool operator==(const Feature& other) const {
+      return sum == other.sum && object == other.object && iso == other.iso
+        && count == other.count && etaMax == other.etaMax;
+    }
+  };
+
+  struct Condition {
+    int feature;
+    float threshold;
+  };
+
+  struct Seed {
+    std::string name;
+    unsigned prescale;
+    std::vector<int> conditions;
+  };
+
+  // index of the parsed condition, -1 if it is malformed
+  int addCondition(const std::string& text) {
+    size_t ge = text.find(">=");
+    if (ge == std::string::npos) return -1;
+    std::string lhs = text.substr(0, ge);
+    std::string rhs = text.substr(ge+2);
+
+    Feature feature = {-1, 0, false, 1, std::numeric_limits<float>::infinity()};
+    size_t star = lhs.find('*');
+    if (star != std::string::npos) {
+      feature.count = std::atoi(lhs.substr(0, star).c_str());
+      lhs = lhs.substr(star+1);
+    }
+    size_t at = rhs.find('@');
+    if (at != std::string::npos) {
+      feature.etaMax = std::atof(rhs.substr(at+1).c_str());
+      rhs = rhs.substr(0, at);
+    }
+    if (feature.count < 1 || feature.count > 4) return -1;
+
+    static const char* sumNames[kNMenuSumTypes] = {"htSum", "mhtSum", "etSum", "metSum", "metHFSum"};
+    for (int s=0; s<kNMenuSumTypes; s++) {
+      if (lhs == sumNames[s]) feature.sum = s;
+    }
+    if (feature.sum >= 0) {
+      if (star != std::string::npos || at != std::string::npos) return -1;
+    }
+    else if (lhs == "jet") feature.object = kMenuJet;
+    else if (lhs == "eg" || lhs == "isoEg") feature.object = kMenuEg;
+    else if (lhs == "tau" || lhs == "isoTau") feature.object = kMenuTau;
+    else return -1;
+    feature.iso = lhs == "isoEg" || lhs == "isoTau";
+
+    char* end;
+    Condition condition;
+    condition.threshold = std::strtod(rhs.c_str(), &end);
+    if (rhs.empty() || *end != '\0') return -1;
+
+    condition.feature = -1;
+    for (size_t f=0; f<features_.size(); f++) {
+      if (features_[f] == feature) condition.feature = f;
+    }
+    if (condition.feature < 0) {
+      condition.feature = features_.size();
+      features_.push_back(feature);
+    }
+    conditions_.push_back(condition);
+    return conditions_.size()-1;
+  }
+
+  std::vector<Feature> features_;
+  std::vector<Condition> conditions_;
+  std::vector<Seed> seeds_;
+};
+
+// Counts of a menu over a set of events. Events are buffered 64 at a time
+// as feature columns; every condition is then one branch-free comparison
+// loop over the block giving a 64-bit mask, a seed is the AND of its
+// condition masks, and the total, pure and overlap counts are popcounts
+// of ORs and ANDs of the seed masks. A prescaled seed keeps a fixed 1/P
+// subset of its events chosen by the event id, so the result does not
+// depend on the order or the threads the events were processed in.
+class MenuRates {
+public:
+  // no menu: nothing is counted
+  explicit MenuRates(const SeedMenu* menu)
+    : menu_(menu), nSeeds_(menu ? menu->nSeeds() : 0), nFeatures_(menu ? menu->nFeatures() : 0),
+      nRows_(0), nEvents_(0), total_(0),
+      features_(kBlock*nFeatures_), ids_(kBlock), fired_(nSeeds_, 0), pure_(nSeeds_, 0),
+      overlap_(nSeeds_*nSeeds_, 0), masks_(nSeeds_), others_(nSeeds_+1), row_(nFeatures_) {}
+
+  bool active() const { return menu_ != 0; }
+
+  void fill(const MenuEvent& event) {
+    if (!menu_) return;
+    menu_->features(event, row_.data());
+    for (size_t f=0; f<nFeatures_; f++) features_[f*kBlock + nRows_] = row_[f];
+    ids_[nRows_] = event.id;
+    if (++nRows_ == kBlock) flush();
+  }
+
+  // count the buffered events; call before reading the counts
+  void flush() {
+    if (nRows_ == 0) return;
+    uint64_t valid = nRows_ == kBlock ? ~uint64_t(0) : (uint64_t(1) << nRows_) - 1;
+    std::vector<uint64_t> conditionMasks(menu_->conditions_.size());
+    for (size_t c=0; c<conditionMasks.size(); c++) {
+      const SeedMenu::Condition& condition = menu_->conditions_[c];
+      const float* feature = &features_[condition.feature*kBlock];
+      float threshold = condition.threshold;
+      uint64_t mask = 0;
+      for (int i=0; i<kBlock; i++) mask |= uint64_t(feature[i] >= threshold) << i;
+      conditionMasks[c] = mask;
+    }
+
+    for (size_t s=0; s<nSeeds_; s++) {
+      const SeedMenu::Seed& seed = menu_->seeds_[s];
+      uint64_t mask = valid;
+      for (int c : seed.conditions) mask &= conditionMasks[c];
+      if (seed.prescale > 1) mask &= prescaleMask(mask, s, seed.prescale);
+      masks_[s] = mask;
+    }
+
+    // others_[s]: OR of the seeds before s, then combined with those after
+    others_[0] = 0;
+    for (size_t s=0; s<nSeeds_; s++) others_[s+1] = others_[s] | masks_[s];
+    uint64_t any = others_[nSeeds_];
+    uint64_t after = 0;
+    for (size_t s=nSeeds_; s-- > 0;) {
+      uint64_t others = others_[s] | after;
+      fired_[s] += __builtin_popcountll(masks_[s]);
+      pure_[s] += __builtin_popcountll(masks_[s] & ~others);
+      after |= masks_[s];
+      for (size_t t=s+1; t<nSeeds_; t++) overlap_[s*nSeeds_ + t] += __builtin_popcountll(masks_[s] & masks_[t]);
+    }
+    total_ += __builtin_popcountll(any);
+    nEvents_ += nRows_;
+    nRows_ = 0;
+  }
+
+  void add(const MenuRates& other) {
+    total_ += other.total_;
+    nEvents_ += other.nEvents_;
+    for (size_t s=0; s<nSeeds_; s++) {
+      fired_[s] += other.fired_[s];
+      pure_[s] += other.pure_[s];
+    }
+    for (size_t i=0; i<overlap_.size(); i++) overlap_[i] += other.overlap_[i];
+  }
+
+  long long nEvents() const { return nEvents_; }
+  // events passing any seed, after the prescales
+  long long total() const { return total_; }
+  long long fired(size_t seed) const { return fired_[seed]; }
+  // events passing only this seed
+  long long pure(size_t seed) const { return pure_[seed]; }
+  // events passing both seeds (fired() on the diagonal)
+  long long overlap(size_t seed1, size_t seed2) const {
+    if (seed1 == seed2) return fired_[seed1];
+    return seed1 < seed2 ? overlap_[seed1*nSeeds_ + seed2] : overlap_[seed2*nSeeds_ + seed1];
+  }
+
+private:
+  static const int kBlock = 64;
+
+  // the bits of mask whose event is kept by a prescale of the seed
+  uint64_t prescaleMask(uint64_t mask, size_t seed, unsigned prescale) const {
+    uint64_t keep = 0;
+    for (int i=0; i<kBlock; i++) {
+      if (!((mask >> i) & 1)) continue;
+      uint64_t x = ids_[i] + 0x9e3779b97f4a7c15ULL*(seed+1);
+      x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+      x ^= x >> 31;
+      if (x % prescale == 0) keep |= uint64_t(1) << i;
+    }
+    return keep;
+  }
+
+  const SeedMenu* menu_;
+  size_t nSeeds_;
+  size_t nFeatures_;
+  int nRows_;
+  long long nEvents_;
+  long long total_;
+  std::vector<float> features_;   // feature-major, kBlock rows each
+  std::vector<uint64_t> ids_;
+  std::vector<long long> fired_;
+  std::vector<long long> pure_;
+  std::vector<long long> overlap_;  // upper triangle, seed1 < seed2
+  std::vector<uint64_t> masks_;
+  std::vector<uint64_t> others_;
+  std::vector<float> row_;
+};
+
+#endif
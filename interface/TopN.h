@@ -0,0 +1,54 @@
+#ifndef HcalTrigger_Validation_TopN_h
+#define HcalTrigger_Validation_TopN_h
+
+#include <algorithm>
+#include <vector>
+
+// The N highest values pushed so far, in descending order, 0 where fewer
+// than N positive values were seen. Values that do not beat the current
+// N-th (including NaN) are dropped with one comparison; the others go
+// through a fixed min/max insertion network.
+template <int N>
+class TopN {
+public:
+  TopN() { std::fill(et_, et_+N, 0.); }
+
+  void push(double et) {
+    if (!(et > et_[N-1])) return;
+    for (int i=0; i<N; i++) {
+      double hi = std::max(et_[i], et);
+      et = std::min(et_[i], et);
+      et_[i] = hi;
+    }
+  }
+
+  // i-th highest value, i < N
+  double operator[](int i) const { return et_[i]; }
+
+private:
+  double et_[N];
+};
+
+// Rank the n objects accepted by select.
+template <int N, typename Select>
+void rankObjects(unsigned n, const std::vector<float>& et, Select select, TopN<N>& all)
+{
+  for (unsigned c=0; c<n; c++) {
+    if (select(c)) all.push(et[c]);
+  }
+}
+
+// Rank n objects in one pass: those accepted by select go into all, and
+// those also accepted by isolated into iso.
+template <int N, typename Select, typename Isolated>
+void rankObjects(unsigned n, const std::vector<float>& et, Select select, Isolated isolated,
+                 TopN<N>& all, TopN<N>& iso)
+{
+  for (unsigned c=0; c<n; c++) {
+    if (!select(c)) continue;
+    all.push(et[c]);
+    if (isolated(c)) iso.push(et[c]);
+  }
+}
+
+#endif
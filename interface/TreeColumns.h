@@ -0,0 +1,67 @@
+#ifndef HcalTrigger_Validation_TreeColumns_h
+#define HcalTrigger_Validation_TreeColumns_h
+
+#include "TTree.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Base for reading selected leaves of a split ntuple branch into plain
+// members instead of streaming the whole object. attach() switches the
+// tree to MakeClass mode and disables every branch; each column then
+// enables and binds its own leaf. The bindings are kept, so the columns
+// can be attached to the same tree of the next file. The vectors are owned
+// here and reused from entry to entry, so their capacity is only allocated
+// once.
+class TreeColumns {
+public:
+  TreeColumns(const TreeColumns&) = delete;
+  TreeColumns& operator=(const TreeColumns&) = delete;
+
+  void attach(TTree* tree) {
+    tree_ = tree;
+    tree_->SetMakeClass(1);
+    tree_->SetBranchStatus("*", 0);
+    for (const std::function<void(TTree*)>& connection : connections_) connection(tree_);
+  }
+
+protected:
+  // without a tree, nothing is bound until attach()
+  explicit TreeColumns(TTree* tree) : tree_(0) {
+    if (tree) attach(tree);
+  }
+
+  template <typename T>
+  void connect(const char* leaf, T& column) {
+    std::string name(leaf);
+    T* address = &column;
+    add([name, address](TTree* tree) {
+	tree->SetBranchStatus(name.c_str(), 1);
+	tree->SetBranchAddress(name.c_str(), address);
+      });
+  }
+
+  // vector leaves are bound through a pointer, which has to stay valid
+  template <typename T>
+  void connect(const char* leaf, std::vector<T>& column) {
+    std::string name(leaf);
+    std::shared_ptr<std::vector<T>*> address(new std::vector<T>*(&column));
+    add([name, address](TTree* tree) {
+	tree->SetBranchStatus(name.c_str(), 1);
+	tree->SetBranchAddress(name.c_str(), address.get());
+      });
+  }
+
+private:
+  void add(const std::function<void(TTree*)>& connection) {
+    connections_.push_back(connection);
+    if (tree_) connection(tree_);
+  }
+
+  TTree* tree_;
+  std::vector<std::function<void(TTree*)> > connections_;
+};
+
+#endif
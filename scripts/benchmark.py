@@ -0,0 +1,257 @@
+#!/usr/bin/env python
+"""Time rates.exe and l1jetanalysis.exe on synthetic ntuples and check their output
+
+Generates "def" and "new" ntuples of the same events with synthetic_ntuples.exe
+(once per work directory), runs the tools on them for every thread count and
+compares every histogram and graph of the outputs with the first run and with
+a golden reference. Timings come from the JSON reports the tools write. The
+rate vs pileup fit of rates.exe -p is checked against the same fit done here,
+on a pileup table in which one pileup bin has too few events to pass the
+higher thresholds.
+
+Make a reference once, e.g. on the release before an optimisation:
+./benchmark.py -w /tmp/bench --update-golden golden_dir
+and compare against it afterwards:
+./benchmark.py -w /tmp/bench -g golden_dir
+"""
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+PARSER = argparse.ArgumentParser()
+PARSER.add_argument('-w', '--workdir', default='benchmark')
+PARSER.add_argument('-n', '--events', type=int, default=20000, help='events per file')
+PARSER.add_argument('-f', '--files', type=int, default=4)
+PARSER.add_argument('-p', '--pileup', type=float, default=40.)
+PARSER.add_argument('-s', '--seed', type=int, default=1)
+PARSER.add_argument('-r', '--response', type=float, default=1.1, help='emulated HCAL response of "new"')
+PARSER.add_argument('-j', '--threads', default='1,2,4', help='thread counts of rates.exe')
+PARSER.add_argument('-g', '--golden', help='directory with the reference outputs')
+PARSER.add_argument('--update-golden', help='store the outputs as the reference in this directory')
+ARGS = PARSER.parse_args()
+
+WORKDIR = os.path.abspath(ARGS.workdir)
+THREADS = [int(t) for t in ARGS.threads.split(',')]
+
+
+def run(cmd, cwd):
+    """run cmd in cwd, return the wall time; the log goes to cwd/log.txt"""
+    start = time.time()
+    with open(os.path.join(cwd, 'log.txt'), 'w') as log:
+        status = subprocess.call(cmd, cwd=cwd, stdout=log, stderr=subprocess.STDOUT)
+    if status != 0:
+        sys.exit('"' + ' '.join(cmd) + '" failed, see ' + os.path.join(cwd, 'log.txt'))
+    return time.time() - start
+
+
+def make_ntuples():
+    """def and new ntuples of the same events, unless they exist already"""
+    config = [ARGS.events, ARGS.files, ARGS.pileup, ARGS.seed, ARGS.response]
+    config_file = os.path.join(WORKDIR, 'ntuples.json')
+    if os.path.exists(config_file):
+        with open(config_file) as old:
+            if json.load(old) == config:
+                return
+    for cond, response in [('def', 1.), ('new', ARGS.response)]:
+        path = os.path.join(WORKDIR, cond + '_ntuples')
+        if os.path.exists(path):
+            shutil.rmtree(path)
+        os.makedirs(path)
+        run(['synthetic_ntuples.exe', '-n', str(ARGS.events), '-f', str(ARGS.files),
+             '-p', str(ARGS.pileup), '-s', str(ARGS.seed), '-r', str(response), path], path)
+    with open(config_file, 'w') as new:
+        json.dump(config, new)
+
+
+def write_pileup_table():
+    """brilcalc-like CSV of the ntuple lumi sections: alternately pileup 20.5 and
+    40.5, except for the first, alone at 80.5, and the bins between them empty"""
+    path = os.path.join(WORKDIR, 'pileup.csv')
+    n_lumis = (ARGS.events * ARGS.files + 999) // 1000
+    with open(path, 'w') as table:
+        table.write('#run:fill,ls,time,beamstatus,E(GeV),delivered(/ub),recorded(/ub),avgpu,source\n')
+        for lumi in range(1, n_lumis + 1):
+            pileup = 80.5 if lumi == 1 else (20.5 if lumi % 2 else 40.5)
+            table.write('1:1,%d:%d,01/01/18 00:00:00,STABLE BEAMS,6500,1,1,%.1f,HFOC\n' % (lumi, lumi, pileup))
+    return path
+
+
+# PileupRates::kMinCountVariance
+MIN_COUNT_VARIANCE = 1.84 * 1.84
+
+
+def pileup_fit_problems(path, suffix='emu'):
+    """refit the <type>RatesVsPileup_<suffix> rates with the weights of
+    PileupRates::fit and compare with the fit rates.exe wrote"""
+    import ROOT
+    problems = []
+    root_file = ROOT.TFile.Open(path)
+    events = root_file.Get('pileupEvents')
+    n_events = [events.GetBinContent(b) for b in range(1, events.GetNbinsX() + 1)]
+    centres = [events.GetBinCenter(b) for b in range(1, events.GetNbinsX() + 1)]
+    zero_counts = False
+    for key in root_file.GetListOfKeys():
+        name = key.GetName()
+        if not name.endswith('RatesVsPileup_' + suffix):
+            continue
+        rate_type = name[:-len('RatesVsPileup_' + suffix)]
+        rates = key.ReadObj()
+        offset = root_file.Get(rate_type + 'RateFitOffset_' + suffix)
+        slope = root_file.Get(rate_type + 'RateFitSlope_' + suffix)
+        for t in range(1, rates.GetNbinsX() + 1):
+            sums = [0.] * 5
+            passing_bins = 0
+            for b, n in enumerate(n_events):
+                if n == 0:
+                    continue
+                rate = rates.GetBinContent(t, b + 1)
+                error = rates.GetBinError(t, b + 1)
+                # rate = passing*norm and error = sqrt(passing)*norm
+                passing = round((rate / error) ** 2) if error > 0 else 0
+                passing_bins += passing > 0
+                w = n * n / max(passing, MIN_COUNT_VARIANCE)
+                x = centres[b]
+                for i, term in enumerate([w, w * x, w * rate, w * x * x, w * x * rate]):
+                    sums[i] += term
+            if 0 < passing_bins < sum(n > 0 for n in n_events):
+                zero_counts = True
+            sw, swx, swy, swxx, swxy = sums
+            det = sw * swxx - swx * swx
+            fit_slope = (sw * swxy - swx * swy) / det if det > 0 else 0.
+            fit_offset = (swy - fit_slope * swx) / sw if det > 0 else 0.
+            for wanted, hist in [(fit_offset, offset), (fit_slope, slope)]:
+                got = hist.GetBinContent(t)
+                if got != got or abs(got - wanted) > 1e-4 * max(abs(wanted), 1e-3):
+                    problems.append('%s threshold bin %d: %s %g, refit %g' % (rate_type, t, hist.GetName(),
+                                                                               got, wanted))
+    root_file.Close()
+    if not zero_counts:
+        problems.append('no threshold passed by nobody in one pileup bin only')
+    return problems[:5]
+
+
+def run_tool(name, cmd, outputs):
+    """run cmd in its own directory, return that directory and the job report"""
+    cwd = os.path.join(WORKDIR, name)
+    if os.path.exists(cwd):
+        shutil.rmtree(cwd)
+    os.makedirs(os.path.join(cwd, 'output_rates', 'emu'))
+    wall = run(cmd, cwd)
+    report = {}
+    json_file = os.path.join(cwd, outputs[0].replace('.root', '.json'))
+    if os.path.exists(json_file):
+        with open(json_file) as report_file:
+            report = json.load(report_file)
+    report['wall'] = wall
+    return cwd, report
+
+
+def contents(path):
+    """every histogram and graph of a ROOT file, as exact values"""
+    import ROOT
+    result = {}
+    root_file = ROOT.TFile.Open(path)
+
+    def visit(directory, prefix):
+        for key in directory.GetListOfKeys():
+            obj = key.ReadObj()
+            name = prefix + key.GetName()
+            if obj.InheritsFrom('TDirectory'):
+                visit(obj, name + '/')
+            elif obj.InheritsFrom('TH1'):
+                result[name] = ([obj.GetBinContent(i) for i in range(obj.GetNcells())] +
+                                [obj.GetBinError(i) for i in range(obj.GetNcells())])
+            elif obj.InheritsFrom('TGraph'):
+                result[name] = ([obj.GetX()[i] for i in range(obj.GetN())] +
+                                [obj.GetY()[i] for i in range(obj.GetN())])
+    visit(root_file, '')
+    root_file.Close()
+    return result
+
+
+def differences(path, reference):
+    """names of the objects that differ between two ROOT files"""
+    mine = contents(path)
+    theirs = contents(reference)
+    return sorted(name for name in set(mine) | set(theirs) if mine.get(name) != theirs.get(name))
+
+
+def main():
+    """generate, run, compare and summarise"""
+    if not os.path.exists(WORKDIR):
+        os.makedirs(WORKDIR)
+    make_ntuples()
+    pileup_table = write_pileup_table()
+
+    jobs = []
+    for cond in ['def', 'new']:
+        ntuples = os.path.join(WORKDIR, cond + '_ntuples')
+        rates = 'rates_def.root' if cond == 'def' else 'rates_new_cond.root'
+        for threads in THREADS:
+            jobs.append(('rates_%s_j%d' % (cond, threads),
+                         ['rates.exe', '-j', str(threads), cond, ntuples], [rates]))
+        analysis = 'l1analysis_def.root' if cond == 'def' else 'l1analysis_new_cond.root'
+        jobs.append(('l1jetanalysis_' + cond, ['l1jetanalysis.exe', cond, ntuples], [analysis]))
+    jobs.append(('rates_pair_j%d' % THREADS[-1],
+                 ['rates.exe', '-j', str(THREADS[-1]), 'pair', os.path.join(WORKDIR, 'def_ntuples'),
+                  os.path.join(WORKDIR, 'new_ntuples')],
+                 ['rates_paired.root', 'rates_def.root', 'rates_new_cond.root']))
+    jobs.append(('rates_pileup', ['rates.exe', '-p', pileup_table, 'def', os.path.join(WORKDIR, 'def_ntuples')],
+                 ['rates_def.root']))
+
+    summary = []
+    first = {}
+    failed = False
+    print('%-22s %8s %10s %10s %12s  %s' % ('job', 'wall s', 'loop s', 'events/s', 'peak RSS MB', 'output'))
+    for name, cmd, outputs in jobs:
+        cwd, report = run_tool(name, cmd, outputs)
+        status = []
+        if name == 'rates_pileup':
+            status += pileup_fit_problems(os.path.join(cwd, outputs[0]))
+        for output in outputs:
+            path = os.path.join(cwd, output)
+            # the same output of an earlier job (other thread count) and of the reference
+            key = (name.split('_j')[0] if 'pair' not in name else 'pair') + '/' + output
+            if key in first:
+                diff = differences(path, first[key])
+                if diff:
+                    status.append(output + ' differs from ' + os.path.basename(os.path.dirname(first[key])) +
+                                  ': ' + ', '.join(diff[:5]))
+            else:
+                first[key] = path
+            if ARGS.golden:
+                golden = os.path.join(ARGS.golden, key)
+                if not os.path.exists(golden):
+                    status.append('no reference for ' + key)
+                else:
+                    diff = differences(path, golden)
+                    if diff:
+                        status.append(output + ' differs from the reference: ' + ', '.join(diff[:5]))
+        failed = failed or bool(status)
+        print('%-22s %8.1f %10.1f %10.0f %12.1f  %s' % (name, report['wall'], report.get('loopSeconds', 0.),
+                                                       report.get('eventsPerSecond', 0.),
+                                                       report.get('peakRssKB', 0) / 1024.,
+                                                       '; '.join(status) if status else 'identical'))
+        report['job'] = name
+        report['identical'] = not status
+        summary.append(report)
+
+    if ARGS.update_golden:
+        for key, path in first.items():
+            target = os.path.join(ARGS.update_golden, key)
+            if not os.path.exists(os.path.dirname(target)):
+                os.makedirs(os.path.dirname(target))
+            shutil.copy(path, target)
+        print('stored the reference in ' + ARGS.update_golden)
+
+    with open(os.path.join(WORKDIR, 'benchmark.json'), 'w') as out:
+        json.dump(summary, out, indent=2)
+    if failed:
+        sys.exit(1)
+
+
+main()
@@ -0,0 +1,210 @@
+#!/usr/bin/env python
+"""Run rates.exe and l1jetanalysis.exe on all cores of this machine, without a batch system
+
+The ntuples are split into work units of about --entries entries (big files
+into entry ranges, rates.exe -r). A pool of worker processes takes the units
+largest first, each worker the next one as soon as it is done, so the cores
+stay busy until the last units. The partial outputs (rates.exe -w) are added
+up in a tree reduction, --fan-in at a time in parallel, into rates_def.root,
+rates_new_cond.root and output_rates/emu/extraInfo.txt in the current
+directory. l1jetanalysis.exe has no entry ranges; it runs one unit per file
+and its outputs are added up with hadd.
+
+./run_local.py -d /path/to/def/ntuples -n /path/to/new/ntuples -j 16
+./run_local.py -d /path/to/def/ntuples -a rates,analysis -l lumimask.json
+"""
+import argparse
+import glob
+import json
+import multiprocessing
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+PARSER = argparse.ArgumentParser()
+PARSER.add_argument('-d', '--default', help='default conditions ntuple directory')
+PARSER.add_argument('-n', '--new', help='new conditions ntuple directory')
+PARSER.add_argument('-a', '--analyses', default='rates', help='rates and/or analysis, comma separated')
+PARSER.add_argument('-l', '--lumimask', help='good run JSON, passed on with -l')
+PARSER.add_argument('-j', '--jobs', type=int, default=multiprocessing.cpu_count(), help='worker processes')
+PARSER.add_argument('-e', '--entries', type=int, default=200000, help='entries per rates work unit')
+PARSER.add_argument('--fan-in', type=int, default=4, help='partial outputs added up per merge job')
+PARSER.add_argument('-w', '--workdir', default='local_jobs', help='where the units run and the partial outputs go')
+PARSER.add_argument('--keep', action='store_true', help='keep the work directory')
+ARGS = PARSER.parse_args()
+
+WORKDIR = os.path.abspath(ARGS.workdir)
+ANALYSES = ARGS.analyses.split(',')
+
+
+def run(cmd, cwd, log_file=None):
+    """run cmd in cwd (created if needed), logging to cwd/log.txt; the error, if any"""
+    if not os.path.exists(os.path.join(cwd, 'output_rates', 'emu')):
+        os.makedirs(os.path.join(cwd, 'output_rates', 'emu'))
+    log_file = log_file or os.path.join(cwd, 'log.txt')
+    with open(log_file, 'w') as log:
+        status = subprocess.call(cmd, cwd=cwd, stdout=log, stderr=subprocess.STDOUT)
+    if status != 0:
+        return '"' + ' '.join(cmd) + '" failed, see ' + log_file
+    return None
+
+
+def count_entries(path):
+    """entries of the tree rates.exe loops over"""
+    import ROOT
+    root_file = ROOT.TFile.Open(path)
+    if not root_file or root_file.IsZombie():
+        return path, -1
+    tree = root_file.Get('l1UpgradeEmuTree/L1UpgradeTree')
+    entries = tree.GetEntries() if tree else -1
+    root_file.Close()
+    return path, entries
+
+
+def work_units(files, entries, unit_size):
+    """(file, first, last) covering every file, largest first"""
+    units = []
+    for path in files:
+        n_units = max(1, (entries[path] + unit_size - 1) // unit_size)
+        for i in range(n_units):
+            units.append((path, entries[path] * i // n_units, entries[path] * (i + 1) // n_units))
+    return sorted(units, key=lambda unit: unit[1] - unit[2])
+
+
+def run_unit(job):
+    """one work unit; (output, job report, error)"""
+    cmd, cwd, output = job
+    error = run(cmd, cwd)
+    report = {}
+    json_file = os.path.join(cwd, output.replace('.root', '.json'))
+    if not error and os.path.exists(json_file):
+        with open(json_file) as report_file:
+            report = json.load(report_file)
+    return os.path.join(cwd, output), report, error
+
+
+def run_all(pool, jobs):
+    """run the jobs on the pool, the workers taking the next one when free"""
+    results = []
+    for output, report, error in pool.imap_unordered(run_unit, jobs, chunksize=1):
+        if error:
+            pool.terminate()
+            sys.exit(error)
+        results.append((output, report))
+        sys.stdout.write('\r%d of %d jobs done' % (len(results), len(jobs)))
+        sys.stdout.flush()
+    sys.stdout.write('\n')
+    return results
+
+
+def reduce_outputs(pool, outputs, merge_cmd, cwd):
+    """add up the outputs fan-in at a time, level by level, down to at most fan-in"""
+    level = 0
+    while len(outputs) > ARGS.fan_in:
+        jobs = []
+        for i in range(0, len(outputs), ARGS.fan_in):
+            job_dir = os.path.join(cwd, 'merge%d_%d' % (level, i // ARGS.fan_in))
+            merged = os.path.join(job_dir, 'merged.root')
+            jobs.append((merge_cmd(merged, outputs[i:i + ARGS.fan_in]), job_dir, 'merged.root'))
+        # keep the order of the outputs, so the result does not depend on the timing
+        outputs = [output for output, _ in sorted(run_all(pool, jobs))]
+        level += 1
+    return outputs
+
+
+def rates(pool, cond, ntuples):
+    """rates_<cond>.root of the ntuples in a directory"""
+    tag = 'def' if cond == 'def' else 'new_cond'
+    cwd = os.path.join(WORKDIR, 'rates_' + cond)
+    files = sorted(glob.glob(os.path.join(ntuples, 'L1Ntuple_*.root')))
+    if not files:
+        sys.exit('no L1Ntuple_*.root in ' + ntuples)
+    entries = dict(pool.map(count_entries, files))
+    unreadable = [path for path in files if entries[path] < 0]
+    if unreadable:
+        sys.exit('cannot read ' + ', '.join(unreadable))
+
+    units = work_units(files, entries, ARGS.entries)
+    print('rates %s: %d entries in %d files, %d units on %d workers' %
+          (cond, sum(entries.values()), len(files), len(units), ARGS.jobs))
+    jobs = []
+    for i, (path, first, last) in enumerate(units):
+        cmd = ['rates.exe', '-r', '%d:%d' % (first, last), '-w', 'partial.root',
+               '-i', os.path.join(WORKDIR, 'ntuple_index.txt')]
+        if ARGS.lumimask:
+            cmd += ['-l', os.path.abspath(ARGS.lumimask)]
+        jobs.append((cmd + [cond, path], os.path.join(cwd, 'unit%d' % i), 'partial.root'))
+    results = sorted(run_all(pool, jobs))
+
+    outputs = reduce_outputs(pool, [output for output, _ in results],
+                             lambda merged, parts: ['rates.exe', '-w', merged, 'merge', cond] + parts, cwd)
+    error = run(['rates.exe', 'merge', cond] + outputs, os.getcwd(), os.path.join(cwd, 'merge_log.txt'))
+    if error:
+        sys.exit(error)
+    return {'job': 'rates_' + cond, 'output': 'rates_%s.root' % tag, 'files': len(files), 'units': len(units),
+            'events': sum(report.get('events', 0) for _, report in results),
+            'goodEvents': sum(report.get('goodEvents', 0) for _, report in results),
+            'loopSeconds': sum(report.get('loopSeconds', 0.) for _, report in results)}
+
+
+def analysis(pool, cond, ntuples):
+    """l1analysis_<cond>.root, one unit per file, added up with hadd"""
+    tag = 'def' if cond == 'def' else 'new_cond'
+    output = 'l1analysis_%s.root' % tag
+    cwd = os.path.join(WORKDIR, 'analysis_' + cond)
+    files = sorted(glob.glob(os.path.join(ntuples, 'L1Ntuple_*.root')))
+    if not files:
+        sys.exit('no L1Ntuple_*.root in ' + ntuples)
+    print('l1jetanalysis %s: %d files on %d workers' % (cond, len(files), ARGS.jobs))
+    jobs = []
+    for i, path in enumerate(files):
+        cmd = ['l1jetanalysis.exe']
+        if ARGS.lumimask:
+            cmd += ['-l', os.path.abspath(ARGS.lumimask)]
+        jobs.append((cmd + [cond, path], os.path.join(cwd, 'unit%d' % i), output))
+    results = sorted(run_all(pool, jobs))
+
+    outputs = reduce_outputs(pool, [path for path, _ in results],
+                             lambda merged, parts: ['hadd', '-f', merged] + parts, cwd)
+    error = run(['hadd', '-f', os.path.join(os.getcwd(), output)] + outputs, cwd)
+    if error:
+        sys.exit(error)
+    return {'job': 'analysis_' + cond, 'output': output, 'files': len(files), 'units': len(files),
+            'events': sum(report.get('events', 0) for _, report in results),
+            'goodEvents': sum(report.get('goodEvents', 0) for _, report in results),
+            'loopSeconds': sum(report.get('loopSeconds', 0.) for _, report in results)}
+
+
+def main():
+    """every analysis for every condition, one after the other, each on all workers"""
+    if not ARGS.default and not ARGS.new:
+        PARSER.error('give -d and/or -n')
+    conditions = [(cond, ntuples) for cond, ntuples in [('def', ARGS.default), ('new', ARGS.new)] if ntuples]
+    if os.path.exists(WORKDIR):
+        shutil.rmtree(WORKDIR)
+    os.makedirs(WORKDIR)
+
+    pool = multiprocessing.Pool(ARGS.jobs)
+    summary = []
+    for cond, ntuples in conditions:
+        for name, step in [('rates', rates), ('analysis', analysis)]:
+            if name not in ANALYSES:
+                continue
+            start = time.time()
+            result = step(pool, cond, ntuples)
+            result['wall'] = time.time() - start
+            print('%s: %d events in %.1f s (%.0f events/s)' % (result['output'], result['events'], result['wall'],
+                                                             result['events'] / result['wall']))
+            summary.append(result)
+    pool.close()
+    pool.join()
+
+    with open('run_local.json', 'w') as out:
+        json.dump(summary, out, indent=2)
+    if not ARGS.keep:
+        shutil.rmtree(WORKDIR)
+
+
+main()
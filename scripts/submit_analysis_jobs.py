@@ -19,11 +19,11 @@ if(ARGS.default):
     cmd = BASECMD
     cmd += " -o def.log \'l1jetanalysis.exe def "
     cmd += ARGS.default
-    cmd += "; cp l1analysis_def.root '`pwd`"
+    cmd += "; cp l1analysis_def.root l1analysis_def.json '`pwd`"
     os.system(cmd)
 if(ARGS.new):
     cmd = BASECMD
     cmd += " -o new.log \'l1jetanalysis.exe new "
     cmd += ARGS.new
-    cmd += "; cp l1analysis_new_cond.root '`pwd`"
+    cmd += "; cp l1analysis_new_cond.root l1analysis_new_cond.json '`pwd`"
     os.system(cmd)
@@ -19,11 +19,11 @@ if(ARGS.default):
     cmd = BASECMD
     cmd += " -o def.log \'rates.exe def "
     cmd += ARGS.default
-    cmd += "; cp rates_def.root '`pwd`"
+    cmd += "; cp rates_def.root rates_def.json '`pwd`"
     os.system(cmd)
 if(ARGS.new):
     cmd = BASECMD
     cmd += " -o new.log \'rates.exe new "
     cmd += ARGS.new
-    cmd += "; cp rates_new_cond.root '`pwd`"
+    cmd += "; cp rates_new_cond.root rates_new_cond.json '`pwd`"
     os.system(cmd)